@@ -325,10 +325,11 @@ for val in "max_analysis_steps", "max_time", "max_real_time", "max_agents", "ini
 with open(INPUT_FILE_NAME + "-generated", "w") as f:
     yaml.dump(CONFIG, f)
 
+OUTPUT_DIRECTORY = CONFIG["output"].get("output_directory", "output")
 try:
-    os.mkdir('output') 
+    os.mkdir(OUTPUT_DIRECTORY) 
     print("hashkat_pre.py -- Created an output directory")
-    os.system('cp ./INFILE.yaml ./output/INFILE.yaml')
+    os.system('cp ./INFILE.yaml ./%s/INFILE.yaml' % OUTPUT_DIRECTORY)
     print("hashkat_pre.py -- Copied INFILE.yaml to output directory")
 except OSError:
     print "hashkat_pre.py -- An output directory already exists, leaving it intact"
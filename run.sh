@@ -71,6 +71,10 @@ Command line options for run.sh below:
 
 Configuration options:
     --input <FILE, default ./INFILE.yaml>, load network configuration options from the given input file (options for this file not discussed here).
+    --seed <N, default 1>, seed the random number generator with N.
+Ensemble options:
+    --ensemble <N>, run N simulations of the same configuration (with seeds S, S+1, ..., where S is given by --seed) in one process. Each writes to its own output/replica_NNN directory, and averages with confidence intervals are written to output/ensemble_*.
+    --threads <T, default all cores>, run at most T ensemble simulations at a time.
 Misc options:
     Running ./scripts/stop.sh will send a SIGUSR1 (user-defined signal) to the binary ‘hashkat’, in effect resulting in graceful termination of the program. This can never result in immediate termination.
     --no-ctrlc, do not handle Ctrl+C (note, results in immediate termination with Ctrl+C)"
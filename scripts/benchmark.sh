@@ -0,0 +1,58 @@
+#!/bin/bash
+
+# Measures the simulation speed, in KMC events per second, on quickstart_INFILE.yaml.
+# Every run performs the same number of events with the same seed, so
+# binaries built from different versions of the code can be compared:
+#
+#   scripts/benchmark.sh [--steps N] [--runs R] [hashkat binaries...]
+#
+# Defaults to build/src/hashkat, 1000000 events and the best of 3 runs.
+# Build with 'build.sh -O' for meaningful numbers.
+
+# Default HASHKAT to the repository root, check if unset (using a BASHism):
+if [ ! "$HASHKAT" ] ; then
+    export HASHKAT=$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)
+fi
+
+# Good practice -- exit completely on any bad exit code:
+set -e
+
+steps=1000000
+runs=3
+binaries=()
+while [ $# -gt 0 ] ; do
+    case "$1" in
+        --steps) steps="$2" ; shift 2 ;;
+        --runs) runs="$2" ; shift 2 ;;
+        *) binaries+=("$(cd "$(dirname "$1")" && pwd)/$(basename "$1")") ; shift ;;
+    esac
+done
+if [ ${#binaries[@]} -eq 0 ] ; then
+    binaries=("$HASHKAT/build/src/hashkat")
+fi
+
+# Run in a scratch directory, stopping after a fixed number of events rather than a fixed time:
+workdir=$(mktemp -d)
+trap "rm -rf '$workdir'" EXIT
+cd "$workdir"
+sed -e 's/^analysis:$/analysis:\n  max_analysis_steps:\n    '$steps'/' \
+    -e '/^  max_time:/{n;s/.*/    unlimited/}' \
+    -e '/^  max_real_time:/{n;s/.*/    unlimited/}' \
+    "$HASHKAT/quickstart_INFILE.yaml" > INFILE.yaml
+# Every run starts from scratch, and only the simulation loop is of interest:
+echo "
+output:
+  save_network_on_timeout: false
+  load_network_on_startup: false
+  stdout_summary: false" >> INFILE.yaml
+python "$HASHKAT/hashkat_pre.py" --input INFILE.yaml > /dev/null
+
+for binary in "${binaries[@]}" ; do
+    best=""
+    for run in $(seq $runs) ; do
+        # The time spent in the simulation loop, in milliseconds:
+        ms=$("$binary" --seed 1 --stdout-nobuffer 2> /dev/null | sed -n "s/^'analyzer_main' took \([0-9.]*\) milliseconds.*/\1/p")
+        best=$(echo "$ms $best" | awk '{ if ($2 == "" || $1 < $2) print $1; else print $2 }')
+    done
+    echo "$binary: $steps events in $best ms, $(echo "$steps $best" | awk '{ printf "%.0f", $1 / ($2 / 1000) }') events per second (best of $runs)"
+done
@@ -0,0 +1,101 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#ifndef AGENTACTIVITY_H_
+#define AGENTACTIVITY_H_
+
+#include <vector>
+
+#include "RateTree.h"
+
+/* AgentActivity:
+ The follow and tweet rates of every agent, for when the agents of a type and
+ creation month are not equally active (see 'activity_distribution' in
+ DEFAULT.yaml). Selecting the agent of a follow or tweet event is then a
+ descent of the channel's tree, in O(log N), instead of a pick among the
+ cohorts of the RateLedger.
+
+ The inner nodes of a RateTree only sum whole leaves, so each channel has
+ its own tree. An agent has the same leaf in both. */
+struct AgentActivity {
+    typedef RateTree<int, 1> AgentRateTree;
+
+    void clear() {
+        follow_tree = AgentRateTree();
+        tweet_tree = AgentRateTree();
+        leaves.clear();
+    }
+
+    // Add an agent, or change its rates if it was already added
+    void set_rates(int agent, double follow_rate, double tweet_rate) {
+        if (leaves.size() <= agent) {
+            leaves.resize(agent + 1, INVALID);
+        }
+        ref_t& leaf = leaves[agent];
+        if (leaf == INVALID) {
+            leaf = follow_tree.add(agent, RateVec<1>(follow_rate));
+            ref_t tweet_leaf = tweet_tree.add(agent, RateVec<1>(tweet_rate));
+            DEBUG_CHECK(tweet_leaf == leaf, "Activity trees out of step!");
+        } else {
+            follow_tree.replace_rate(leaf, RateVec<1>(follow_rate));
+            tweet_tree.replace_rate(leaf, RateVec<1>(tweet_rate));
+        }
+    }
+
+    double follow_rate() {
+        return follow_tree.rate_summary().tuple_sum;
+    }
+    double tweet_rate() {
+        return tweet_tree.rate_summary().tuple_sum;
+    }
+
+    // Select the agent of an event, with 'num' within [0, rate of the channel).
+    // Returns -1 if there are no agents.
+    int pick_follow(double num) {
+        return pick_weighted(follow_tree, num);
+    }
+    int pick_tweet(double num) {
+        return pick_weighted(tweet_tree, num);
+    }
+
+    size_t size() const {
+        return follow_tree.size();
+    }
+private:
+    enum {
+        INVALID = -1
+    };
+
+    static int pick_weighted(AgentRateTree& tree, double num) {
+        if (tree.size() == 0) {
+            return -1;
+        }
+        return tree.get(tree.pick_weighted(num)).data;
+    }
+
+    AgentRateTree follow_tree, tweet_tree;
+    std::vector<ref_t> leaves; // The leaf of each agent, by id, INVALID if not added
+};
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#ifndef ALIASTABLE_H_
+#define ALIASTABLE_H_
+
+#include <vector>
+#include <algorithm>
+
+#include "RandomStreams.h"
+
+/*
+ * Walker's alias method (with Vose's construction) for drawing from a fixed
+ * discrete distribution in O(1), regardless of the number of choices.
+ *
+ * Each of the n slots holds a probability and an alias. A draw picks a slot
+ * uniformly, then either the slot itself or its alias. Building is O(n), so
+ * this suits distributions that only change when a configuration is loaded;
+ * distributions that change as the simulation runs belong in a RateTree.
+ */
+struct AliasTable {
+    AliasTable() {
+    }
+    AliasTable(const double* weights, int n) {
+        build(weights, n);
+    }
+    AliasTable(const std::vector<double>& weights) {
+        build(weights);
+    }
+
+    /* Weights need not be normalized. Negative weights count as 0. */
+    void build(const double* weights, int n) {
+        slots.assign(n, Slot());
+        double total = 0;
+        for (int i = 0; i < n; i++) {
+            total += std::max(weights[i], 0.0);
+        }
+        ASSERT(n == 0 || total > 0, "Cannot build an alias table without positive weights!");
+
+        // Scale so that the average slot is exactly full, and split into under- and overfull slots
+        std::vector<int> small, large;
+        std::vector<double> scaled(n);
+        for (int i = 0; i < n; i++) {
+            scaled[i] = std::max(weights[i], 0.0) * n / total;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+        // Fill up each underfull slot with the remainder of an overfull one
+        while (!small.empty() && !large.empty()) {
+            int s = small.back(), l = large.back();
+            small.pop_back();
+            slots[s].prob = scaled[s];
+            slots[s].alias = l;
+            scaled[l] -= 1.0 - scaled[s];
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // Whatever remains is full, up to floating point error
+        for (int i : large) {
+            slots[i].prob = 1.0;
+            slots[i].alias = i;
+        }
+        for (int i : small) {
+            slots[i].prob = 1.0;
+            slots[i].alias = i;
+        }
+    }
+    void build(const std::vector<double>& weights) {
+        build(weights.empty() ? NULL : &weights[0], weights.size());
+    }
+
+    /* Draw a choice, with a single 53-bit random number */
+    int pick(RandomStream& rng) const {
+        DEBUG_CHECK(!slots.empty(), "Picking from an empty alias table!");
+        double num = rng.rand_real_not1() * slots.size();
+        int i = (int) num;
+        const Slot& slot = slots[i];
+        return (num - i < slot.prob) ? i : slot.alias;
+    }
+
+    size_t size() const {
+        return slots.size();
+    }
+    bool empty() const {
+        return slots.empty();
+    }
+private:
+    struct Slot {
+        double prob = 1.0; // Chance of choosing this slot, rather than its alias
+        int alias = 0;
+    };
+    std::vector<Slot> slots;
+};
+
+#endif
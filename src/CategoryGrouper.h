@@ -27,7 +27,11 @@
 
 #include "util.h"
 #include "serialization.h"
+#include "RandomStreams.h"
+#include "util/FenwickTree.h"
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 // Each category is defined with respect to a series of bounds
@@ -79,18 +83,50 @@ struct CategoryGrouper {
 			categorizations.resize(agent + 1);
 		}
 		Cat& c = categorizations.at(agent);
-		for (int i = 0; i < categories.size(); i++) {
-			CategoryAgentList& C = categories[i];
-			if (parameter <= C.threshold) {
-				if (i != c.category) {
-					// We have to move ourselves into the new list
-					remove(c);
-					c = add(agent, i);
-				}
-				return; // Categorized, done.
+		int i = locate(parameter, c.category);
+		if (i != -1 && i != c.category) {
+			// We have to move ourselves into the new list
+			remove(c);
+			c = add(agent, i);
+		}
+	}
+
+	/* The category that 'parameter' falls into, ie the first one whose
+	 * threshold is at least 'parameter', or -1 if there is none.
+	 * Parameters mostly change by one per event, so the category 'hint'
+	 * and its neighbours are tried first, in O(1). Otherwise, evenly spaced
+	 * thresholds are indexed directly and others are binary searched. */
+	int locate(double parameter, int hint = -1) {
+		int n = categories.size();
+		if (hint >= 0 && hint < n) {
+			if (fits(hint, parameter)) {
+				return hint;
+			}
+			if (hint + 1 < n && fits(hint + 1, parameter)) {
+				return hint + 1;
+			}
+			if (hint > 0 && fits(hint - 1, parameter)) {
+				return hint - 1;
 			}
 		}
-		DEBUG_CHECK(false, "Logic error");
+		ensure_spacing();
+		if (n_evenly_spaced > 1) {
+			double offset = std::ceil((parameter - first_threshold) / spacing);
+			int i = (int) std::max(0.0, std::min(offset, (double) n_evenly_spaced));
+			// Rounding may put us one category off, in which case we fall back to searching
+			if (i < n && fits(i, parameter)) {
+				return i;
+			}
+		}
+		auto it = std::lower_bound(categories.begin(), categories.end(), parameter,
+				[](const CategoryAgentList& C, double p) {
+			return C.threshold < p;
+		});
+		if (it == categories.end()) {
+			DEBUG_CHECK(false, "Logic error");
+			return -1;
+		}
+		return it - categories.begin();
 	}
 
 	/* Remove a categorized agent. */
@@ -103,11 +139,49 @@ struct CategoryGrouper {
 			c_top.index = c.index;
 			C.agents[c.index] = C.agents.back();
 			C.agents.pop_back();
+			adjust_weight(c.category, -C.prob);
 			// Reset:
 			c = Cat();
 		}
 	}
 
+	/* The weight of a category when picking agents preferentially */
+	double weight(int category) const {
+		const CategoryAgentList& C = categories.at(category);
+		return C.prob * C.size();
+	}
+	double total_weight() {
+		ensure_weights();
+		return weights.total();
+	}
+
+	/* Pick a category with probability proportional to its weight,
+	 * in O(log #categories). Returns -1 if all weights are zero. */
+	int pick_weighted_category(RandomStream& rng) {
+		ensure_weights();
+		double num = rng.rand_real_not1();
+		int i = weights.find(num * weights.total());
+		if (UNLIKELY(i >= categories.size() || categories[i].agents.empty())) {
+			// Floating point drift landed us on an empty category, recompute the sums
+			rebuild_weights();
+			i = weights.find(num * weights.total());
+			if (i >= categories.size() || categories[i].agents.empty()) {
+				return -1;
+			}
+		}
+		return i;
+	}
+	/* Pick an agent with probability proportional to the 'prob' of its category.
+	 * Returns -1 if there are no agents in categories of nonzero weight. */
+	int pick_weighted_agent(RandomStream& rng) {
+		int i = pick_weighted_category(rng);
+		if (i == -1) {
+			return -1;
+		}
+		CategoryAgentList& C = categories[i];
+		return C.agents[rng.rand_int(C.agents.size())];
+	}
+
 	/* Synchronize rates from a loaded configuration.
 	 * This is done because, although we can load a new configuration,
 	 * some rates remain duplicated in our state object. */
@@ -116,18 +190,103 @@ struct CategoryGrouper {
             categories[i].prob = C.categories[i].prob;
             categories[i].threshold = C.categories[i].threshold;
         }
+        rebuild_weights();
+        spacing_checked_for = 0;
+	}
+
+	/* Remove every agent, keeping the thresholds and probabilities of the categories. */
+	void clear_agents() {
+		categorizations.clear();
+		for (CategoryAgentList& C : categories) {
+			C.agents.clear();
+		}
+		rebuild_weights();
 	}
 
 	Cat add(int agent, int new_cat) {
 		CategoryAgentList& C = categories.at(new_cat);
 		C.agents.push_back(agent);
+		adjust_weight(new_cat, C.prob);
 		return Cat(new_cat, C.agents.size() - 1);
 	}
 
 	template <typename Archive>
     void serialize(Archive& ar) {
 	    ar(categorizations, categories);
+	    // The weights and the threshold spacing are rebuilt on first use
+	    weights = FenwickTree<double>();
+	    spacing_checked_for = 0;
 	}
+private:
+	// Whether 'parameter' falls into category i, given that the thresholds increase
+	bool fits(int i, double parameter) const {
+		return parameter <= categories[i].threshold
+				&& (i == 0 || parameter > categories[i - 1].threshold);
+	}
+
+	// Check whether the thresholds are evenly spaced, ignoring an infinite
+	// threshold that catches everything above them. Categories are only
+	// ever appended, so this is redone whenever their number changes.
+	void ensure_spacing() {
+		if (spacing_checked_for == categories.size()) {
+			return;
+		}
+		spacing_checked_for = categories.size();
+		n_evenly_spaced = 0;
+		int n = categories.size();
+		if (n > 0 && std::isinf(categories[n - 1].threshold)) {
+			n--;
+		}
+		if (n < 2) {
+			return;
+		}
+		first_threshold = categories[0].threshold;
+		spacing = categories[1].threshold - first_threshold;
+		if (!(spacing > 0)) {
+			return;
+		}
+		for (int i = 2; i < n; i++) {
+			if (categories[i].threshold != first_threshold + i * spacing) {
+				return;
+			}
+		}
+		n_evenly_spaced = n;
+	}
+
+	// Rebuild the weights from scratch after this many updates, bounding floating point drift
+	static const int REBUILD_INTERVAL = 1 << 16;
+
+	void rebuild_weights() {
+		std::vector<double> values(categories.size());
+		for (int i = 0; i < categories.size(); i++) {
+			values[i] = weight(i);
+		}
+		weights.assign(values);
+		updates_since_rebuild = 0;
+	}
+	// Categories are added while parsing the configuration, before any agents
+	void ensure_weights() {
+		if (weights.size() != categories.size()) {
+			rebuild_weights();
+		}
+	}
+	void adjust_weight(int category, double delta) {
+		if (weights.size() != categories.size() || ++updates_since_rebuild >= REBUILD_INTERVAL) {
+			rebuild_weights();
+		} else {
+			weights.add(category, delta);
+		}
+	}
+
+	// The weight of each category, for picking agents preferentially. Not serialized.
+	FenwickTree<double> weights;
+	int updates_since_rebuild = 0;
+
+	// The thresholds of the first 'n_evenly_spaced' categories are
+	// first_threshold + i * spacing, or n_evenly_spaced is 0. Not serialized.
+	size_t spacing_checked_for = 0;
+	int n_evenly_spaced = 0;
+	double first_threshold = 0, spacing = 0;
 };
 
 #endif
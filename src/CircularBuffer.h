@@ -25,6 +25,7 @@
 #define CIRCULARBUFFER_H_
 
 #include "util.h"
+#include "RandomStreams.h"
 #include <algorithm>
 
 // CircularBuffer implements a buffer that deletes the oldest element
@@ -82,7 +83,7 @@ public:
     bool empty() {
        return (start == end);
     }
-    T pick_random_uniform(MTwist& rng) {
+    T pick_random_uniform(RandomStream& rng) {
     	T temp[cap];
     	int n = copy(temp);
         return temp[rng.rand_int(n)];
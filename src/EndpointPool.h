@@ -0,0 +1,125 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#ifndef ENDPOINTPOOL_H_
+#define ENDPOINTPOOL_H_
+
+#include <vector>
+
+#include "util.h"
+#include "RandomStreams.h"
+
+/*
+ * The pool of follow endpoints, for exact linear preferential attachment.
+ * An agent has one entry in the pool for itself, and one more for each of
+ * its followers, so that a uniform pick from the pool chooses an agent with
+ * probability proportional to its number of followers + 1.
+ *
+ * The entries of an agent form a doubly linked list through the pool, so
+ * that adding, removing (by moving the last entry into the hole) and picking
+ * are all O(1), without a container per agent.
+ */
+struct EndpointPool {
+    /* Add an entry for 'agent' */
+    void add(int agent) {
+        if (agent >= heads.size()) {
+            heads.resize(agent + 1, -1);
+        }
+        int index = entries.size();
+        entries.push_back(Entry(agent, -1, heads[agent]));
+        if (heads[agent] != -1) {
+            entries[heads[agent]].prev = index;
+        }
+        heads[agent] = index;
+    }
+
+    /* Remove one entry of 'agent', returning false if it had none */
+    bool remove(int agent) {
+        if (agent >= heads.size() || heads[agent] == -1) {
+            return false;
+        }
+        int hole = heads[agent];
+        unlink(hole);
+        int last = entries.size() - 1;
+        if (hole != last) {
+            move(last, hole);
+        }
+        entries.pop_back();
+        return true;
+    }
+
+    /* An agent chosen in proportion to its number of entries, -1 if the pool is empty */
+    int pick_random_uniform(RandomStream& rng) const {
+        if (UNLIKELY(entries.empty())) {
+            return -1;
+        }
+        return entries[rng.rand_int(entries.size())].agent;
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+    void clear() {
+        entries.clear();
+        heads.clear();
+    }
+private:
+    struct Entry {
+        int agent;
+        int prev, next; // The neighbouring entries of the same agent, -1 for none
+        Entry(int agent, int prev, int next) :
+                agent(agent), prev(prev), next(next) {
+        }
+    };
+
+    void unlink(int index) {
+        Entry& e = entries[index];
+        if (e.prev != -1) {
+            entries[e.prev].next = e.next;
+        } else {
+            heads[e.agent] = e.next;
+        }
+        if (e.next != -1) {
+            entries[e.next].prev = e.prev;
+        }
+    }
+    // Move an entry to another index, keeping its list intact
+    void move(int from, int to) {
+        Entry& e = entries[to];
+        e = entries[from];
+        if (e.prev != -1) {
+            entries[e.prev].next = to;
+        } else {
+            heads[e.agent] = to;
+        }
+        if (e.next != -1) {
+            entries[e.next].prev = to;
+        }
+    }
+
+    std::vector<Entry> entries;
+    std::vector<int> heads; // The first entry of each agent, -1 for none
+};
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#ifndef EVENTRATETREE_H_
+#define EVENTRATETREE_H_
+
+#include "RateTree.h"
+
+/* The event channels of the KMC loop.
+ * A new kind of event needs an entry here, and an action in Analyzer::event_actions. */
+enum EventType {
+    EVENT_ADD,
+    EVENT_FOLLOW,
+    EVENT_TWEET,
+    EVENT_RETWEET,
+    N_EVENT_TYPES
+};
+
+/* EventRateTree:
+ The top level of event selection. Each event channel is a leaf holding the
+ channel's total rate. The candidates within a channel (agents, tweets) are
+ selected by continuing the descent with the remainder of the same draw. */
+struct EventRateTree {
+    EventRateTree() {
+        for (int i = 0; i < N_EVENT_TYPES; i++) {
+            refs[i] = tree.add(i, RateVec<1>(0.0));
+        }
+    }
+
+    double rate(EventType type) {
+        return tree.get(refs[type]).rates.tuple_sum;
+    }
+
+    double total_rate() {
+        return tree.rate_summary().tuple_sum;
+    }
+
+    // Call sync_total() once all channels are set
+    void set_rate(EventType type, double rate) {
+        tree.replace_rate(refs[type], RateVec<1>(rate));
+    }
+
+    void sync_total() {
+        tree.resum_rates();
+    }
+
+    /* Choose an event channel, with 'num' drawn from [0, total_rate()).
+     * On return 'num' is the remainder within the channel, in [0, rate(type)]. */
+    EventType pick_weighted(double& num) {
+        return (EventType) tree.get(tree.pick_weighted(num)).data;
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        for (int i = 0; i < N_EVENT_TYPES; i++) {
+            double channel_rate = rate((EventType) i);
+            ar(channel_rate);
+            set_rate((EventType) i, channel_rate);
+        }
+        sync_total();
+    }
+
+private:
+    RateTree<int, 1, N_EVENT_TYPES> tree;
+    ref_t refs[N_EVENT_TYPES];
+};
+
+#endif
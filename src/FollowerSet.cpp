@@ -55,7 +55,7 @@ int LanguageLayer::classify(Agent& agent) {
 
 /*****************************************************************************
  * add implementation:
- * The leaf layer inserts to a HashedEdgeSet, while the parent layers
+ * The leaf layer inserts to a SmallEdgeSet, while the parent layers
  * delegate insertion to child layers.
  *
  *****************************************************************************/
@@ -82,11 +82,14 @@ static bool add_follower(LeafLayer& layer, Agent& agent) {
 template <typename Layer>
 static bool add_follower(Layer& layer, Agent& agent) {
     auto& sub = layer.sublayers[classify(layer, agent)];
-     if (add_follower(sub, agent)) {
-         layer.n_elems++;
-         return true;
-     }
-     return false;
+    if (!sub) {
+        sub.reset(new typename Layer::ChildLayer());
+    }
+    if (add_follower(*sub, agent)) {
+        layer.n_elems++;
+        return true;
+    }
+    return false;
 }
 
 bool FollowerSet::add(Agent& agent) {
@@ -95,7 +98,7 @@ bool FollowerSet::add(Agent& agent) {
 
 /*****************************************************************************
  * remove implementation:
- * The leaf layer removes from a HashedEdgeSet, while the parent layers
+ * The leaf layer removes from a SmallEdgeSet, while the parent layers
  * delegate removal to child layers.
  *****************************************************************************/
 
@@ -113,7 +116,10 @@ static bool remove_follower(LeafLayer& layer, Agent& agent) {
 template <typename Layer>
 static bool remove_follower(Layer& layer, Agent& agent) {
     auto& sub = layer.sublayers[layer.classify(agent)];
-    if (remove_follower(sub, agent)) {
+    if (sub && remove_follower(*sub, agent)) {
+        if (sub->n_elems == 0) {
+            sub.reset(); // Empty categories are not kept around
+        }
         layer.n_elems--;
         return true;
     }
@@ -128,21 +134,25 @@ bool FollowerSet::remove(Agent& agent) {
  * pick_random_weighted implementation:
  *****************************************************************************/
 
-// Leaf layer specialization
-static bool pick_weighted(MTwist& rng, LeafLayer& layer, LeafLayer::Weights& weights, int& id) {
-    int bin = rng.kmc_select(weights.weights, LeafLayer::N_SUBLAYERS);
-    return layer.sublayers[bin].pick_random_uniform(rng, id);
-}
-
-// Parent layers template
-template <typename Layer>
-static bool pick_weighted(MTwist& rng, Layer& layer, typename Layer::Weights& weights, int& id) {
-    int bin = rng.kmc_select(weights.weights, Layer::N_SUBLAYERS);
-    return pick_weighted(rng, layer.sublayers[bin], weights.subweights[bin], id);
-}
-
-bool FollowerSet::pick_random_weighted(MTwist rng, Weights& weights, int& id) {
-    return pick_weighted(rng, followers, weights, id);
+bool FollowerSet::pick_random_weighted(RandomStream& rng, const Weights& weights, int& id) {
+    if (weights.empty()) {
+        return false;
+    }
+    // One draw over the cumulative weights selects the leaf set:
+    int leaf = weights.find_leaf(rng.rand_real_not1() * weights.cells.back().cumulative);
+    int i_ideo = leaf % N_BIN_IDEOLOGIES;
+    leaf /= N_BIN_IDEOLOGIES;
+    int i_region = leaf % N_BIN_REGIONS;
+    leaf /= N_BIN_REGIONS;
+    int i_pref = leaf % N_BIN_PREFERENCE_CLASS;
+    int lang = leaf / N_BIN_PREFERENCE_CLASS;
+    // The category may have lost its followers since the weights were determined
+    auto& prefs = followers.sublayers[lang];
+    if (!prefs || !prefs->sublayers[i_pref] || !prefs->sublayers[i_pref]->sublayers[i_region]) {
+        return false;
+    }
+    auto& set = prefs->sublayers[i_pref]->sublayers[i_region]->sublayers[i_ideo];
+    return set.pick_random_uniform(rng, id);
 }
 
 /*****************************************************************************
@@ -150,7 +160,7 @@ bool FollowerSet::pick_random_weighted(MTwist rng, Weights& weights, int& id) {
  *****************************************************************************/
 
 // Leaf layer specialization
-static bool pick_uniform(MTwist& rng, LeafLayer& layer, int& id) {
+static bool pick_uniform(RandomStream& rng, LeafLayer& layer, int& id) {
     int R = rng.rand_int(layer.n_elems);
     for (auto& sublayer : layer.sublayers) {
         R -= sublayer.size();
@@ -163,18 +173,21 @@ static bool pick_uniform(MTwist& rng, LeafLayer& layer, int& id) {
 
 // Parent layers template
 template <typename Layer>
-static bool pick_uniform(MTwist& rng, Layer& layer, int& id) {
+static bool pick_uniform(RandomStream& rng, Layer& layer, int& id) {
     int R = rng.rand_int(layer.n_elems);
     for (auto& sublayer : layer.sublayers) {
-        R -= sublayer.n_elems;
+        if (!sublayer) {
+            continue;
+        }
+        R -= sublayer->n_elems;
         if (R < 0) {
-            return pick_uniform(rng, sublayer, id);
+            return pick_uniform(rng, *sublayer, id);
         }
     }
     return false;
 }
 
-bool FollowerSet::pick_random_uniform(MTwist& rng, int& id) {
+bool FollowerSet::pick_random_uniform(RandomStream& rng, int& id) {
     return pick_uniform(rng, followers, id);
 }
 
@@ -206,12 +219,12 @@ static void print_layer(Layer& layer, int depth) {
     for (int i = 0; i < Layer::N_SUBLAYERS; i++) {
         string repr = format("%s (Bin %d)", cpp_type_name(layer).c_str(), i);
         auto& sublayer = layer.sublayers[i];
-        if (sublayer.n_elems > 0) {
+        if (sublayer) {
             for (int i = 0; i < depth; i++) {
                 printf("  ");
             }
-            printf("[%s] (N_elems %d)\n", repr.c_str(), sublayer.n_elems);
-            print_layer(sublayer, depth + 1);
+            printf("[%s] (N_elems %d)\n", repr.c_str(), sublayer->n_elems);
+            print_layer(*sublayer, depth + 1);
         }
     }
 }
@@ -229,15 +242,15 @@ void FollowerSet::post_load(AnalysisState& state) {
     serialization_cache = NULL;
 }
 
-double FollowerSet::determine_tweet_weights(Agent& author, TweetContent& content, WeightDeterminer& d_root, /*Weights placed here:*/ Weights& w_root) {
+double FollowerSet::determine_tweet_weights(Agent& author, TweetContent& content, WeightDeterminer& d_root, /*Weights placed here:*/ Weights& output) {
     PERF_TIMER();
-    // Weights are assumed to start 0-initialized.
+    // Weights are assumed to start empty.
 
     auto& f_root = followers;
 
     DEBUG_CHECK(content.language != LANG_FRENCH_AND_ENGLISH, "Invalid tweet language!");
 
-    double total = 0;
+    double total = 0, cumulative = 0;
     // Language spoken:
     for (int lang = 0; lang < N_LANGS; lang++) {
 
@@ -246,18 +259,15 @@ double FollowerSet::determine_tweet_weights(Agent& author, TweetContent& content
         }
         double incr0 = 0;
         auto& f_prefs = f_root.sublayers[lang];
-        for (int i_pref = 0; i_pref < N_BIN_PREFERENCE_CLASS; i_pref++) {
-            auto& f_regions = f_prefs.sublayers[i_pref];
-            auto& w_regions = w_root.subweights[i_pref];
+        for (int i_pref = 0; f_prefs && i_pref < N_BIN_PREFERENCE_CLASS; i_pref++) {
+            auto& f_regions = f_prefs->sublayers[i_pref];
 
             double incr1 = 0;
-            for (int i_region = 0; i_region < N_BIN_REGIONS; i_region++) {
-                auto& f_bins = f_regions.sublayers[i_region];
-                auto& w_bins = w_regions.subweights[i_region];
+            for (int i_region = 0; f_regions && i_region < N_BIN_REGIONS; i_region++) {
+                auto& f_bins = f_regions->sublayers[i_region];
                 double incr2 = 0;
-                for (int i_ideo = 0; i_ideo < N_BIN_IDEOLOGIES; i_ideo++) {
-                    auto& f_leaf = f_bins.sublayers[i_ideo];
-                    auto& w_leaf = w_bins.subweights[i_ideo];
+                for (int i_ideo = 0; f_bins && i_ideo < N_BIN_IDEOLOGIES; i_ideo++) {
+                    auto& f_leaf = f_bins->sublayers[i_ideo];
                     TweetType type = content.type;
 
                     if (type == TWEET_IDEOLOGICAL && i_ideo == content.ideology_bin) {
@@ -266,19 +276,21 @@ double FollowerSet::determine_tweet_weights(Agent& author, TweetContent& content
                     double weight = d_root.weights[i_pref][type][author.agent_type];
 
                     double incr3 = weight * f_leaf.size();
-                    w_leaf.weights[i_ideo] += incr3;
+                    if (incr3 > 0) {
+                        cumulative += incr3;
+                        int leaf = ((lang * N_BIN_PREFERENCE_CLASS + i_pref) * N_BIN_REGIONS + i_region) * N_BIN_IDEOLOGIES + i_ideo;
+                        output.cells.push_back({(react_weight_t) cumulative, (unsigned short) leaf});
+                    }
                     incr2 += incr3;
                 }
-                w_bins.weights[i_region] += incr2;
                 incr1 += incr2;
             }
-            w_regions.weights[i_pref] += incr1;
             incr0 += incr1;
         }
 
-        w_root.weights[lang] += incr0;
         total += incr0;
     }
 
+    output.total = total;
     return total;
 }
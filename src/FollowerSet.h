@@ -29,9 +29,10 @@
 #include <vector>
 #include <functional>
 #include <cmath>
+#include <memory>
 #include "util.h"
 
-#include "util/HashedEdgeSet.h"
+#include "util/SmallEdgeSet.h"
 
 // For bin limits:
 #include "config_static.h"
@@ -52,50 +53,39 @@ struct TweetContent;
  *   Agent preference class
  *   X Tweet type (for ideological tweets, whether ideologies match)
  *   X Original tweeter agent type
+ *
+ * A category is only allocated while it has followers, and the leaf sets
+ * keep their first few followers inline (most agents have few followers).
  *****************************************************************************/
 
 // Leaf layer
 struct IdeologyLayer {
     static const int N_SUBLAYERS = N_BIN_IDEOLOGIES;
 
-    struct Weights {
-        double weights[N_SUBLAYERS] = {0};
-    };
-
     static int classify(Agent& agent);
 
     int n_elems = 0; // Total
-    HashedEdgeSet<int> sublayers[N_SUBLAYERS];
+    SmallEdgeSet<int> sublayers[N_SUBLAYERS];
 };
 
 struct RegionLayer {
     typedef IdeologyLayer ChildLayer;
     static const int N_SUBLAYERS = N_BIN_REGIONS;
 
-    struct Weights {
-        ChildLayer::Weights subweights[N_SUBLAYERS];
-        double weights[N_SUBLAYERS] = {0};
-    };
-
     static int classify(Agent& agent);
 
     int n_elems = 0; // Total
-    ChildLayer sublayers[N_SUBLAYERS];
+    std::unique_ptr<ChildLayer> sublayers[N_SUBLAYERS]; // NULL while empty
 };
 
 struct PreferenceClassLayer {
     typedef RegionLayer ChildLayer;
     static const int N_SUBLAYERS = N_BIN_PREFERENCE_CLASS;
 
-    struct Weights {
-        ChildLayer::Weights subweights[N_SUBLAYERS];
-        double weights[N_SUBLAYERS] = {0};
-    };
-
     static int classify(Agent& agent);
 
     int n_elems = 0; // Total
-    ChildLayer sublayers[N_SUBLAYERS];
+    std::unique_ptr<ChildLayer> sublayers[N_SUBLAYERS]; // NULL while empty
 };
 
 // Top layer
@@ -103,23 +93,59 @@ struct LanguageLayer {
     typedef PreferenceClassLayer ChildLayer;
     static const int N_SUBLAYERS = N_LANGS;
 
-    struct Weights {
-        ChildLayer::Weights subweights[N_SUBLAYERS];
-        double weights[N_SUBLAYERS] = {0};
-        template <typename Archive>
-        void save(Archive& ar) const {
-            ar.saveBinary(this, sizeof(*this));
-        }
+    static int classify(Agent& agent);
+
+    int n_elems = 0; // Total
+    std::unique_ptr<ChildLayer> sublayers[N_SUBLAYERS]; // NULL while empty
+};
+
+/*****************************************************************************
+ * Reaction weights of a tweet:
+ * The weight with which each leaf set of the follower set (one language,
+ * preference class, region and ideology) reacts to a tweet. Only the
+ * non-empty leaves with a non-zero weight are stored, in follower set order,
+ * with the running total of the weights up to and including them.
+ *****************************************************************************/
+
+struct ReactWeights {
+    static const int N_LEAVES = N_LANGS * N_BIN_PREFERENCE_CLASS * N_BIN_REGIONS * N_BIN_IDEOLOGIES;
+    static_assert(N_LEAVES <= 0xFFFF, "Leaf index must fit in a Cell!");
+
+    struct Cell {
+        react_weight_t cumulative;
+        unsigned short leaf; // Index into the flattened layers, language outermost
+
         template <typename Archive>
-        void load(Archive& ar) {
-            ar.loadBinary(this, sizeof(*this));
+        void serialize(Archive& ar) {
+            ar(cumulative, leaf);
         }
     };
 
-    static int classify(Agent& agent);
+    std::vector<Cell> cells;
+    double total = 0; // Kept in double, as the tweet's reaction rate
 
-    int n_elems = 0; // Total
-    ChildLayer sublayers[N_SUBLAYERS];
+    bool empty() const {
+        return cells.empty();
+    }
+
+    // The leaf that a number in [0, total) falls into
+    int find_leaf(double num) const {
+        int lo = 0, hi = (int) cells.size() - 1;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (num < cells[mid].cumulative) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return cells[lo].leaf;
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        ar(NVP(total), NVP(cells));
+    }
 };
 
 /*****************************************************************************
@@ -129,7 +155,7 @@ struct LanguageLayer {
 struct FollowerSet {
     const static int MAGIC_CONSTANT_BEFORE_SERIALIZATION = 0xbadbeef;
     typedef LanguageLayer TopLayer;
-    typedef TopLayer::Weights Weights;
+    typedef ReactWeights Weights;
 
     // Weights for determining whether a tweet has a reaction (follow/retweet).
     // Note that this is primarily decided by a tweet type, observer preference class,
@@ -151,13 +177,19 @@ struct FollowerSet {
         // Reach into all the layers:
         auto& a = followers;
         for (auto& b : a.sublayers) {
-            for (auto& c : b.sublayers) {
-                for (auto& d : c.sublayers) {
-                    for (HashedEdgeSet<int>& set : d.sublayers) {
-                        HashedEdgeSet<int>::iterator iter;
-                        while (set.iterate(iter)) {
-                            func(iter.get());
-                        }
+            if (!b) {
+                continue;
+            }
+            for (auto& c : b->sublayers) {
+                if (!c) {
+                    continue;
+                }
+                for (auto& d : c->sublayers) {
+                    if (!d) {
+                        continue;
+                    }
+                    for (SmallEdgeSet<int>& set : d->sublayers) {
+                        set.for_each(func);
                     }
                 }
             }
@@ -165,6 +197,7 @@ struct FollowerSet {
     }
     std::vector<int> as_vector() {
         std::vector<int> vec;
+        vec.reserve(size());
         for_each([&](int agent_id) {
             vec.push_back(agent_id);
         });
@@ -178,10 +211,10 @@ struct FollowerSet {
     bool remove(Agent& agent);
 
     /* Returns an element, provided the given weights */
-    bool pick_random_weighted(MTwist rng, Weights& weights, int& id);
+    bool pick_random_weighted(RandomStream& rng, const Weights& weights, int& id);
 
     /* Returns an element, weighing all options equally */
-    bool pick_random_uniform(MTwist& rng, int& id);
+    bool pick_random_uniform(RandomStream& rng, int& id);
 
     void print();
 
@@ -189,6 +222,10 @@ struct FollowerSet {
         return followers.n_elems;
     }
 
+    void clear() {
+        followers = TopLayer();
+    }
+
     double determine_tweet_weights(Agent& author, TweetContent& content, WeightDeterminer& determiner, /*Weights placed here: */ Weights& output);
 
     // Do a 'flexible' serialization, upholding semantic meaning but not exact binary compability, allowing for reloading differing configs. 
@@ -29,13 +29,13 @@
 #include "events.h"
 #include "config_static.h"
 
-#include "util/HashedEdgeSet.h"
+#include "util/DenseEdgeSet.h"
 
 // Forward declare, to prevent circular header inclusion:
 struct AnalysisState;
 
 struct FollowingSet {
-    typedef HashedEdgeSet<int> Followings;
+    typedef DenseEdgeSet<int> Followings;
 
     void print(AnalysisState& S);
 
@@ -56,7 +56,7 @@ struct FollowingSet {
     }
 
     // No such thing as pick_random_weighted for FollowingSet
-    bool pick_random_uniform(MTwist& rng, int& id) {
+    bool pick_random_uniform(RandomStream& rng, int& id) {
         return implementation.pick_random_uniform(rng, id);
     }
 
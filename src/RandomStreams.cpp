@@ -0,0 +1,69 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#include <cmath>
+
+#include "RandomStreams.h"
+
+int RandomStream::rand_poisson(double mean) {
+    if (mean <= 0) {
+        return 0;
+    }
+    if (mean < 10) {
+        // Multiply uniforms until the product drops below exp(-mean)
+        double limit = exp(-mean), product = rand_real_not0();
+        int k = 0;
+        while (product > limit) {
+            k++;
+            product *= rand_real_not0();
+        }
+        return k;
+    }
+    // W. Hormann, The transformed rejection method for generating Poisson random variables (1993)
+    double smu = sqrt(mean), log_mean = log(mean);
+    double b = 0.931 + 2.53 * smu;
+    double a = -0.059 + 0.02483 * b;
+    double inv_alpha = 1.1239 + 1.1328 / (b - 3.4);
+    double v_r = 0.9277 - 3.6224 / (b - 2);
+    while (true) {
+        double u = rand_real_not1() - 0.5;
+        double v = rand_real_not0();
+        double us = 0.5 - fabs(u);
+        double k = floor((2 * a / us + b) * u + mean + 0.43);
+        if (us >= 0.07 && v <= v_r) {
+            return (int) k;
+        }
+        if (k < 0 || (us < 0.013 && v > us)) {
+            continue;
+        }
+        if (log(v) + log(inv_alpha) - log(a / (us * us) + b) <= -mean + k * log_mean - lgamma(k + 1)) {
+            return (int) k;
+        }
+    }
+}
+
+double RandomStream::rand_normal() {
+    double radius = sqrt(-2 * log(rand_real_not0()));
+    return radius * cos(2 * M_PI * rand_real_not1());
+}
@@ -0,0 +1,342 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#ifndef RANDOMSTREAMS_H_
+#define RANDOMSTREAMS_H_
+
+#include <vector>
+#include <stdint.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "util.h"
+
+/*
+ * Counter-based random number generation (Philox4x32-10, Salmon et al.,
+ * "Parallel random numbers: as easy as 1, 2, 3", SC11).
+ *
+ * Every output is a pure function of (key, counter), so a stream is just a
+ * key and a position. Streams hold no large state, can jump to any position
+ * in O(1), and two streams with different keys never overlap. This lets each
+ * subsystem and each region partition draw from its own stream without the
+ * draws of one perturbing another.
+ */
+
+namespace philox {
+    const uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+    const uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+    const int N_ROUNDS = 10;
+
+    /* Encrypt the 128-bit counter 'ctr' under 'key' in place. */
+    inline void block(uint32_t ctr[4], const uint32_t key[2]) {
+        uint32_t k0 = key[0], k1 = key[1];
+        for (int round = 0; round < N_ROUNDS; round++) {
+            uint64_t p0 = (uint64_t) M0 * ctr[0];
+            uint64_t p1 = (uint64_t) M1 * ctr[2];
+            uint32_t c1 = ctr[1], c3 = ctr[3];
+            ctr[0] = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+            ctr[1] = (uint32_t) p1;
+            ctr[2] = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+            ctr[3] = (uint32_t) p0;
+            k0 += W0;
+            k1 += W1;
+        }
+    }
+
+#ifdef __SSE2__
+    /* High and low halves of the lane-wise 32x32-bit products a * m */
+    inline void mul_hi_lo(__m128i a, __m128i m, __m128i& hi, __m128i& lo) {
+        const __m128i LOW = _mm_set_epi32(0, ~0, 0, ~0);
+        __m128i even = _mm_mul_epu32(a, m); // Lanes 0 and 2, as 64-bit products
+        __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m); // Lanes 1 and 3
+        lo = _mm_or_si128(_mm_and_si128(even, LOW), _mm_slli_epi64(odd, 32));
+        hi = _mm_or_si128(_mm_srli_epi64(even, 32), _mm_andnot_si128(LOW, odd));
+    }
+
+    /* Four consecutive blocks at once, one block per SSE lane. Gives the same
+     * words as 'block' on each counter {first_block + i, partition}. */
+    inline void blocks4(uint32_t out[16], uint64_t first_block, uint32_t partition, const uint32_t key[2]) {
+        uint32_t lo[4], hi[4];
+        for (int i = 0; i < 4; i++) {
+            lo[i] = (uint32_t) (first_block + i);
+            hi[i] = (uint32_t) ((first_block + i) >> 32);
+        }
+        __m128i c0 = _mm_loadu_si128((__m128i*) lo), c1 = _mm_loadu_si128((__m128i*) hi);
+        __m128i c2 = _mm_set1_epi32(partition), c3 = _mm_setzero_si128();
+        const __m128i m0 = _mm_set1_epi32(M0), m1 = _mm_set1_epi32(M1);
+        uint32_t k0 = key[0], k1 = key[1];
+        for (int round = 0; round < N_ROUNDS; round++) {
+            __m128i hi0, lo0, hi1, lo1;
+            mul_hi_lo(c0, m0, hi0, lo0);
+            mul_hi_lo(c2, m1, hi1, lo1);
+            c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32(k0));
+            c1 = lo1;
+            c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32(k1));
+            c3 = lo0;
+            k0 += W0;
+            k1 += W1;
+        }
+        // Transpose from one word per register to one block per register
+        __m128i t0 = _mm_unpacklo_epi32(c0, c1), t1 = _mm_unpacklo_epi32(c2, c3);
+        __m128i t2 = _mm_unpackhi_epi32(c0, c1), t3 = _mm_unpackhi_epi32(c2, c3);
+        _mm_storeu_si128((__m128i*) (out + 0), _mm_unpacklo_epi64(t0, t1));
+        _mm_storeu_si128((__m128i*) (out + 4), _mm_unpackhi_epi64(t0, t1));
+        _mm_storeu_si128((__m128i*) (out + 8), _mm_unpacklo_epi64(t2, t3));
+        _mm_storeu_si128((__m128i*) (out + 12), _mm_unpackhi_epi64(t2, t3));
+    }
+#endif
+
+    /* Fill 'out' with the words of 'n_blocks' consecutive blocks, starting at counter {first_block, partition}. */
+    inline void fill(uint32_t* out, int n_blocks, uint64_t first_block, uint32_t partition, const uint32_t key[2]) {
+        int n_scalar = n_blocks;
+#ifdef __SSE2__
+        n_scalar = n_blocks % 4;
+        for (int i = 0; i < n_blocks - n_scalar; i += 4) {
+            blocks4(out + i * 4, first_block + i, partition, key);
+        }
+#endif
+        for (int i = n_blocks - n_scalar; i < n_blocks; i++) {
+            uint32_t* ctr = out + i * 4;
+            ctr[0] = (uint32_t) (first_block + i);
+            ctr[1] = (uint32_t) ((first_block + i) >> 32);
+            ctr[2] = partition;
+            ctr[3] = 0;
+            block(ctr, key);
+        }
+    }
+}
+
+/*
+ * A single named stream of 32-bit random words. The word at position 'p'
+ * is lane p % 4 of the Philox block at counter {p / 4, partition}, under
+ * the key {seed, stream id}.
+ *
+ * The words are generated BUFFER_WORDS at a time, so that a draw is usually
+ * just a load and a (well predicted) bounds check.
+ *
+ * Offers the same interface as MTwist, so it can be used wherever the
+ * simulation drew from the shared Mersenne twister before.
+ */
+class RandomStream {
+public:
+    RandomStream() {
+        init(0, 0, 0);
+    }
+    RandomStream(uint32_t seed, uint32_t stream, uint32_t partition = 0) {
+        init(seed, stream, partition);
+    }
+
+    void init(uint32_t seed, uint32_t stream, uint32_t partition = 0) {
+        key[0] = seed;
+        key[1] = stream;
+        this->partition = partition;
+        seek(0);
+    }
+
+    /* Jump to the given word of the stream. */
+    void seek(uint64_t position) {
+        buffer_start = position & ~(uint64_t) (BUFFER_WORDS - 1);
+        index = (int) (position - buffer_start);
+        fill_buffer();
+    }
+    /* The number of words drawn from the stream so far (or the last seek target) */
+    uint64_t tell() const {
+        return buffer_start + index;
+    }
+
+    /* generates a random number on [0,0xffffffff]-interval */
+    uint32_t genrand_int32() {
+        if (UNLIKELY(index == BUFFER_WORDS)) {
+            buffer_start += BUFFER_WORDS;
+            index = 0;
+            fill_buffer();
+        }
+        return buffer[index++];
+    }
+
+    /* generates a random number on [0,0x7fffffff]-interval */
+    int genrand_int31() {
+        return (int) (genrand_int32() >> 1);
+    }
+
+    /* generates a random number on [0,1]-real-interval */
+    double genrand_real1() {
+        return genrand_int32() * (1.0 / 4294967295.0);
+    }
+
+    /* generates a random number on [0,1) with 53-bit resolution*/
+    double genrand_res53() {
+        uint32_t a, b;
+        if (LIKELY(index <= BUFFER_WORDS - 2)) {
+            a = buffer[index], b = buffer[index + 1];
+            index += 2;
+        } else {
+            a = genrand_int32();
+            b = genrand_int32();
+        }
+        a >>= 5, b >>= 6;
+        return (a * 67108864.0 + b) * (1.0 / 9007199254740992.0);
+    }
+
+    // Returns a number from 0 to n (excluding n)
+    int rand_int(int max) {
+        // Avoids the modulo-bias problem. Translation of Java's Random.nextInt implementation.
+        int raw = genrand_int31();
+
+        if ((max & -max) == max) { // i.e., max is a power of 2
+            return (int) ((max * (long long) raw) >> 31);
+        }
+
+        int val = raw % max;
+        while (raw - val + (max - 1) < 0) {
+            raw = genrand_int31();
+            val = raw % max;
+        }
+
+        return val;
+    }
+    int rand_int(int min, int max) {
+        int range = max - min;
+        DEBUG_CHECK(range != 0, "Cannot make random decision when min == max.");
+        return rand_int(range) + min;
+    }
+
+    // Makes a choice given a profile of probabilities
+    int kmc_select(double* start, int len) {
+        double num = genrand_real1();
+        for (int i = 0; i < len; i++) {
+            if (num <= start[i]) {
+                return i;
+            }
+            num -= start[i];
+        }
+        return len - 1; // Assume floating point error
+    }
+    int kmc_select(std::vector<double>& probs) {
+        return kmc_select(&probs[0], probs.size());
+    }
+
+    /* Grab a real number within [0,1) with 53-bit resolution */
+    double rand_real_not1() {
+        return genrand_res53();
+    }
+    /* Grab a real number within (0,1] with 53-bit resolution */
+    double rand_real_not0() {
+        return 1.0 - rand_real_not1();
+    }
+
+    template <typename T>
+    T pick_random_uniform(const std::vector<T>& vec) {
+        int n = rand_int(vec.size());
+        return vec[n];
+    }
+
+    /* Draws the number of events of a Poisson process with the given expected
+     * count. Multiplication method for small means, Hormann's transformed
+     * rejection (PTRS) otherwise. Implemented in RandomStreams.cpp. */
+    int rand_poisson(double mean);
+
+    /* Draws from the standard normal distribution, by the Box-Muller
+     * transform. Implemented in RandomStreams.cpp. */
+    double rand_normal();
+
+    bool random_chance(double probability) {
+        return (rand_real_not1() < probability);
+    }
+
+    // The buffer is a function of the rest, and is regenerated after loading.
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        uint64_t position = tell();
+        ar(key[0], key[1], partition, position);
+        seek(position);
+    }
+private:
+    static const int BUFFER_BLOCKS = 16;
+    static const int BUFFER_WORDS = BUFFER_BLOCKS * 4;
+
+    void fill_buffer() {
+        philox::fill(buffer, BUFFER_BLOCKS, buffer_start / 4, partition, key);
+    }
+
+    uint32_t key[2];
+    uint32_t partition;
+    uint64_t buffer_start; // Position of buffer[0] in the stream
+    int index; // Next word of the buffer to draw
+    uint32_t buffer[BUFFER_WORDS];
+};
+
+/* Stream ids, part of each stream's key. Never renumber these: saved networks
+ * and reproducibility across versions depend on them. */
+enum RandomStreamId {
+    STREAM_CREATION = 1,
+    STREAM_FOLLOW = 2,
+    STREAM_TWEET = 3,
+    STREAM_RETWEET = 4,
+    STREAM_EVENTS = 5,
+    STREAM_TIME = 6
+};
+
+/*
+ * The random streams of one simulation state, one per subsystem. A region
+ * partition of a parallel run gets its own set, keyed by its partition
+ * number, so the draws of a region depend only on the seed and the region,
+ * not on how the regions are scheduled onto threads.
+ */
+struct RandomStreams {
+    RandomStream creation; // New agents and their attributes
+    RandomStream follow;   // Follow targets, followbacks and unfollows
+    RandomStream tweet;    // Tweet content
+    RandomStream retweet;  // Retweeting agents
+    RandomStream events;   // Choosing the next event and its actor
+    RandomStream time;     // Time increments
+
+    uint32_t seed;
+    uint32_t partition; // 0 for the main state, region + 1 for region partitions
+
+    RandomStreams(uint32_t seed = 0, uint32_t partition = 0) {
+        init(seed, partition);
+    }
+
+    void init(uint32_t seed, uint32_t partition) {
+        this->seed = seed;
+        this->partition = partition;
+        creation.init(seed, STREAM_CREATION, partition);
+        follow.init(seed, STREAM_FOLLOW, partition);
+        tweet.init(seed, STREAM_TWEET, partition);
+        retweet.init(seed, STREAM_RETWEET, partition);
+        events.init(seed, STREAM_EVENTS, partition);
+        time.init(seed, STREAM_TIME, partition);
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        ar(seed, partition);
+        ar(creation, follow, tweet, retweet, events, time);
+    }
+};
+
+#endif
@@ -25,6 +25,12 @@
 #ifndef RATETREE_H_
 #define RATETREE_H_
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "dependencies/lcommon/perf_timer.h"
+#include "RandomStreams.h"
 #include "serialization.h"
 
 // 100 bytes / tweet overhead
@@ -62,13 +68,13 @@ struct RateVec {
         tuple[n] += val;
         tuple_sum += val;
     }
-    void add(RateVec& o) {
+    void add(const RateVec& o) {
         for (int i = 0; i < N_ELEM; i++) {
             tuple[i] += o.tuple[i];
         }
         tuple_sum += o.tuple_sum;
     }
-    void sub(RateVec& o) {
+    void sub(const RateVec& o) {
         for (int i = 0; i < N_ELEM; i++) {
             tuple[i] -= o.tuple[i];
         }
@@ -88,48 +94,58 @@ struct RateVec {
     }
 };
 
+/* RateTree:
+ A tree of rates with N_CHILDREN children per node, where only the leaves
+ hold data. The inner nodes store nothing but the rate sums of their
+ children, side by side, and the child indices; the leaves (data and rates)
+ live in a separate array. Choosing a child is then a prefix sum and a
+ compare over one contiguous block of sums, done two lanes at a time with
+ SSE2 where available. Rate updates walk up the parent links, and the
+ descent walks down, without recursion.
+
+ Leaf references stay valid until the leaf is removed. The tree grows by
+ pushing a leaf one level down under a new inner node, at the shallowest
+ vacancy. */
 template <typename T, int N_ELEM, int N_CHILDREN = 2>
 struct RateTree {
     typedef int ref_t;
     enum {
-        INVALID = -1
+        INVALID = -1,
+        // Set in a child (or vacancy) reference that names a leaf rather than an inner node
+        LEAF_BIT = 1 << 30
     };
 
-    struct Node {
-        ref_t parent; // INVALID if root
-        short depth;
-        bool is_leaf; // Default true
-        bool is_allocated; // Default false
-        // Only leaves have data!! (Do not use if is_leaf is false!)
+    struct Leaf {
         T data;
         RateVec<N_ELEM> rates;
 
-        ref_t children[N_CHILDREN]; // INVALID if not allocated
-
         template <typename Archive>
-    void serialize(Archive& ar) {
-            ar(parent, depth, is_leaf, is_allocated);
+        void serialize(Archive& ar) {
             ar(data);
             ar(rates);
-            for (ref_t& child : children) {
-                ar(child);
-            }
         }
+    };
 
-        double debug_rate_sum(RateTree& tree) { // Inefficient
-            if (is_leaf) {
-                return rates.tuple_sum;
-            }
-            double sum = 0.0;
+    struct Node {
+        // The rate sum of each child, 0 where the child is INVALID.
+        // The node's own sum is in its parent (or is the tree total, for the root).
+        double child_sums[N_CHILDREN];
+        ref_t children[N_CHILDREN]; // INVALID, an inner node, or a leaf | LEAF_BIT
+        ref_t parent; // INVALID if root
+        short slot; // Our index among the parent's children
+        short depth;
+
+        Node() {
+            parent = INVALID;
+            slot = 0;
+            depth = 0;
             for (int i = 0; i < N_CHILDREN; i++) {
-                if (children[i] != INVALID) {
-                    sum += tree.get(children[i]).debug_rate_sum(tree);
-                }
+                child_sums[i] = 0.0;
+                children[i] = INVALID;
             }
-            return sum;
         }
 
-        bool has_vacancy() {
+        bool has_vacancy() const {
             for (int i = 0; i < N_CHILDREN; i++) {
                 if (children[i] == INVALID) {
                     return true; // At least one free slot still
@@ -137,155 +153,53 @@ struct RateTree {
             }
             return false;
         }
-        void link_to_parent(ref_t parent, int depth) {
-            this-> parent = parent;
-            this-> depth = depth;
-        }
-
-        ref_t alloc_child(RateTree& tree, ref_t self, int child) {
-             ref_t ref = tree.alloc_node();
-             children[child] = ref;
-             is_allocated = true; // Hack for parent object, which starts !is_allocated
-             tree.get(ref).link_to_parent(self, depth + 1);
-             return ref;
-        }
-
-        ref_t* seek_ref(ref_t ref) {
-            for (int i = 0; i < N_CHILDREN; i++) {
-                if (children[i] == ref) {
-                    return &children[i];
-                }
-            }
-            return NULL;
-        }
-
-        // Shift so that the tree can grow
-        void alloc_parent(RateTree& tree, ref_t self) {
-             ref_t ref = tree.alloc_node();
-             tree.get(ref) = *this; // Make a copy
-             tree.get(ref).is_leaf = false;
-             depth++;
-             // Update pointer from parent to self
-             if (parent != INVALID) {
-                 ref_t* self_loc = tree.get(parent).seek_ref(self);
-                 *self_loc = ref;
-             }
-             parent = ref; // Take new node as parent
-             // Become first child of new parent
-             tree.get(parent).children[0] = self;
-        }
-
-        // If a child node was allocated, place it in child_output, otherwise place self.
-        // Does NOT have any effect on the total rate balance.
-        // Returns false if fails to do so.
-        bool alloc_with_next_vacancy(RateTree& tree, ref_t self, ref_t& child_output) {
-            // Leaf case:
-            if (is_leaf) {
-                alloc_parent(tree, self);
-                tree.post_vacancy(self); // Vacant to expand again, if eventually necessary
-                // Call into a parent case:
-                tree.get(parent).alloc_with_next_vacancy(tree, parent, child_output);
-                return true;
-            }
-            // Parent case:
-            int i = 0;
-            for (; i < N_CHILDREN; i++) {
-                if (children[i] == INVALID) {
-                    child_output = alloc_child(tree, self, i);
-                    tree.post_vacancy(child_output); // Post child to vacancy list
-                    break;
-                }
-            }
-            if (i >= N_CHILDREN) {
-                return false; // No vacancy
-            }
-
-            for (; i < N_CHILDREN; i++) {
-                if (children[i] == INVALID) {
-                    // At least one free slot still, re-post to vacancy list
-                    tree.post_vacancy(self);
-                    return true;
-                }
-            }
-            // All slots have been used, stay removed from vacancy list
-            return true;
-        }
-        Node() {
-            parent = INVALID;
-            is_leaf = true;
-            is_allocated = false;
-            depth = 0;
-            for (int i =0; i < N_CHILDREN; i++) {
-                children[i] = INVALID;
-            }
-        }
 
-        void rate_add(RateTree& tree, RateVec<N_ELEM>& vec) {
-            rates.add(vec);
-            if (parent != INVALID) {
-                tree.get(parent).rate_add(tree, vec);
+        template <typename Archive>
+        void serialize(Archive& ar) {
+            for (double& sum : child_sums) {
+                ar(sum);
             }
-        }
-        /* Principal KMC method, choose with respect to bin rates. */
-        ref_t random_weighted_bin(RateTree& tree, MTwist& rng) {
-            bool dummy = false;
-            while (!dummy) {
-                double num = rng.rand_real_not1() * rates.tuple_sum;
-                for (int i = 0; i < N_CHILDREN; i++) {
-                    int c = children[i];
-                    if (c != INVALID) {
-                        num -= tree.get(c).rates.tuple_sum;
-                        if (num <= ZEROTOL) {
-                            dummy = true;
-                            return i;
-                        }
-                    }
-                }
+            for (ref_t& child : children) {
+                ar(child);
             }
-            ASSERT(false, "Logic error! No child to choose from.");
-            return INVALID;
+            ar(parent, slot, depth);
         }
+    };
 
-        ref_t pick_random_weighted(RateTree& tree, MTwist& rng, ref_t self) {
-            if (is_leaf) {
-                return self; // We are done
-            }
-            ref_t child = children[random_weighted_bin(tree, rng)];
-            return tree.get(child).pick_random_weighted(tree, rng, child);
-        }
+    // Where a leaf hangs in the tree
+    struct Link {
+        ref_t parent;
+        short slot;
+        short depth; // -1 once the leaf is freed
 
-        void rate_sub(RateTree& tree, RateVec<N_ELEM>& vec) {
-            rates.sub(vec);
-            if (parent != INVALID) {
-                tree.get(parent).rate_sub(tree, vec);
-            }
+        Link(ref_t parent = INVALID, int slot = 0, int depth = -1) :
+                parent(parent), slot(slot), depth(depth) {
         }
 
-        void print(RateTree& tree, ref_t self, int tab) {
-            for (int i = 0; i < tab; i++) { printf("  "); }
-            printf("%s Node %d p=%d depth=%d\n", (!is_leaf ? "Parent" : "Leaf"), self, parent, depth);
-            if (is_leaf) {
-                for (int i = 0; i < tab; i++) { printf("  "); }
-                data.print();
-            }
-
-            for (int i = 0; i < tab; i++) { printf("  "); }
-            rates.print();
-            printf("\n");
-            for (int i =0; i < N_CHILDREN; i++) {
-                if (children[i] != INVALID) {
-                    tree.get(children[i]).print(tree, children[i], tab + 1);
-                }
-            }
+        template <typename Archive>
+        void serialize(Archive& ar) {
+            ar(parent, slot, depth);
         }
     };
 
+    static bool is_leaf_ref(ref_t child) {
+        return child != INVALID && (child & LEAF_BIT);
+    }
+
     // Debug methods:
     void debug_check_rates() {
-        std::vector<Node*> v = as_node_vector(/*all:*/ true);
-        for (int i = 0; i < v.size(); i++) {
-            double calc_sum = v[i]->debug_rate_sum(*this);
-            double stored_sum = v[i]->rates.tuple_sum;
+        std::vector<ref_t> inner = inner_nodes();
+        for (int i = 0; i < inner.size(); i++) {
+            Node& n = nodes[inner[i]];
+            double calc_sum = 0.0;
+            for (int j = 0; j < N_CHILDREN; j++) {
+                ref_t c = n.children[j];
+                if (is_leaf_ref(c)) {
+                    DEBUG_CHECK(n.child_sums[j] == leaves[c & ~LEAF_BIT].rates.tuple_sum, "Leaf rate out of sync!");
+                }
+                calc_sum += n.child_sums[j];
+            }
+            double stored_sum = node_sum(inner[i]);
             if (fabs(calc_sum - stored_sum) >= 10e-5) {
                 printf("GOT calc_sum= %f vs stored_sum= %f\b", calc_sum, stored_sum);
                 ASSERT(false, "Should be (fairly) equal!");
@@ -293,9 +207,8 @@ struct RateTree {
         }
     }
     void debug_check_reachability(ref_t ref) {
-        std::vector<Node*> nv = as_node_vector();
-        ASSERT(nv.size() == size(), "Size mismatch!");
-        std::vector<Node*> v = as_node_vector(/*all:*/ true);
+        std::vector<Leaf*> v = as_leaf_vector();
+        ASSERT(v.size() == size(), "Size mismatch!");
         int occurrences = 0;
         for (int i = 0; i < v.size(); i++) {
             if (v[i] == &get(ref)) {
@@ -307,122 +220,155 @@ struct RateTree {
 
     RateTree() {
         n_elems = 0;
-        node_pool.resize(1); // Allocate root
+        nodes.resize(1); // Allocate root
         ensure_vacancy_depth(0).push_back(0); // Starts vacant itself, and with vacant children slots
-        get(0).is_leaf = false; // Root of the tree is not a leaf
     }
-    Node& get(ref_t handle) {
-        return node_pool[handle];
+    Leaf& get(ref_t handle) {
+        return leaves[handle];
     }
-
-    // Debugging only
-    bool has_child(Node& p, ref_t handle) {
-        for (int i = 0; i < N_CHILDREN; i++) {
-            if (p.children[i] == handle) {
-                return true;
-            }
-        }
-        return false;
+    int depth(ref_t handle) const {
+        return links[handle].depth;
     }
 
-    void as_node_vector(Node& node, std::vector<Node*>& vec, bool all = false) {
-        if (node.is_leaf) {
-            vec.push_back(&node);
-            return;
-        }
-        if (all) {
-            vec.push_back(&node);
-        }
-        // Not a leaf, query our children:
-        for (int i = 0; i < N_CHILDREN; i++) {
-            int c = node.children[i];
-            if (c != INVALID) {
-                as_node_vector(get(c), vec, all);
+    // The leaves, in tree order
+    std::vector<Leaf*> as_leaf_vector() {
+        std::vector<Leaf*> vec;
+        std::vector<ref_t> stack(1, 0);
+        while (!stack.empty()) {
+            ref_t ref = stack.back();
+            stack.pop_back();
+            if (is_leaf_ref(ref)) {
+                vec.push_back(&leaves[ref & ~LEAF_BIT]);
+                continue;
+            }
+            // Push in reverse so that the children come off in order
+            Node& n = nodes[ref];
+            for (int i = N_CHILDREN - 1; i >= 0; i--) {
+                if (n.children[i] != INVALID) {
+                    stack.push_back(n.children[i]);
+                }
             }
-        }
-    }
-
-    std::vector<Node*> as_node_vector(bool all = false) {
-        std::vector<Node*> vec;
-        if (node_pool[0].is_allocated) {
-        as_node_vector(node_pool[0], vec, all);
         }
         return vec;
     }
 
     std::vector<T> as_vector() {
-        std::vector<Node*> node_vec = as_node_vector();
+        std::vector<Leaf*> leaf_vec = as_leaf_vector();
         std::vector<T> vec;
-        for (int i = 0; i < node_vec.size(); i++) {
-            vec.push_back(node_vec[i]->data);
+        for (int i = 0; i < leaf_vec.size(); i++) {
+            vec.push_back(leaf_vec[i]->data);
         }
         return vec;
     }
 
-    // NOTE: Should only be exposing ref's to leaf nodes,
-    // don't call with parent nodes.
     void remove(ref_t handle) {
-        DEBUG_CHECK(get(handle).is_leaf, "Cannot remove parent nodes in this tree implementation.");
-        Node& n = get(handle);
-        Node& p = get(n.parent);
+        DEBUG_CHECK(links[handle].depth > 0, "Cannot remove a leaf that is not in the tree.");
+        Link link = links[handle];
+        Node& p = nodes[link.parent];
+        bool was_full = !p.has_vacancy();
         // Perform unlink
-        bool removed = false, was_full = true;
-        for (int i = 0; i < N_CHILDREN; i++) {
-            if (p.children[i] == INVALID) {
-                was_full = false;
-            } else if (p.children[i] == handle) {
-                p.children[i] = INVALID;
-                removed = true;
-            }
-        }
+        DEBUG_CHECK(p.children[link.slot] == (handle | LEAF_BIT), "Could not remove child!");
+        p.children[link.slot] = INVALID;
+        p.child_sums[link.slot] = 0.0;
         if (was_full) {
             // Important: Repost parent to vacancy list if not already in it!!
-            post_vacancy(n.parent);
+            post_vacancy(link.parent);
         }
 
-        DEBUG_CHECK(handle != 0, "Could not remove top node!");
-        DEBUG_CHECK(removed, "Could not remove child!");
-        DEBUG_CHECK(!has_child(p, handle), "Removed child, but duplicate exists!");
-        get(n.parent).rate_sub(*this, n.rates);
+        RateVec<N_ELEM> delta;
+        delta.sub(leaves[handle].rates);
+        propagate(link.parent, delta);
         n_elems--;
         free_list.push_back(handle);
-        n = Node();// 'Wipe' the node
-//        debug_check_rates();
+        leaves[handle] = Leaf(); // 'Wipe' the leaf
+        links[handle] = Link();
     }
 
-    ref_t pick_random_weighted(MTwist& rng) {
+    /* Principal KMC method, choose with respect to bin rates. */
+    ref_t pick_random_weighted(RandomStream& rng) {
         ASSERT(size() > 0, "No element to pick!");
-        return get(0).pick_random_weighted(*this, rng, 0);
+        ref_t ref = 0;
+        double rate = total.tuple_sum;
+        while (true) {
+            Node& n = nodes[ref];
+            int i = random_weighted_bin(n, rate, rng);
+            if (is_leaf_ref(n.children[i])) {
+                return n.children[i] & ~LEAF_BIT;
+            }
+            rate = n.child_sums[i];
+            ref = n.children[i];
+        }
+    }
+
+    /* Descend using an already drawn number in [0, total rate), rather than
+     * drawing again at every level. On return 'num' holds the remainder within
+     * the chosen leaf, so that selection can continue below it. */
+    ref_t pick_weighted(double& num) {
+        ASSERT(size() > 0, "No element to pick!");
+        ref_t ref = 0;
+        while (true) {
+            Node& n = nodes[ref];
+            int i = choose_child(n, num);
+            if (is_leaf_ref(n.children[i])) {
+                return n.children[i] & ~LEAF_BIT;
+            }
+            ref = n.children[i];
+        }
+    }
+
+    /* Recompute the sums of the inner nodes from the leaves,
+     * discarding the rounding error accumulated by repeated deltas. */
+    void resum_rates() {
+        std::vector<ref_t> inner = inner_nodes();
+        // Parents come before their children, so go in reverse
+        for (int i = (int)inner.size() - 1; i >= 0; i--) {
+            Node& n = nodes[inner[i]];
+            double sum = 0.0;
+            for (int j = 0; j < N_CHILDREN; j++) {
+                sum += n.child_sums[j];
+            }
+            node_sum(inner[i]) = sum;
+        }
+        // Only the root keeps the separate elements
+        RateVec<N_ELEM> elems;
+        std::vector<Leaf*> leaf_vec = as_leaf_vector();
+        for (int i = 0; i < leaf_vec.size(); i++) {
+            elems.add(leaf_vec[i]->rates);
+        }
+        for (int i = 0; i < N_ELEM; i++) {
+            total.tuple[i] = elems.tuple[i];
+        }
     }
 
     ref_t add(const T& data, const RateVec<N_ELEM>& tuple) {
-        const int BUFF = 3; // Buffer room resolve cases where nodes can become deallocated during internal methods
-        node_pool.reserve(node_pool.size() + BUFF);
-        ref_t node = find_vacancy();
-        Node& n = get(node);
-        n.data = data;
-        n.rates = tuple;
-        get(n.parent).rate_add(*this, n.rates);
+        ref_t leaf = find_vacancy();
+        leaves[leaf].data = data;
+        leaves[leaf].rates = tuple;
+        Link& link = links[leaf];
+        nodes[link.parent].child_sums[link.slot] = tuple.tuple_sum;
+        propagate(link.parent, tuple);
         n_elems++;
 
-//        debug_check_reachability(node);
+//        debug_check_reachability(leaf);
 //        debug_check_rates();
-        return node;
+        return leaf;
     }
     void replace_rate(ref_t ref, const RateVec<N_ELEM>& tuple) {
-        Node& n = get(ref);
-        RateVec<N_ELEM> delta = n.rates.delta(tuple);
-        n.rates = tuple;
-        get(n.parent).rate_add(*this, delta);
+        Leaf& l = leaves[ref];
+        RateVec<N_ELEM> delta = l.rates.delta(tuple);
+        l.rates = tuple;
+        Link& link = links[ref];
+        nodes[link.parent].child_sums[link.slot] = tuple.tuple_sum;
+        propagate(link.parent, delta);
     }
 
     RateVec<N_ELEM> rate_summary() {
-        return get(0).rates;
+        return total;
     }
 
     void print() {
-        get(0).print(*this, 0, 0);
-        printf("Leaf nodes = %d, total number of nodes = %d\n", (int) size(), (int) node_pool.size());
+        print(0, 0);
+        printf("Leaf nodes = %d, inner nodes = %d\n", (int) size(), (int) nodes.size());
     }
     size_t size() const {
         return n_elems;
@@ -430,66 +376,245 @@ struct RateTree {
 
     template <typename Archive>
     void serialize(Archive& ar) {
-        ar(n_elems, free_list); //Freed nodes
-        ar(node_pool, vacancy_list);
-        for (auto& list : vacancy_list) {
-            ar(list);
-        }
-        printf("Checking tweet/retweet RateTree structure integrity...\n");
-        debug_check_rates();
-        printf("Tweet/retweet RateTree structure integrity checks out.\n");
+        ar(n_elems, free_list); //Freed leaves
+        ar(nodes, leaves, links, total);
+        ar(vacancy_list);
     }
 private:
     typedef std::vector<ref_t> ref_list;
-    ref_t alloc_node() {
+
+    // The rate sum of an inner node, as stored in its parent
+    double& node_sum(ref_t ref) {
+        Node& n = nodes[ref];
+        if (n.parent == INVALID) {
+            return total.tuple_sum;
+        }
+        return nodes[n.parent].child_sums[n.slot];
+    }
+
+    // Add 'delta' to the sum of an inner node and of all its ancestors
+    void propagate(ref_t ref, const RateVec<N_ELEM>& delta) {
+        while (nodes[ref].parent != INVALID) {
+            Node& n = nodes[ref];
+            nodes[n.parent].child_sums[n.slot] += delta.tuple_sum;
+            ref = n.parent;
+        }
+        total.add(delta);
+    }
+
+    // The inner nodes, parents before their children
+    std::vector<ref_t> inner_nodes() {
+        std::vector<ref_t> vec;
+        std::vector<ref_t> stack(1, 0);
+        while (!stack.empty()) {
+            ref_t ref = stack.back();
+            stack.pop_back();
+            vec.push_back(ref);
+            Node& n = nodes[ref];
+            for (int i = N_CHILDREN - 1; i >= 0; i--) {
+                ref_t c = n.children[i];
+                if (c != INVALID && !is_leaf_ref(c)) {
+                    stack.push_back(c);
+                }
+            }
+        }
+        return vec;
+    }
+
+    /* Inclusive prefix sums of the child sums, with negative rounding residue
+     * clamped to 0. The sums are taken a pair at a time: (a, a + b), offset by
+     * the total of the pairs before. Sets bit i of the result if num < prefix[i].
+     * The SSE2 and the portable code round identically. */
+    static int prefix_compare(const double* sums, double num, double* prefix) {
+        int mask = 0;
+        int i = 0;
+#ifdef __SSE2__
+        const __m128d zero = _mm_setzero_pd();
+        const __m128d target = _mm_set1_pd(num);
+        __m128d carry = zero;
+        for (; i + 1 < N_CHILDREN; i += 2) {
+            __m128d v = _mm_max_pd(_mm_loadu_pd(sums + i), zero);
+            v = _mm_add_pd(v, _mm_unpacklo_pd(zero, v)); // (a, b + a)
+            v = _mm_add_pd(v, carry);
+            _mm_storeu_pd(prefix + i, v);
+            mask |= _mm_movemask_pd(_mm_cmplt_pd(target, v)) << i;
+            carry = _mm_unpackhi_pd(v, v);
+        }
+        double offset = _mm_cvtsd_f64(carry);
+#else
+        double offset = 0.0;
+        for (; i + 1 < N_CHILDREN; i += 2) {
+            double a = std::max(sums[i], 0.0), b = std::max(sums[i + 1], 0.0);
+            prefix[i] = a + offset;
+            prefix[i + 1] = (b + a) + offset;
+            offset = prefix[i + 1];
+            mask |= ((num < prefix[i]) | (num < prefix[i + 1]) << 1) << i;
+        }
+#endif
+        if (i < N_CHILDREN) { // Odd child out
+            prefix[i] = std::max(sums[i], 0.0) + offset;
+            mask |= (num < prefix[i]) << i;
+        }
+        return mask;
+    }
+
+    /* Choose the child that 'num' falls into, leaving the remainder within it in 'num'. */
+    static int choose_child(const Node& n, double& num) {
+        double prefix[N_CHILDREN];
+        int mask = prefix_compare(n.child_sums, num, prefix);
+        if (LIKELY(mask != 0)) {
+            int i = __builtin_ctz(mask);
+            if (i > 0) {
+                num -= prefix[i - 1];
+            }
+            return i;
+        }
+        // Rounding error took us past the last child, take the top of the last one with a rate
+        int chosen = INVALID;
+        for (int i = 0; i < N_CHILDREN; i++) {
+            if (n.children[i] != INVALID && (chosen == INVALID || n.child_sums[i] > 0)) {
+                chosen = i;
+            }
+        }
+        ASSERT(chosen != INVALID, "Logic error! No child to choose from.");
+        num = n.child_sums[chosen];
+        return chosen;
+    }
+
+    /* Draw a child of a node with the given rate sum. */
+    static int random_weighted_bin(const Node& n, double rate, RandomStream& rng) {
+        while (true) {
+            double num = rng.rand_real_not1() * rate;
+            for (int i = 0; i < N_CHILDREN; i++) {
+                if (n.children[i] != INVALID) {
+                    num -= n.child_sums[i];
+                    if (num <= ZEROTOL) {
+                        return i;
+                    }
+                }
+            }
+        }
+    }
+
+    void print(ref_t ref, int tab) {
+        Node& n = nodes[ref];
+        for (int i = 0; i < tab; i++) { printf("  "); }
+        printf("Parent Node %d p=%d depth=%d sum=%.2f\n", ref, n.parent, n.depth, node_sum(ref));
+        for (int i = 0; i < N_CHILDREN; i++) {
+            ref_t c = n.children[i];
+            if (c == INVALID) {
+                continue;
+            }
+            if (!is_leaf_ref(c)) {
+                print(c, tab + 1);
+                continue;
+            }
+            Leaf& l = leaves[c & ~LEAF_BIT];
+            for (int j = 0; j < tab + 1; j++) { printf("  "); }
+            printf("Leaf Node %d depth=%d\n", c & ~LEAF_BIT, n.depth + 1);
+            for (int j = 0; j < tab + 1; j++) { printf("  "); }
+            l.data.print();
+            for (int j = 0; j < tab + 1; j++) { printf("  "); }
+            l.rates.print();
+            printf("\n");
+        }
+    }
+
+    ref_t alloc_leaf() {
         PERF_TIMER();
         ref_t n;
         if (!free_list.empty()) {
-            // Reuse deallocated nodes before anything else:
+            // Reuse deallocated leaves before anything else:
             n = free_list.back();
             free_list.pop_back();
         } else {
-            int size = node_pool.size();
-            node_pool.resize(size + 1);
-            n = size;
+            n = leaves.size();
+            leaves.resize(n + 1);
+            links.resize(n + 1);
         }
-        get(n).is_allocated = true;
         return n;
     }
 
-    void post_vacancy(ref_t ref) {
-        ensure_vacancy_depth(get(ref).depth).push_back(ref);
+    // Place a new leaf in the first free slot of an inner node, and post it
+    // as a vacancy. Returns false if the node has no free slot.
+    bool alloc_child(ref_t ref, ref_t& leaf_output) {
+        int i = 0;
+        while (i < N_CHILDREN && nodes[ref].children[i] != INVALID) {
+            i++;
+        }
+        if (i >= N_CHILDREN) {
+            return false; // No vacancy
+        }
+        ref_t leaf = alloc_leaf();
+        Node& n = nodes[ref];
+        n.children[i] = leaf | LEAF_BIT;
+        n.child_sums[i] = 0.0;
+        links[leaf] = Link(ref, i, n.depth + 1);
+        leaf_output = leaf;
+        post_vacancy(leaf | LEAF_BIT); // Vacant to expand, if eventually necessary
+        if (n.has_vacancy()) {
+            // At least one free slot still, re-post to vacancy list
+            post_vacancy(ref);
+        }
+        // All slots have been used, stay removed from vacancy list
+        return true;
     }
 
-    bool check_validity(int depth, ref_t ref) {
-        return (get(ref).depth == depth);
+    // Push a leaf one level down, under a new inner node that takes its place,
+    // and place a new leaf next to it. Does NOT change any rate sum.
+    ref_t grow_leaf(ref_t leaf) {
+        Link link = links[leaf];
+        ref_t ref = nodes.size();
+        nodes.resize(ref + 1);
+        Node& n = nodes[ref];
+        n.parent = link.parent;
+        n.slot = link.slot;
+        n.depth = link.depth;
+        n.children[0] = leaf | LEAF_BIT;
+        n.child_sums[0] = leaves[leaf].rates.tuple_sum;
+        nodes[link.parent].children[link.slot] = ref;
+        links[leaf] = Link(ref, 0, link.depth + 1);
+        post_vacancy(leaf | LEAF_BIT); // Vacant to expand again, if eventually necessary
+
+        ref_t new_leaf;
+        alloc_child(ref, new_leaf);
+        return new_leaf;
+    }
+
+    int vacancy_depth(ref_t ref) const {
+        return is_leaf_ref(ref) ? links[ref & ~LEAF_BIT].depth : nodes[ref].depth;
+    }
+
+    void post_vacancy(ref_t ref) {
+        ensure_vacancy_depth(vacancy_depth(ref)).push_back(ref);
     }
 
     ref_t find_vacancy(int depth, ref_list& sub_list) {
         PERF_TIMER();
         while (!sub_list.empty()) {
             ref_t vacancy = sub_list.back();
-            // We assume we need to pop the element, we re-add as necessary (eg in alloc_with_next_vacancy or right below)
+            // We assume we need to pop the element, we re-add as necessary (eg in alloc_child)
             sub_list.pop_back();
-            if (!check_validity(depth, vacancy) ) {
+            // Skip leaves that have since moved down or been freed
+            if (vacancy_depth(vacancy) != depth) {
                 continue;
             }
-            ref_t new_node;
-            bool valid = get(vacancy).alloc_with_next_vacancy(*this, vacancy, new_node);
-            if (!valid) {
-                continue;
+            if (is_leaf_ref(vacancy)) {
+                return grow_leaf(vacancy & ~LEAF_BIT);
+            }
+            ref_t new_leaf;
+            if (alloc_child(vacancy, new_leaf)) {
+                return new_leaf;
             }
-            return new_node;
         }
         return INVALID;
     }
-    // Find a vacant parent to link our node to
+    // Find a vacant slot to link our leaf to
     // Does NOT propagate changes up the tree (add does)
     ref_t find_vacancy() {
         // A node with some sort of vacancy *must* exist
         for (int depth = 0; depth < vacancy_list.size(); depth++) {
-            ref_list& sub_list = vacancy_list[depth];
-            ref_t vacancy = find_vacancy(depth, sub_list);
+            ref_t vacancy = find_vacancy(depth, vacancy_list[depth]);
             if (vacancy != INVALID) {
                 return vacancy;
             }
@@ -505,8 +630,11 @@ private:
     }
 
     size_t n_elems;
-    std::vector<ref_t> free_list; //Freed nodes
-    std::vector<Node> node_pool; // 0 is the root node
+    RateVec<N_ELEM> total; // Sum of all leaves, ie of the root
+    std::vector<ref_t> free_list; // Freed leaves
+    std::vector<Node> nodes; // Inner nodes, 0 is the root
+    std::vector<Leaf> leaves;
+    std::vector<Link> links; // Parallel to 'leaves'
     std::vector<ref_list> vacancy_list;
 };
 
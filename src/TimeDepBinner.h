@@ -26,59 +26,66 @@
 #define TIMEDEPBINNER_H_
 
 #include <cstdio>
+#include <cmath>
 #include <vector>
 #include <algorithm>
 
 #include <iostream>
 
 #include "serialization.h"
+#include "util/RingQueue.h"
 
 #include "dependencies/prettyprint.hpp"
 #include "lcommon/perf_timer.h"
 #include "lcommon/Timer.h"
 
+/* The elements of a bin, in the order they leave it. Elements enter the first
+ * bin in creation order and all move on after the same time in a bin, so each
+ * bin is a first-in first-out queue. */
 struct TimeDepBin {
-    typedef std::vector<int> Heap;
+    typedef RingQueue<int> Queue;
 
     template <typename Checker>
     void add(Checker& checker, int id) {
-        heap.push_back(id);
-        std::push_heap(heap.begin(), heap.end(), checker);
-//        std::cout << "ID: " << id << std::endl;
-//        std::cout << heap << std::endl;
+        DEBUG_CHECK(queue.empty() || !checker(queue[queue.size() - 1], id), "Element added out of order!");
+        queue.push_back(id);
     }
 
     template <typename Checker>
     int pop(Checker& checker) {
-        int next = heap.front();
-        std::pop_heap(heap.begin(), heap.end(), checker);
-        heap.pop_back();
+        int next = queue.front();
+        queue.pop_front();
         return next;
     }
 
-    // Whether the max-element passes a check.
+    // The next element to leave the bin
+    int front() {
+        return queue.front();
+    }
+
+    // Whether the front element passes a check.
     // Returns true if the bin is empty.
     template <typename Checker>
     bool top_check(Checker& checker) {
         if (empty()) {
             return true;
         }
-        return checker.check(heap.front());
+        return checker.check(queue.front());
     }
 
     size_t size() {
-        return heap.size();
+        return queue.size();
     }
     bool empty() {
-        return heap.empty();
+        return queue.empty();
     }
 
     template <typename Archive>
     void serialize(Archive& ar) {
-        ar(heap);
+        ar(queue);
     }
 private:
-    Heap heap;
+    Queue queue;
 };
 
 class TimeDepBinner {
@@ -93,8 +100,7 @@ public:
         bins[bin].add(checker, id);
     }
 
-    // Whether the max-element passes a check.
-    // Returns true if the bin is empty.
+    // Move every element that fails its check onwards, bin by bin.
     template <typename Checker>
     void update(Checker checker) {
         for (int i = 0; i < bins.size(); i++) {
@@ -160,6 +166,16 @@ struct TimePeriodChecker {
         return true;
     }
 
+    // The earliest time by which has_past can be true 'n' more times, checking times from 't' on:
+    // the end of the n-th period, counting the one holding 't'
+    double time_to_pass(double t, int n) const {
+        double first = next_check_time;
+        if (t >= first) {
+            first += floor((t - first) / interval) * interval;
+        }
+        return first + n * interval;
+    }
+
     template <typename Archive>
     void serialize(Archive& ar) {
         ar(next_check_time, interval);
@@ -211,6 +227,10 @@ struct RealOrSimulatedTimePeriodChecker {
     bool has_past(double t) {
         return use_simulated_time ? simulated_time_period_checker.has_past(t) : real_time_period_checker.has_past();
     }
+    // Infinite for real time periods, which cannot be foreseen in simulated time
+    double time_to_pass(double t, int n) const {
+        return use_simulated_time ? simulated_time_period_checker.time_to_pass(t, n) : INFINITY;
+    }
 
     template <typename Archive>
     void serialize(Archive& ar) {
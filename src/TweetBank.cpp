@@ -37,70 +37,57 @@ double TweetRateDeterminer::get_age(const Tweet& tweet) {
     return age;
 }
 
-void TweetRateDeterminer::update_rate(TweetReactRateVec& rates, const Tweet& tweet, int bin) {
-    rates = get_rate(tweet, bin);
-}
-
 double TweetRateDeterminer::get_cat_threshold(int bin) {
     return state.config.tweet_obs.thresholds[bin];
 }
 
-TweetReactRateVec TweetRateDeterminer::get_rate(const Tweet& tweet, int bin) {
-    Agent& agent = state.network[tweet.id_tweeter];
-    FollowerSet& followers = agent.follower_set;
-
+double TweetRateDeterminer::get_obs_value(int bin) {
     /********************************************************************
      * Determine the 'Omega' observation PDF.
      * This describes the probability density of a tweet reaction 
      * occurring at a specific time, given that someone reacts to a 
      * retweet eventually.
      ********************************************************************/
-    
-    double obs_prob = state.config.tweet_obs.values[bin];
+    return state.config.tweet_obs.values[bin];
+}
 
+TweetReactRateVec TweetRateDeterminer::get_weight(const Tweet& tweet) {
     /********************************************************************
      * Determine the (fixed-length) vector 'rates', which stores the rate
      * with which a given category reacts to the tweeter.
-     * We scale by 'obs_prob'.
      ********************************************************************/
 
     // Assumption: react_weights is initialized to the appropriate
     // weights for this tweet.
+    return TweetReactRateVec(tweet.react_weights.total);
+}
 
-    double weight_sum = 0;
-    for (double d : tweet.react_weights.weights) {
-        weight_sum += d;
-    }
-
-    return TweetReactRateVec(obs_prob * weight_sum);
+TweetReactRateVec TweetRateDeterminer::get_rate(const Tweet& tweet, int bin) {
+    // We scale by the observation value of the bin
+    return TweetReactRateVec(get_obs_value(bin) * get_weight(tweet).tuple_sum);
 }
 
 
 void appendOldTweet(AnalysisState& state, Tweet& t) {
     t.deletion_time = state.time;
-    state.oldTweets.push_back(t);
+    state.old_tweets.append(t);
 }
 
-bool TimeDepRateTree::ElementChecker::check(ref_t id) {
+bool TimeDepRateTree::ElementChecker::check(tweet_ref_t id) {
     AnalysisState& state = tree.determiner.state;
-    Tweet& t = tree.get(id).data;
-//        printf("CHECKING %d time(%f) > t.retweet_next_rebin_time(%f)\n", id, time, t.retweet_next_rebin_time);
+    Tweet& t = tree.get(id);
     if (time > t.retweet_next_rebin_time) {
         // Move to a new bin:
         t.retweet_time_bin++;
         if (t.retweet_time_bin >= tree.n_bins()) {
-            //                    printf("BOOTING NODE %d AT BIN %d\n", id,  t.retweet_time_bin);
             // Here is the hook, the tweet with id = id is about to be kicked
             appendOldTweet(state, t);
-            tree.tree.remove(id);
+            tree.remove(id);
         } else {
-            //                    printf("MOVING TO BIN %d\n", t.retweet_time_bin);
-//            printf("RATE BEFORE %f\n", tree.get(id).rates.tuple_sum);
             t.retweet_next_rebin_time = t.creation_time
                     + tree.determiner.get_cat_threshold(t.retweet_time_bin);
-            TweetReactRateVec rates = tree.determiner.get_rate(t, t.retweet_time_bin);
-            tree.tree.replace_rate(id, rates);
-//            printf("RATE AFTER %f\n", tree.get(id).rates.tuple_sum);
+            // Its weight is unchanged, only the bin's observation value differs
+            tree.move(id, t.retweet_time_bin);
         }
         return false;
     }
@@ -109,7 +96,7 @@ bool TimeDepRateTree::ElementChecker::check(ref_t id) {
 
 
 TweetBank::TweetBank(AnalysisState& state) :
-        tree(TweetRateDeterminer(state),
+        tree(store, TweetRateDeterminer(state),
                 state.config.tweet_obs.initial_resolution,
                 /*n_bins: */
                 state.config.tweet_obs.values.size()) {
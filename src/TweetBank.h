@@ -34,6 +34,7 @@
 
 #include "serialization.h"
 #include "TimeDepBinner.h"
+#include "TweetStore.h"
 
 #include "tweets.h"
 
@@ -44,55 +45,90 @@
  * Each tweeter's follower list has homogenous (ie, same):
  *  - agent type (of tweeter)
  * */
-const double RETWEET_REBIN_TIME_INTERVAL = 1.0;
+// The longest tau leap, in simulated minutes, over which tweets are not rebinned
+const double RETWEET_REBIN_MAX_LEAP = 1.0;
 
 typedef RateVec</*Rates per: */ 1> TweetReactRateVec;
-typedef RateTree<Tweet, /*Rates per: */ 1, /*Branching factor:*/ 4> TweetRateTree;
+typedef RateTree<tweet_ref_t, /*Rates per: */ 1, /*Branching factor:*/ 4> TweetRateTree;
 
 struct TweetRateDeterminer {
     TweetRateDeterminer(AnalysisState& state) : state(state){
     }
     double get_age(const Tweet& tweet); // Implemented in tweets.cpp
-    void update_rate(TweetReactRateVec& rates, const Tweet& tweet, int bin);
+    // The reaction rate of a tweet in an observation bin, its weight scaled by the bin's value
     TweetReactRateVec get_rate(const Tweet& tweet, int bin);
+    // The reaction weight of a tweet, before scaling by the observation bin
+    TweetReactRateVec get_weight(const Tweet& tweet);
+    double get_obs_value(int bin);
 
     double get_cat_threshold(int bin);
 
     AnalysisState& state;
 };
 
+/* TimeDepRateTree:
+ The active tweets, grouped by observation time bin. Every tweet of a bin is
+ scaled by the same observation value, so each bin has its own RateTree
+ holding the unscaled weights of its tweets, and a small top-level tree holds
+ the rate of every bin (its weight sum times its observation value). A draw
+ picks a bin, then a tweet within it.
+
+ The tweets themselves live in a TweetStore, and the leaves only hold their
+ refs. Rebinning a tweet moves its leaf to the next bin's tree without
+ rescaling, and the top level is resynchronized once per rebinning pass.
+
+ A pass happens as soon as the simulation passes the earliest rebin time,
+ which is that of the oldest tweet of one of the bins. */
 struct TimeDepRateTree {
 
-    TimeDepRateTree(TweetRateDeterminer determiner, double initial_resolution, int number_of_bins) :
-        periodic(RETWEET_REBIN_TIME_INTERVAL), determiner(determiner),
-        initial_resolution(initial_resolution), binner(number_of_bins) {
+    TimeDepRateTree(TweetStore& store, TweetRateDeterminer determiner, double initial_resolution, int number_of_bins) :
+        store(store), determiner(determiner),
+        initial_resolution(initial_resolution), bin_trees(number_of_bins), binner(number_of_bins) {
             ASSERT(number_of_bins > 0, "Need more than 0 bins!");
             last_rate = 0;
             time = 0;
+            next_rebin_time = INFINITY;
+            for (int i = 0; i < number_of_bins; i++) {
+                bin_refs.push_back(bin_rates.add(i, TweetReactRateVec(0.0)));
+            }
     }
 
     /*
-     * Add an element. Determiner determines the rate associated.
+     * Add a tweet of the store. Determiner determines the weight associated.
      */
-    ref_t add(const Tweet& data) {
-        // ASSUMPTION: Add to initial time bin always
-        const int TIME_BIN = 0;
-        TweetReactRateVec rate_tuple = determiner.get_rate(data, TIME_BIN);
-        ref_t ref = tree.add(data, rate_tuple);
+    void add(tweet_ref_t ref) {
+        Tweet& data = store.get(ref);
+        // New tweets start in the first bin. Tweets merged from region partitions keep theirs.
+        int bin = std::max(0, data.retweet_time_bin);
+        DEBUG_CHECK(bin < n_bins(), "Tweet is past the last bin!");
+        if (handles.size() < store.capacity()) {
+            handles.resize(store.capacity());
+        }
+        handles[ref] = Handle(bin, bin_trees[bin].add(ref, determiner.get_weight(data)));
         binner.add(checker(), ref);
-        return ref;
+        sync_bin_rate(bin);
+        next_rebin_time = std::min(next_rebin_time, data.retweet_next_rebin_time);
     }
 
     size_t size() const {
-        return tree.size();
+        size_t n = 0;
+        for (auto& tree : bin_trees) {
+            n += tree.size();
+        }
+        return n;
+    }
+
+    Tweet& get(tweet_ref_t ref) {
+        return store.get(ref);
     }
 
-    typename TweetRateTree::Node& get(ref_t ref) {
-        return tree.get(ref);
+    // The current reaction rate of a tweet
+    double reaction_rate(const Tweet& tweet) {
+        return determiner.get_rate(tweet, tweet.retweet_time_bin).tuple_sum;
     }
 
     TweetReactRateVec rate_summary() {
-        return tree.rate_summary();
+        return bin_rates.rate_summary();
     }
 
     double get_cat_threshold(int i) {
@@ -101,49 +137,136 @@ struct TimeDepRateTree {
 
     void update(double time) {
         this->time = time;
-        if (!periodic.has_past(time)) {
+        // Same comparison as ElementChecker::check
+        if (!(time > next_rebin_time)) {
             return;
         }
         binner.update(checker());
-
-//        int i = 0;
-//        for (auto& bin : binner.get_bins()) {
-//            i++;
-//            double time = determiner.get_cat_threshold(i);
-//            std::cout << "IN BIN " << i << " HAVE " << bin.size() << std::endl;
-//            std::cout << "THEY HAVE elapsed-time < " << time << std::endl;
-//        }
+        sync_bin_rates();
+        schedule_next_rebin();
     }
 
-    std::vector<TweetRateTree::Node*> as_node_vector() {
-        return tree.as_node_vector();
+    std::vector<tweet_ref_t> as_ref_vector() {
+        std::vector<tweet_ref_t> vec;
+        for (auto& tree : bin_trees) {
+            for (TweetRateTree::Leaf* leaf : tree.as_leaf_vector()) {
+                vec.push_back(leaf->data);
+            }
+        }
+        return vec;
     }
 
     std::vector<Tweet> as_vector() {
-        return tree.as_vector();
+        std::vector<Tweet> vec;
+        for (tweet_ref_t ref : as_ref_vector()) {
+            vec.push_back(store.get(ref));
+        }
+        return vec;
     }
 
     void print() {
-        tree.print();
+        for (int i = 0; i < n_bins(); i++) {
+            TweetRateTree& tree = bin_trees[i];
+            printf("Bin %d, observation value %g, %d tweets, weight %.2f:\n", i,
+                    determiner.get_obs_value(i), (int) tree.size(), tree.rate_summary().tuple_sum);
+            for (TweetRateTree::Leaf* leaf : tree.as_leaf_vector()) {
+                printf("  Tweet ref %u: ", leaf->data);
+                store.get(leaf->data).print();
+                printf("\n");
+            }
+        }
     }
 
     /* Principal KMC method, choose with respect to bin rates. */
-    ref_t pick_random_weighted(MTwist& rng) {
-        return tree.pick_random_weighted(rng);
+    tweet_ref_t pick_random_weighted(RandomStream& rng) {
+        double num = rng.rand_real_not1() * rate_summary().tuple_sum;
+        return pick_weighted(num);
+    }
+
+    // Choose with an already drawn number in [0, total rate)
+    tweet_ref_t pick_weighted(double& num) {
+        int bin = bin_rates.get(bin_rates.pick_weighted(num)).data;
+        // Continue within the bin, where the weights are not scaled
+        num /= determiner.get_obs_value(bin);
+        TweetRateTree& tree = bin_trees[bin];
+        return tree.get(tree.pick_weighted(num)).data;
     }
 
     template <typename Archive>
     void serialize(Archive& ar) {
-        ar(NVP(periodic));
-        // determiner carries no important state
+        // determiner carries no important state, the store belongs to the TweetBank
         ar(NVP(last_rate), NVP(initial_resolution), NVP(time));
-        ar(NVP(tree));
+        ar(NVP(bin_trees), NVP(handles));
         ar(NVP(binner));
+        printf("Checking tweet/retweet RateTree structure integrity...\n");
+        for (auto& tree : bin_trees) {
+            tree.debug_check_rates();
+        }
+        printf("Tweet/retweet RateTree structure integrity checks out.\n");
+        // The bin rates and the rebin time are not stored
+        sync_bin_rates();
+        schedule_next_rebin();
     }
-    int n_bins() {
-        return binner.get_bins().size();
+    int n_bins() const {
+        return bin_trees.size();
     }
 private:
+    // Where a tweet currently is
+    struct Handle {
+        int bin;
+        ref_t ref; // Leaf within bin_trees[bin], -1 if the tweet is not active
+        Handle(int bin = -1, ref_t ref = -1) :
+                bin(bin), ref(ref) {
+        }
+
+        template <typename Archive>
+        void serialize(Archive& ar) {
+            ar(bin, ref);
+        }
+    };
+
+    // Move a tweet's leaf to another bin. Does NOT change the bin rates, see sync_bin_rates().
+    void move(tweet_ref_t tweet, int bin) {
+        Handle& h = handles[tweet];
+        TweetRateTree& from = bin_trees[h.bin];
+        TweetReactRateVec weight = from.get(h.ref).rates;
+        from.remove(h.ref);
+        h = Handle(bin, bin_trees[bin].add(tweet, weight));
+    }
+    // Drop a tweet, freeing it from the store. Does NOT change the bin rates, see sync_bin_rates().
+    void remove(tweet_ref_t tweet) {
+        Handle& h = handles[tweet];
+        bin_trees[h.bin].remove(h.ref);
+        h = Handle();
+        store.free(tweet);
+    }
+
+    // The oldest tweet of each bin is the next to leave it
+    void schedule_next_rebin() {
+        next_rebin_time = INFINITY;
+        for (TimeDepBin& bin : binner.get_bins()) {
+            if (!bin.empty()) {
+                next_rebin_time = std::min(next_rebin_time, get(bin.front()).retweet_next_rebin_time);
+            }
+        }
+    }
+    void sync_bin_rates() {
+        for (int i = 0; i < n_bins(); i++) {
+            sync_bin_rate(i);
+        }
+        bin_rates.resum_rates();
+    }
+    void sync_bin_rate(int bin) {
+        TweetRateTree& tree = bin_trees[bin];
+        double rate = 0.0;
+        if (tree.size() > 0) {
+            rate = determiner.get_obs_value(bin) * tree.rate_summary().tuple_sum;
+        } else {
+            // Start the empty bin afresh, dropping any rounding residue
+            tree = TweetRateTree();
+        }
+        bin_rates.replace_rate(bin_refs[bin], TweetReactRateVec(rate));
+    }
 
     struct ElementChecker {
         ElementChecker(TimeDepRateTree& tree, double time) : tree(tree) {
@@ -158,18 +281,15 @@ private:
         int bin;
 
         // Bin-move-check function for TimeDepBinner:
-    bool check(ref_t id);
+        bool check(tweet_ref_t id);
 
-        // Comparison function for TimeDepBinner:
-        bool operator()(ref_t id1, ref_t id2) {
-            Tweet& t1 = tree.get(id1).data;
-            Tweet& t2 = tree.get(id2).data;
-            // Ensure the heap in TimeDepBinner is a min-heap:
-            return t1.creation_time > t2.creation_time;
+        // Ordering function for TimeDepBinner, whether id1 must leave a bin after id2:
+        bool operator()(tweet_ref_t id1, tweet_ref_t id2) {
+            return tree.get(id1).creation_time > tree.get(id2).creation_time;
         }
 
-        int initial_bin(ref_t a) {
-            return 0; // All tweets start in bin 0
+        int initial_bin(tweet_ref_t a) {
+            return tree.handles[a].bin;
         }
 
         TimeDepRateTree& tree;
@@ -179,17 +299,26 @@ private:
         return ElementChecker(*this, time);
     }
 
-    // Checks whether we should update all elements
-    TimePeriodChecker periodic;
-
+    TweetStore& store;
     TweetRateDeterminer determiner;
     double last_rate, initial_resolution;
-    TweetRateTree tree;
     double time;
-    TimeDepBinner binner;
+    // The earliest time at which a tweet changes bins, not serialized
+    double next_rebin_time;
+
+    // The tweets of each observation bin, with unscaled weights
+    std::vector<TweetRateTree> bin_trees;
+    // The rate of each bin, not serialized
+    RateTree<int, 1, 4> bin_rates;
+    std::vector<ref_t> bin_refs;
+
+    // Indexed by tweet_ref_t
+    std::vector<Handle> handles;
+    TimeDepBinner binner; // Holds tweet refs
 };
 
 struct TweetBank {
+    TweetStore store;
     TimeDepRateTree tree;
 
     double get_total_rate() {
@@ -199,15 +328,36 @@ struct TweetBank {
     TweetBank(AnalysisState& state);
 
     /*
-     * Add an tweet. TweetRateDeterminer determines the reaction rate (follow or retweet) associated.
+     * A new tweet, to be filled in place and then added. A tweet that is
+     * not added (it cannot be retweeted) is reused by the next alloc().
      */
-    void add(const Tweet& data) {
+    tweet_ref_t alloc() {
+        release_unadded();
+        unadded = store.alloc();
+        return unadded;
+    }
+
+    /*
+     * Add a tweet from alloc(). TweetRateDeterminer determines the reaction rate (follow or retweet) associated.
+     */
+    void add(tweet_ref_t ref) {
         PERF_TIMER();
-        tree.add(data);
+        DEBUG_CHECK(ref == unadded, "Tweet was not just allocated!");
+        unadded = NO_TWEET;
+        tree.add(ref);
+    }
+    void add(const Tweet& data) {
+        tweet_ref_t ref = alloc();
+        store.get(ref) = data;
+        add(ref);
+    }
+
+    Tweet& get(tweet_ref_t ref) {
+        return store.get(ref);
     }
 
-    std::vector<TweetRateTree::Node*> as_node_vector() {
-        return tree.as_node_vector();
+    std::vector<tweet_ref_t> as_ref_vector() {
+        return tree.as_ref_vector();
     }
 
     std::vector<Tweet> as_vector() {
@@ -224,15 +374,29 @@ struct TweetBank {
     int n_active_tweets() const {
         return tree.size();
     }
-    Tweet& pick_random_weighted(MTwist& rng) {
-        ref_t ref = tree.pick_random_weighted(rng);
-        return tree.get(ref).data;
+    tweet_ref_t pick_random_weighted(RandomStream& rng) {
+        return tree.pick_random_weighted(rng);
+    }
+    tweet_ref_t pick_weighted(double& num) {
+        return tree.pick_weighted(num);
     }
 
     template <typename Archive>
     void serialize(Archive& ar) {
+        release_unadded();
+        ar(NVP(store));
         tree.serialize(ar);
     }
+
+    // Frees the tweet of the last alloc() if it was not added, releasing its content
+    void release_unadded() {
+        if (unadded != NO_TWEET) {
+            store.free(unadded);
+            unadded = NO_TWEET;
+        }
+    }
+private:
+    tweet_ref_t unadded = NO_TWEET;
 };
 
 #endif
@@ -0,0 +1,216 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#ifndef TWEETCASCADE_H_
+#define TWEETCASCADE_H_
+
+#include <vector>
+#include <algorithm>
+
+#include "util.h"
+#include "serialization.h"
+
+struct CascadeStats;
+
+/* TweetCascade:
+ The retweet tree of one tweet content. Every tweet of the content, the
+ original first, appends a node holding the node of the tweet it retweeted,
+ so the parent, tweeter and depth of a tweet are found from its
+ 'cascade_node' in constant time. The number of nodes at each depth is kept
+ as they are appended. */
+struct TweetCascade {
+    struct Node {
+        int parent; // -1 for the original tweet
+        int id_tweeter;
+        int depth;
+
+        template <typename Archive>
+        void serialize(Archive& ar) {
+            ar(NVP(parent), NVP(id_tweeter), NVP(depth));
+        }
+    };
+
+    // Where the cascade is counted once its content is released, not serialized
+    CascadeStats* sink = NULL;
+
+    // Returns the new node. 'parent' may be from remote_parent().
+    int append(int parent, int id_tweeter) {
+        DEBUG_CHECK(parent < (int)nodes.size(), "Parent not in cascade!");
+        DEBUG_CHECK(parent < -1 || (parent == -1) == nodes.empty(), "Cascade must have exactly one root!");
+        int depth = 0;
+        if (parent < -1) {
+            depth = remote_parents[-2 - parent].depth + 1;
+        } else if (parent != -1) {
+            depth = nodes[parent].depth + 1;
+        }
+        nodes.push_back({parent, id_tweeter, depth});
+        // A copy's first nodes may hang below the depths it holds
+        if (depth >= breadth.size()) {
+            breadth.resize(depth + 1, 0);
+        }
+        breadth[depth]++;
+        return nodes.size() - 1;
+    }
+
+    /* With region partitions, a content retweeted in several regions has a copy in each,
+     * holding the nodes of the tweets made there (see analyzer_parallel.cpp). */
+
+    // A parent for append(): node 'node', at 'depth', of the copy in partition 'region'
+    int remote_parent(int region, int node, int depth) {
+        remote_parents.push_back({region, node, depth});
+        return -2 - ((int)remote_parents.size() - 1);
+    }
+    // The copies of a content, by region (NULL where there is none), joined into one cascade.
+    // The nodes of each copy follow those of the copies before it, from 'offsets[region]' on.
+    static TweetCascade join(const std::vector<const TweetCascade*>& copies, std::vector<int>& offsets) {
+        TweetCascade joined;
+        offsets.assign(copies.size(), 0);
+        for (int region = 0; region < copies.size(); region++) {
+            offsets[region] = joined.nodes.size();
+            if (copies[region] != NULL) {
+                const std::vector<Node>& nodes = copies[region]->nodes;
+                joined.nodes.insert(joined.nodes.end(), nodes.begin(), nodes.end());
+            }
+        }
+        for (int region = 0; region < copies.size(); region++) {
+            if (copies[region] == NULL) {
+                continue;
+            }
+            for (int i = 0; i < copies[region]->size(); i++) {
+                Node& node = joined.nodes[offsets[region] + i];
+                if (node.parent < -1) {
+                    const RemoteParent& remote = copies[region]->remote_parents[-2 - node.parent];
+                    DEBUG_CHECK(copies[remote.region] != NULL, "Parent copy not joined!");
+                    node.parent = offsets[remote.region] + remote.node;
+                } else if (node.parent != -1) {
+                    node.parent += offsets[region];
+                }
+                if (node.depth >= joined.breadth.size()) {
+                    joined.breadth.resize(node.depth + 1, 0);
+                }
+                joined.breadth[node.depth]++;
+            }
+        }
+        return joined;
+    }
+
+    const Node& node(int i) const {
+        DEBUG_CHECK(i >= 0 && i < (int)nodes.size(), "Node not in cascade!");
+        return nodes[i];
+    }
+    int size() const {
+        return nodes.size();
+    }
+    // The depth of the deepest retweet, 0 if there were none
+    int max_depth() const {
+        return (int)breadth.size() - 1;
+    }
+    // The most tweets at any one depth
+    int max_breadth() const {
+        int max = 0;
+        for (int n : breadth) {
+            max = std::max(max, n);
+        }
+        return max;
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        ar(NVP(nodes), NVP(breadth));
+    }
+private:
+    struct RemoteParent {
+        int region, node, depth;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> breadth; // The number of nodes at each depth
+    // Only while the partitions run, not serialized
+    std::vector<RemoteParent> remote_parents;
+};
+
+/* CascadeStats:
+ The size, depth and breadth distributions of the cascades of the contents
+ released so far. Sizes and breadths are binned by powers of two. */
+struct CascadeStats {
+    long long n_cascades = 0;
+    long long total_size = 0;
+    int max_size = 0, max_depth = 0, max_breadth = 0;
+    // Number of cascades by floor(log2(size)), by depth, and by floor(log2(max breadth))
+    std::vector<long long> size_bins, depth_counts, breadth_bins;
+
+    void add(const TweetCascade& cascade) {
+        if (cascade.size() == 0) {
+            return;
+        }
+        int breadth = cascade.max_breadth();
+        n_cascades++;
+        total_size += cascade.size();
+        max_size = std::max(max_size, cascade.size());
+        max_depth = std::max(max_depth, cascade.max_depth());
+        max_breadth = std::max(max_breadth, breadth);
+        increment(size_bins, log2_bin(cascade.size()), 1);
+        increment(depth_counts, cascade.max_depth(), 1);
+        increment(breadth_bins, log2_bin(breadth), 1);
+    }
+
+    void add(const CascadeStats& o) {
+        n_cascades += o.n_cascades;
+        total_size += o.total_size;
+        max_size = std::max(max_size, o.max_size);
+        max_depth = std::max(max_depth, o.max_depth);
+        max_breadth = std::max(max_breadth, o.max_breadth);
+        for (int i = 0; i < o.size_bins.size(); i++) {
+            increment(size_bins, i, o.size_bins[i]);
+        }
+        for (int i = 0; i < o.depth_counts.size(); i++) {
+            increment(depth_counts, i, o.depth_counts[i]);
+        }
+        for (int i = 0; i < o.breadth_bins.size(); i++) {
+            increment(breadth_bins, i, o.breadth_bins[i]);
+        }
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        ar(NVP(n_cascades), NVP(total_size), NVP(max_size), NVP(max_depth), NVP(max_breadth));
+        ar(NVP(size_bins), NVP(depth_counts), NVP(breadth_bins));
+    }
+private:
+    static int log2_bin(int n) {
+        int bin = 0;
+        while (n >>= 1) {
+            bin++;
+        }
+        return bin;
+    }
+    static void increment(std::vector<long long>& counts, int i, long long n) {
+        if (i >= counts.size()) {
+            counts.resize(i + 1, 0);
+        }
+        counts[i] += n;
+    }
+};
+
+#endif
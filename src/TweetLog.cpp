@@ -0,0 +1,340 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#include <unistd.h>
+#include <memory>
+
+#include "TweetLog.h"
+#include "tweets.h"
+#include "analyzer.h"
+#include "util.h"
+
+using namespace std;
+
+// The number of records the simulation gathers before handing them to the writer thread
+const size_t TWEET_LOG_BLOCK_SIZE = 4096;
+
+TweetRecord::TweetRecord(const Tweet& tweet) {
+    id_tweet = tweet.id_tweet;
+    id_tweeter = tweet.id_tweeter;
+    id_link = tweet.id_link;
+    generation = tweet.generation;
+    id_content = tweet.content->id;
+    id_original_author = tweet.content->id_original_author;
+    type = tweet.content->type;
+    language = tweet.content->language;
+    hashtag = tweet.hashtag;
+    creation_time = tweet.creation_time;
+    deletion_time = tweet.deletion_time;
+    n_retweets = tweet.content->n_retweeters();
+}
+
+void TweetRecord::api_serialize(cereal::JSONOutputArchive& ar) {
+    std::string content_type = tweet_type_name(type);
+    std::string language = language_name(this->language);
+    AnalysisState& state = get_state(ar);
+    Agent& author = state.network[id_original_author];
+
+    ar(cereal::make_nvp("id", id_tweet),
+       cereal::make_nvp("content_id", id_content),
+       cereal::make_nvp("broadcasted_at", creation_time),
+       cereal::make_nvp("broadcaster_id", id_tweeter),
+       cereal::make_nvp("author_id", id_original_author),
+       cereal::make_nvp("previous_broadcaster_id", id_link),
+       cereal::make_nvp("has_hashtag", hashtag),
+       cereal::make_nvp("retweets_since_origin", generation),
+       cereal::make_nvp("author_region", state.config.regions.regions[author.region_bin].name),
+       cereal::make_nvp("author_ideology", state.config.ideologies[author.ideology_bin].name),
+       NVP(content_type), NVP(language),
+       // Twitter API:
+       cereal::make_nvp("retweet_count", n_retweets),
+       cereal::make_nvp("author_follower_count", author.follower_set.size())
+    );
+}
+
+/*****************************************************************************
+ * TweetLogBlock
+ *****************************************************************************/
+
+void TweetLogBlock::push_back(const TweetRecord& record) {
+    id_tweet.push_back(record.id_tweet);
+    id_tweeter.push_back(record.id_tweeter);
+    id_link.push_back(record.id_link);
+    generation.push_back(record.generation);
+    id_content.push_back(record.id_content);
+    id_original_author.push_back(record.id_original_author);
+    n_retweets.push_back(record.n_retweets);
+    type.push_back(record.type);
+    language.push_back(record.language);
+    hashtag.push_back(record.hashtag);
+    creation_time.push_back(record.creation_time);
+    deletion_time.push_back(record.deletion_time);
+}
+
+TweetRecord TweetLogBlock::get(size_t i) const {
+    TweetRecord record;
+    record.id_tweet = id_tweet[i];
+    record.id_tweeter = id_tweeter[i];
+    record.id_link = id_link[i];
+    record.generation = generation[i];
+    record.id_content = id_content[i];
+    record.id_original_author = id_original_author[i];
+    record.n_retweets = n_retweets[i];
+    record.type = type[i];
+    record.language = language[i];
+    record.hashtag = hashtag[i];
+    record.creation_time = creation_time[i];
+    record.deletion_time = deletion_time[i];
+    return record;
+}
+
+void TweetLogBlock::clear() {
+    *this = TweetLogBlock();
+}
+
+template <typename T>
+static void write_column(FILE* file, const vector<T>& column) {
+    std::fwrite(&column[0], sizeof(T), column.size(), file);
+}
+
+template <typename T>
+static bool read_column(FILE* file, vector<T>& column, size_t n) {
+    column.resize(n);
+    return std::fread(&column[0], sizeof(T), n, file) == n;
+}
+
+void TweetLogBlock::write(FILE* file) const {
+    uint32_t n = size();
+    std::fwrite(&n, sizeof(n), 1, file);
+    write_column(file, id_tweet);
+    write_column(file, id_tweeter);
+    write_column(file, id_link);
+    write_column(file, generation);
+    write_column(file, id_content);
+    write_column(file, id_original_author);
+    write_column(file, n_retweets);
+    write_column(file, type);
+    write_column(file, language);
+    write_column(file, hashtag);
+    write_column(file, creation_time);
+    write_column(file, deletion_time);
+}
+
+bool TweetLogBlock::read(FILE* file) {
+    uint32_t n = 0;
+    if (std::fread(&n, sizeof(n), 1, file) != 1 || n == 0) {
+        return false;
+    }
+    return read_column(file, id_tweet, n) && read_column(file, id_tweeter, n)
+            && read_column(file, id_link, n) && read_column(file, generation, n)
+            && read_column(file, id_content, n) && read_column(file, id_original_author, n)
+            && read_column(file, n_retweets, n) && read_column(file, type, n)
+            && read_column(file, language, n) && read_column(file, hashtag, n)
+            && read_column(file, creation_time, n) && read_column(file, deletion_time, n);
+}
+
+/*****************************************************************************
+ * TweetLogReader
+ *****************************************************************************/
+
+TweetLogReader::TweetLogReader(const string& path, size_t limit) {
+    file = fopen(path.c_str(), "rb");
+    position = n_read = 0;
+    this->limit = limit;
+}
+
+TweetLogReader::~TweetLogReader() {
+    if (file != NULL) {
+        fclose(file);
+    }
+}
+
+bool TweetLogReader::next(TweetRecord& record) {
+    if (n_read >= limit) {
+        return false;
+    }
+    if (position >= block.size()) {
+        if (file == NULL || !block.read(file)) {
+            return false;
+        }
+        position = 0;
+    }
+    record = block.get(position++);
+    n_read++;
+    return true;
+}
+
+/*****************************************************************************
+ * TweetLog
+ *****************************************************************************/
+
+void TweetLog::append(const Tweet& tweet) {
+    append(TweetRecord(tweet));
+}
+
+void TweetLog::append(const TweetRecord& record) {
+    if (file == NULL) {
+        start("wb");
+    }
+    current.push_back(record);
+    n_records++;
+    if (current.size() >= TWEET_LOG_BLOCK_SIZE) {
+        hand_over();
+    }
+}
+
+void TweetLog::merge(const vector<TweetLog*>& logs) {
+    vector<unique_ptr<TweetLogReader>> readers;
+    vector<TweetRecord> heads(logs.size());
+    vector<bool> has_head(logs.size());
+    for (int i = 0; i < logs.size(); i++) {
+        logs[i]->flush();
+        readers.emplace_back(new TweetLogReader(logs[i]->path, logs[i]->size()));
+        has_head[i] = readers[i]->next(heads[i]);
+    }
+    while (true) {
+        // The earliest deletion, the first log winning ties
+        int earliest = -1;
+        for (int i = 0; i < logs.size(); i++) {
+            if (has_head[i] && (earliest == -1 || heads[i].deletion_time < heads[earliest].deletion_time)) {
+                earliest = i;
+            }
+        }
+        if (earliest == -1) {
+            break;
+        }
+        append(heads[earliest]);
+        has_head[earliest] = readers[earliest]->next(heads[earliest]);
+    }
+}
+
+void TweetLog::flush() {
+    if (file == NULL) {
+        return;
+    }
+    hand_over();
+    unique_lock<std::mutex> lock(mutex);
+    written.wait(lock, [this]() {
+        return pending.empty() && !writing;
+    });
+    fflush(file);
+}
+
+void TweetLog::close() {
+    if (file == NULL) {
+        return;
+    }
+    flush();
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    writer.join();
+    stopping = false;
+    fclose(file);
+    file = NULL;
+}
+
+void TweetLog::discard() {
+    close();
+    if (!path.empty()) {
+        remove(path.c_str());
+    }
+    n_records = 0;
+}
+
+void TweetLog::start(const char* mode) {
+    file = fopen(path.c_str(), mode);
+    if (file == NULL) {
+        error_exit("Could not open the expired tweet log '" + path + "'!");
+    }
+    writer = thread(&TweetLog::write_blocks, this);
+}
+
+void TweetLog::resume(size_t n_saved) {
+    close();
+    n_records = 0;
+    if (n_saved == 0) {
+        // The file is recreated by the next append
+        return;
+    }
+    size_t n_found = 0;
+    long end = 0;
+    FILE* existing = fopen(path.c_str(), "rb");
+    if (existing != NULL) {
+        TweetLogBlock block;
+        while (n_found < n_saved && block.read(existing) && n_found + block.size() <= n_saved) {
+            n_found += block.size();
+            end = ftell(existing);
+        }
+        fclose(existing);
+    }
+    if (n_found != n_saved) {
+        printf("Warning: the saved network expects %d expired tweets in '%s', but %d were found. "
+                "Continuing after the ones found.\n", (int)n_saved, path.c_str(), (int)n_found);
+    }
+    if (existing == NULL) {
+        return;
+    }
+    // Drop whatever was written after the network was saved
+    if (truncate(path.c_str(), end) != 0) {
+        error_exit("Could not truncate the expired tweet log '" + path + "'!");
+    }
+    start("ab");
+    n_records = n_found;
+}
+
+void TweetLog::hand_over() {
+    if (current.size() == 0) {
+        return;
+    }
+    {
+        lock_guard<std::mutex> lock(mutex);
+        pending.push_back(std::move(current));
+    }
+    current.clear();
+    wakeup.notify_one();
+}
+
+void TweetLog::write_blocks() {
+    unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wakeup.wait(lock, [this]() {
+            return stopping || !pending.empty();
+        });
+        if (pending.empty()) {
+            // Stopping, and everything is written
+            break;
+        }
+        TweetLogBlock block = std::move(pending.front());
+        pending.pop_front();
+        writing = true;
+        lock.unlock();
+        block.write(file);
+        lock.lock();
+        writing = false;
+        written.notify_all();
+    }
+}
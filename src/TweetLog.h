@@ -0,0 +1,172 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#ifndef TWEETLOG_H_
+#define TWEETLOG_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "serialization.h"
+
+struct Tweet;
+
+/* What remains of a tweet once it has left the tweet bank. */
+struct TweetRecord {
+    int id_tweet = -1, id_tweeter = -1, id_link = -1, generation = -1;
+    int id_content = -1, id_original_author = -1;
+    int type = -1, language = -1;
+    bool hashtag = false;
+    double creation_time = 0, deletion_time = 0;
+    // The number of retweets of the content, as of the tweet's expiry
+    int n_retweets = 0;
+
+    TweetRecord() {
+    }
+    TweetRecord(const Tweet& tweet);
+
+    // Same fields as Tweet::api_serialize
+    void api_serialize(cereal::JSONOutputArchive& ar);
+};
+
+/* A block of records, stored column by column. */
+struct TweetLogBlock {
+    std::vector<int> id_tweet, id_tweeter, id_link, generation, id_content, id_original_author, n_retweets;
+    std::vector<char> type, language, hashtag;
+    std::vector<double> creation_time, deletion_time;
+
+    void push_back(const TweetRecord& record);
+    TweetRecord get(size_t i) const;
+    size_t size() const {
+        return id_tweet.size();
+    }
+    void clear();
+
+    void write(FILE* file) const;
+    // Returns false at the end of the file
+    bool read(FILE* file);
+};
+
+/* Reads the records of a log file in order. */
+struct TweetLogReader {
+    // Reads at most 'limit' records
+    TweetLogReader(const std::string& path, size_t limit);
+    ~TweetLogReader();
+
+    bool next(TweetRecord& record);
+private:
+    FILE* file;
+    TweetLogBlock block;
+    size_t position, n_read, limit;
+};
+
+/* TweetLog:
+ The tweets that expired from the tweet bank, appended to a binary file in
+ blocks of columns. Full blocks are written by a background thread, so the
+ simulation only copies a few numbers per expired tweet.
+
+ The file is created by the first append. A saved network stores only the
+ number of records, and loading it continues the file from there. */
+class TweetLog {
+public:
+    TweetLog() {
+        file = NULL;
+        n_records = 0;
+        writing = stopping = false;
+    }
+    ~TweetLog() {
+        close();
+    }
+    TweetLog(const TweetLog&) = delete;
+    TweetLog& operator=(const TweetLog&) = delete;
+
+    // Set the file of the log. Nothing is written until the first append.
+    void open(const std::string& path) {
+        close();
+        this->path = path;
+        n_records = 0;
+    }
+    void append(const Tweet& tweet);
+    // Append the records of other logs, in order of deletion time
+    void merge(const std::vector<TweetLog*>& logs);
+    // Wait for every appended record to be in the file
+    void flush();
+    void close();
+    // Close and delete the file
+    void discard();
+
+    size_t size() const {
+        return n_records;
+    }
+
+    template <typename Function>
+    void for_each(Function f) {
+        flush();
+        TweetLogReader reader(path, n_records);
+        TweetRecord record;
+        while (reader.next(record)) {
+            f(record);
+        }
+    }
+
+    template <typename Archive>
+    void save(Archive& ar) const {
+        // The records themselves stay in the file
+        const_cast<TweetLog*>(this)->flush();
+        ar(n_records);
+    }
+    template <typename Archive>
+    void load(Archive& ar) {
+        size_t n_saved = 0;
+        ar(n_saved);
+        resume(n_saved);
+    }
+private:
+    void append(const TweetRecord& record);
+    void start(const char* mode);
+    // Continue an existing file after its first n_saved records
+    void resume(size_t n_saved);
+    // Queue the current block for the writer thread
+    void hand_over();
+    void write_blocks();
+
+    std::string path;
+    FILE* file;
+    size_t n_records;
+    TweetLogBlock current;
+
+    // Full blocks waiting for the writer thread
+    std::deque<TweetLogBlock> pending;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wakeup, written;
+    bool writing, stopping;
+};
+
+#endif
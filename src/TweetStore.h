@@ -0,0 +1,118 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#ifndef TWEETSTORE_H_
+#define TWEETSTORE_H_
+
+#include <vector>
+#include <memory>
+
+#include "util.h"
+#include "serialization.h"
+#include "tweets.h"
+
+/* TweetStore:
+ Holds the tweets in fixed-size chunks, so that a tweet never moves while it
+ is alive, and growing the store does not copy the tweets already in it.
+ Freed slots are reused first. */
+struct TweetStore {
+    TweetStore() {
+        n_slots = n_live = 0;
+    }
+
+    // A default-constructed tweet in a free slot
+    tweet_ref_t alloc() {
+        tweet_ref_t ref;
+        if (!free_list.empty()) {
+            ref = free_list.back();
+            free_list.pop_back();
+        } else {
+            if (n_slots == chunks.size() * CHUNK_SIZE) {
+                chunks.emplace_back(new Tweet[CHUNK_SIZE]);
+            }
+            ref = n_slots++;
+            live.push_back(false);
+        }
+        live[ref] = true;
+        n_live++;
+        return ref;
+    }
+
+    void free(tweet_ref_t ref) {
+        // Drop the tweet's content now rather than when the slot is reused
+        get(ref) = Tweet();
+        live[ref] = false;
+        free_list.push_back(ref);
+        n_live--;
+    }
+
+    Tweet& get(tweet_ref_t ref) {
+        DEBUG_CHECK(ref < n_slots && live[ref], "Not a live tweet!");
+        return chunks[ref >> CHUNK_BITS][ref & (CHUNK_SIZE - 1)];
+    }
+
+    // The number of live tweets
+    size_t size() const {
+        return n_live;
+    }
+    // One more than the largest ref handed out
+    size_t capacity() const {
+        return n_slots;
+    }
+
+    template <typename Archive>
+    void save(Archive& ar) const {
+        ar(n_slots, live, free_list);
+        for (tweet_ref_t ref = 0; ref < n_slots; ref++) {
+            if (live[ref]) {
+                ar(chunks[ref >> CHUNK_BITS][ref & (CHUNK_SIZE - 1)]);
+            }
+        }
+    }
+    template <typename Archive>
+    void load(Archive& ar) {
+        ar(n_slots, live, free_list);
+        chunks.clear();
+        while (chunks.size() * CHUNK_SIZE < n_slots) {
+            chunks.emplace_back(new Tweet[CHUNK_SIZE]);
+        }
+        n_live = 0;
+        for (tweet_ref_t ref = 0; ref < n_slots; ref++) {
+            if (live[ref]) {
+                ar(get(ref));
+                n_live++;
+            }
+        }
+    }
+private:
+    static const int CHUNK_BITS = 8;
+    static const size_t CHUNK_SIZE = 1 << CHUNK_BITS;
+
+    std::vector<std::unique_ptr<Tweet[]>> chunks;
+    std::vector<bool> live;
+    std::vector<tweet_ref_t> free_list;
+    size_t n_slots, n_live;
+};
+
+#endif
@@ -32,7 +32,8 @@
 
 #include "CategoryGrouper.h"
 
-#include "mtwist.h"
+#include "RandomStreams.h"
+#include "AliasTable.h"
 
 #include "events.h"
 
@@ -57,6 +58,8 @@ struct Agent {
 
     double ideology_tweet_percent = 0;
     double creation_time = 0;
+    // Scales the follow and tweet rates of a lognormal 'activity_distribution', see AgentActivity.h
+    double activity = 1;
 
     // this is the average chatiness of the agents following list
     double avg_chatiness = 0.0;
@@ -91,6 +94,7 @@ struct Agent {
           , NVP(n_tweets), NVP(n_retweets)
           , NVP(region_bin)
           , NVP(ideology_tweet_percent), NVP(creation_time)
+          , NVP(activity)
           , NVP(avg_chatiness)
           , NVP(language)
           , NVP(ideology_bin)
@@ -115,6 +119,17 @@ struct AgentStats {
     int64 n_agent_follows = 0, n_pref_agent_follows = 0;
     int64 n_retweet_follows = 0, n_hashtag_follows = 0;
     int64 n_hashtags = 0;
+
+    void add(const AgentStats& o) {
+        n_follows += o.n_follows, n_followers += o.n_followers, n_tweets += o.n_tweets;
+        n_original_tweets += o.n_original_tweets, n_retweets += o.n_retweets, n_unfollows += o.n_unfollows;
+        n_followback += o.n_followback;
+        n_random_follows += o.n_random_follows, n_preferential_follows += o.n_preferential_follows;
+        n_agent_follows += o.n_agent_follows, n_pref_agent_follows += o.n_pref_agent_follows;
+        n_retweet_follows += o.n_retweet_follows, n_hashtag_follows += o.n_hashtag_follows;
+        n_hashtags += o.n_hashtags;
+    }
+
     template <typename Archive>
     void serialize(Archive& ar) {
         ar(NVP(n_follows), NVP(n_followers), NVP(n_tweets), 
@@ -149,8 +164,8 @@ struct AgentType {
     // categorize the agents by age
     CategoryGrouper age_ranks;
     CategoryGrouper follow_ranks;
-    std::vector<double> updating_probs;
     double tweet_type_probs[N_TWEET_TYPES];
+    AliasTable tweet_type_sampler; // Sampler for tweet_type_probs, not serialized
 
     AgentStats stats;
 
@@ -173,6 +188,7 @@ struct AgentType {
         for (int i = 0; i < N_TWEET_TYPES; i++) {
             tweet_type_probs[i] = E.tweet_type_probs[i];
         }
+        tweet_type_sampler = E.tweet_type_sampler;
     }
 
     template <typename Archive>
@@ -186,7 +202,7 @@ struct AgentType {
         ar(NVP(agent_cap), NVP(agent_list));
         ar(NVP(age_ranks));
         ar(NVP(follow_ranks));
-        ar(NVP(updating_probs), NVP(stats));
+        ar(NVP(stats));
         for (auto& ttp : tweet_type_probs) {
             ar(ttp);
         }
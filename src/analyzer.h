@@ -32,7 +32,7 @@
 
 #include <lcommon/Timer.h>
 
-#include <dependencies/mtwist.h>
+#include "RandomStreams.h"
 
 extern "C" {
 #include "capi.h"
@@ -45,15 +45,26 @@ extern "C" {
 
 #include "serialization.h"
 #include "TweetBank.h"
-
-extern volatile int SIGNAL_ATTEMPTS;
+#include "TweetLog.h"
+#include "EventRateTree.h"
+#include "EndpointPool.h"
+#include "AgentActivity.h"
+#include "util/FenwickTree.h"
+
+// The number of interrupt signals (ctrl-c, SIGUSR1) the process has received so far
+int analyzer_signal_count();
+
+// Per-simulation state of the query API and of the Lua scripting, see analyzer_api.cpp and interactive_mode.cpp
+struct ApiState;
+struct InteractiveModeLuaState;
+// Region-partitioned simulation, see analyzer_parallel.h
+struct RegionPartition;
+struct RegionPartitions;
 
 // Global network stats
 struct NetworkStats {
-    double prob_add = 0;
-    double prob_follow = 0;
-    double prob_tweet = 0;
-    double prob_retweet = 0;
+    // The rate of each event channel, used to select the next event
+    EventRateTree event_rates;
 
     double event_rate = 0;
 
@@ -64,7 +75,7 @@ struct NetworkStats {
 
     template <typename Archive>
     void serialize(Archive& ar) {
-        ar(NVP(prob_add), NVP(prob_follow), NVP(prob_retweet), NVP(prob_tweet));
+        ar(NVP(event_rates));
         ar(NVP(event_rate), NVP(n_steps), NVP(n_outputs));
         // Don't serialize 'user_did_exit'
         // Valid because only full of primitive types:
@@ -79,6 +90,34 @@ struct NetworkStats {
 
 struct Analyzer;
 
+/* RateLedger:
+ Cached follow and tweet rate sums, summed over all agent types.
+ Within a month only the newest cohort of each agent type grows, so
+ creating an agent is an O(1) delta (O(log months) for the cohort trees).
+ Everything is recomputed when a month boundary is crossed, or after the
+ configuration is reloaded. */
+struct RateLedger {
+    // The month the ledger was computed for, -1 if it must be recomputed
+    int month = -1;
+    double follow_rate = 0, tweet_rate = 0;
+    // The rates of each agent type, used to descend into the follow and tweet channels
+    std::vector<double> type_follow_rate, type_tweet_rate;
+    // The rate contributed by each new agent, indexed by agent type
+    std::vector<double> per_new_follow_rate, per_new_tweet_rate;
+    // The rate of each creation cohort of each agent type, indexed by agent type
+    // and then by the age of the cohort in months (0 for the agents created this month).
+    // Selecting the cohort of an agent is a descent of these trees. Empty while
+    // rate_add is 0, as every agent then has the rate of the current month.
+    std::vector<FenwickTree<double>> follow_cohorts, tweet_cohorts;
+
+    bool valid() const {
+        return month != -1;
+    }
+    void invalidate() {
+        month = -1;
+    }
+};
+
 struct InteractiveModeState {
     // Interactive mode allows for controlling the simulation using Lua.
     // we run the interactive_mode Lua function, defined typically
@@ -115,19 +154,33 @@ struct AnalysisState {
     // This is used to communicate with hashkat during the event loop.
     EventCallbacks event_callbacks;
 
+    // Whether the event code checks the hooks, callbacks and query API, see analyzer_observed.h.
+    // Chosen when the simulation starts, and always true before.
+    bool observed = true;
+
     // The full contents of the simulated network.
-    Network network;
+    // Region partitions refer to the network of the main state instead of their own.
+    Network own_network;
+    Network& network;
 
     // Various categorizations of users.
     CategoryGrouper tweet_ranks;
     CategoryGrouper follow_ranks;
     CategoryGrouper retweet_ranks;
     CategoryGrouper age_ranks;
+    // With linear preferential attachment, the agents to follow are drawn from here,
+    // see use_follow_endpoints(). Not serialized, rebuilt when a network is loaded or partitions are merged.
+    EndpointPool follow_endpoints;
+    // The rate of every agent, see use_agent_activity(). Not serialized,
+    // rebuilt with the rate ledger.
+    AgentActivity activity;
 
     // Our distinct agent classes.
     // Agent probabilities are derived from config,
     // while the list of users within is derived from
     AgentTypeVector agent_types;
+    // For choosing the type of a new agent by prob_add. Not serialized, rebuilt by sync_rates.
+    AliasTable agent_type_sampler;
     std::vector<int> agent_cap;
 
     // Add any values that must be extracted from 'analyze' here.
@@ -151,10 +204,14 @@ struct AnalysisState {
        - O(log N), insertion into the tweet bank via add(tweet object)
        - O(log N), weighted selection for a tweet via pick_random_uniform(RNG object) */
 
+    // The cascades of the released tweet contents, see TweetCascade.h.
+    // Declared before the tweets, whose contents count themselves here when they are destroyed.
+    CascadeStats cascade_stats;
+
     TweetBank tweet_bank;
 
-    // old tweets being stored in a vector to be accessed after sim
-    std::vector<Tweet> oldTweets;
+    // The tweets that left the tweet bank, kept on disk to be accessed after sim
+    TweetLog old_tweets;
 
     /* most_pop_tweet: The most popular tweet, by number of retweets. */
 
@@ -169,20 +226,41 @@ struct AnalysisState {
      a chance of propagating a given tweet in their own immediate network. */
 
     HashTags hashtags;
-    std::vector<double> updating_follow_probabilities;
 
     /* InteractiveModeState: 
      State for determining when to begin interactive mode. See above. */
     InteractiveModeState interactive_mode_state;
 
-    MTwist rng;
+    // Lua context for interactive mode and the Lua hooks, created on first use.
+    std::shared_ptr<InteractiveModeLuaState> lua_state;
+    // Streams and queued commands of the query API, created on first use.
+    std::shared_ptr<ApiState> api_state;
+
+    // Number of interrupt signals this simulation has already handled
+    int signals_handled;
+
+    // Set if this state simulates a single region of a parallel run.
+    RegionPartition* partition = NULL;
+    // The region partitions, while a parallel run is active.
+    std::shared_ptr<RegionPartitions> region_partitions;
+
+    // Named random streams of this state, see RandomStreams.h
+    RandomStreams rng;
 
     /* AnalysisStats:
      Various statistics gathered for analysis purposes. */
     NetworkStats stats;
 
+    // Not serialized, rebuilt on the first rate update after loading.
+    RateLedger rate_ledger;
+
     AnalysisState(const ParsedConfig& config, int seed) :
-            config(config), tweet_bank(*this){
+            AnalysisState(config, seed, own_network) {
+    }
+
+    // 'stream_partition' keys the random streams of a region partition, 0 for a whole simulation.
+    AnalysisState(const ParsedConfig& config, int seed, Network& network, int stream_partition = 0) :
+            config(config), network(network), tweet_bank(*this), rng(seed, stream_partition) {
         n_follows = 0;
         end_time = 0;
 
@@ -192,14 +270,42 @@ struct AnalysisState {
         follow_ranks = config.follow_ranks;
         retweet_ranks = config.retweet_ranks;
         agent_types = config.agent_types;
+        build_agent_type_sampler();
         // Fill callbacks with NULL
         memset(&event_callbacks, 0, sizeof(EventCallbacks));
 
-        rng.init_genrand(seed);
         time = 0.0;
+        // Signals received before this simulation started are not its concern
+        signals_handled = analyzer_signal_count();
         // Let analyze.cpp handle any additional initialization logic from here.
     }
 
+    // With use_barabasi and barabasi_exponent == 1, preferential follows pick from follow_endpoints
+    bool use_follow_endpoints() const {
+        return config.use_barabasi && config.barabasi_exponent == 1;
+    }
+
+    // Give an agent its entries in follow_endpoints, one for itself and one per follower
+    void add_follow_endpoints(int id_agent) {
+        for (int i = 0; i <= network[id_agent].follower_set.size(); i++) {
+            follow_endpoints.add(id_agent);
+        }
+    }
+    void rebuild_follow_endpoints() {
+        follow_endpoints.clear();
+        if (!use_follow_endpoints()) {
+            return;
+        }
+        for (Agent& agent : network) {
+            add_follow_endpoints(agent.id);
+        }
+    }
+
+    // Unless agents are equally active, agents are selected from 'activity'
+    bool use_agent_activity() const {
+        return config.activity_model != UNIFORM_ACTIVITY;
+    }
+
     AgentType& agent_type(int agent_id) {
         return agent_types[network[agent_id].agent_type];
     }
@@ -208,6 +314,11 @@ struct AnalysisState {
         return time / APPROX_MONTH;
     }
 
+    // Signals received that this simulation has not yet handled
+    int signal_attempts() {
+        return analyzer_signal_count() - signals_handled;
+    }
+
 
     /* Synchronize rates from a loaded configuration.
      * This is done because, although we can load a new configuration,
@@ -220,6 +331,16 @@ struct AnalysisState {
         for (int i = 0; i < agent_types.size(); i++) {
             agent_types[i].sync_configuration(config.agent_types[i]);
         }
+        build_agent_type_sampler();
+        rate_ledger.invalidate();
+    }
+
+    void build_agent_type_sampler() {
+        std::vector<double> probs;
+        for (AgentType& type : agent_types) {
+            probs.push_back(type.prob_add);
+        }
+        agent_type_sampler.build(probs);
     }
 
     // For network reading/writing:
@@ -236,14 +357,14 @@ struct AnalysisState {
         ar(NVP(retweet_ranks));
         ar(NVP(age_ranks));
         ar(NVP(tweet_bank));
-        ar(NVP(oldTweets));
+        ar(NVP(old_tweets));
         ar(NVP(stats));
+        ar(NVP(cascade_stats));
         ar(NVP(hashtags));
         ar(NVP(agent_types));
         ar(NVP(agent_cap));
 
         ar(NVP(n_follows), NVP(end_time));
-        ar(NVP(updating_follow_probabilities));
         // Don't serialize interactive_mode_state
         ar(NVP(rng));
     }
@@ -261,13 +382,17 @@ struct RetweetChoice {
     int id_observer;
     int id_link;
     int generation;
+    // The cascade node of the tweet being retweeted
+    int cascade_parent;
 
-    std::shared_ptr<TweetContent>* content;
+    // The tweet being retweeted, in the tweet bank of the selecting state
+    tweet_ref_t tweet;
     RetweetChoice() :
-            id_author(-1), id_observer(-1), id_link(-1), generation(-1), content(NULL) {
+            id_author(-1), id_observer(-1), id_link(-1), generation(-1), cascade_parent(-1), tweet(NO_TWEET) {
     }
-    RetweetChoice(int id_author, int id_observer, int id_link, int generation, std::shared_ptr<TweetContent>* tweet) :
-            id_author(id_author), id_observer(id_observer), id_link(id_link), generation(generation), content(tweet) {
+    RetweetChoice(int id_author, int id_observer, int id_link, int generation, int cascade_parent, tweet_ref_t tweet) :
+            id_author(id_author), id_observer(id_observer), id_link(id_link), generation(generation),
+            cascade_parent(cascade_parent), tweet(tweet) {
     }
     bool valid() {
         return (id_author != -1);
@@ -277,9 +402,14 @@ struct RetweetChoice {
 /** Function prototypes **/
 
 // 'analyzer_select_agent' and 'analyzer_set_rates' implement time-dependent rates
-// Select based on any SelectionType
-int analyzer_select_agent(AnalysisState& state, SelectionType type);
+// Select based on any SelectionType, 'rand_num' is the remainder of the event selection draw
+// and lies within [0, rate of the event channel).
+int analyzer_select_agent(AnalysisState& state, SelectionType type, double rand_num);
 void analyzer_rate_update(AnalysisState& state);
+// Account for a newly created agent in the cached rates
+void analyzer_rate_add_agent(AnalysisState& state, int id_agent);
+// The followers of an agent changed, which matters to a 'followers' activity_distribution
+void analyzer_rate_followers_changed(AnalysisState& state, int id_agent);
 
 // Follow a specific user
 bool analyzer_handle_follow(AnalysisState& state, int id_actor, int id_target, int follow_method);
@@ -290,7 +420,10 @@ bool analyzer_sim_time_check(AnalysisState& state);
 bool analyzer_real_time_check(AnalysisState& state);
 void analyzer_save_network_state(AnalysisState& state, const char* fname);
 void analyzer_load_network_state(AnalysisState& state, const char* fname);
-bool analyzer_follow_agent(AnalysisState& state, int agent, double time_of_follow);
+// Unless 'choose_region' is false, a region partition first picks the region of the followed agent
+bool analyzer_follow_agent(AnalysisState& state, int agent, double time_of_follow, bool choose_region = true);
+// Complete a follow of a chosen agent, including the follow-back and categorization
+bool analyzer_complete_follow(AnalysisState& state, int id_actor, int id_target, int follow_method);
 
 // Implements a follow-back
 bool analyzer_followback(AnalysisState& state, int follower, int followed);
@@ -302,16 +435,22 @@ void analyzer_main(AnalysisState& state);
 double analyzer_total_retweet_rate(AnalysisState& state);
 
 // check query API for incoming events 
-void analyzer_api_tweet(AnalysisState& state, Tweet& tweet);
+void analyzer_api_tweet(AnalysisState& state, tweet_ref_t tweet);
 void analyzer_handle_outstanding_api_request(AnalysisState& state);
-void spawn_stdin_command_queueing_thread_for_api();
+void spawn_stdin_command_queueing_thread_for_api(AnalysisState& state);
 
 // this is for the retweet agent selection
-RetweetChoice analyzer_select_tweet_to_retweet(AnalysisState& state, SelectionType type);
+RetweetChoice analyzer_select_tweet_to_retweet(AnalysisState& state, SelectionType type, double rand_num);
 
 // Create an agent
 bool analyzer_create_agent(AnalysisState& state);
 
+// Drives a region partition, see analyzer_parallel.cpp
+void analyzer_partition_init(AnalysisState& state);
+void analyzer_partition_run_window(AnalysisState& state, double window_end);
+// Retweet 'content', which was chosen in another partition (choice.tweet is not used)
+bool analyzer_retweet(AnalysisState& state, RetweetChoice choice, const TweetContentRef& content);
+
 void update_retweets(AnalysisState& state);
 
 #endif
@@ -40,16 +40,21 @@ using namespace std;
 
 typedef shared_ptr<fstream> fstream_ptr;
 
-// Uses global variables for convenience, as there can only be one API-serving instance:
+// Held by each AnalysisState, created when first needed:
 struct ApiState {
     map<string, fstream_ptr> tweet_pipes;
     fstream async_response_stream; // TODO
     SafeQueue<string> queued_commands;
 };
 
-static ApiState api;
+static ApiState& get_api_state(AnalysisState& state) {
+    if (!state.api_state) {
+        state.api_state.reset(new ApiState);
+    }
+    return *state.api_state;
+}
 
-static void handle_outstanding_api_request(const string& line) {
+static void handle_outstanding_api_request(ApiState& api, const string& line) {
     stringstream str_stream {line};
     cereal::JSONInputArchive ar {str_stream};
     string type, stream_path;
@@ -64,14 +69,15 @@ static void handle_outstanding_api_request(const string& line) {
 }
 
 // Write out tweets to the locations specified by the API: 
-void analyzer_api_tweet(AnalysisState& state, Tweet& tweet) { 
-    if (!state.config.enable_query_api || api.tweet_pipes.empty()) {
+void analyzer_api_tweet(AnalysisState& state, tweet_ref_t tweet) { 
+    if (!state.config.enable_query_api || !state.api_state || state.api_state->tweet_pipes.empty()) {
         return; // Fast case
     }
+    ApiState& api = *state.api_state;
     stringstream str_stream;
     { // Scope off 'writer'
         JsonWriter writer {state, str_stream};
-        tweet.api_serialize(writer);
+        state.tweet_bank.get(tweet).api_serialize(writer);
     }
     string tweet_str = str_stream.str();
     // Remove newlines from the tweet data:
@@ -84,11 +90,14 @@ void analyzer_api_tweet(AnalysisState& state, Tweet& tweet) {
     }
 }
 
-void spawn_stdin_command_queueing_thread_for_api() {
-    std::thread([](){
+void spawn_stdin_command_queueing_thread_for_api(AnalysisState& state) {
+    // The thread may outlive the simulation, so it shares ownership of the queue
+    get_api_state(state);
+    shared_ptr<ApiState> api = state.api_state;
+    std::thread([api](){
 	string line;
 	while (getline(cin, line)) {
-            api.queued_commands.enqueue(line);
+            api->queued_commands.enqueue(line);
 	}
     }).detach();
 }
@@ -96,8 +105,9 @@ void spawn_stdin_command_queueing_thread_for_api() {
 // Read an API request from a single line of standard input. 
 void analyzer_handle_outstanding_api_request(AnalysisState& state) {
     // If we have an outstanding request, handle it.
+    ApiState& api = get_api_state(state);
     string line = api.queued_commands.nonblocking_dequeue();
     if (!line.empty()) {
-        handle_outstanding_api_request(line);
+        handle_outstanding_api_request(api, line);
     }
 }
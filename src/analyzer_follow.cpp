@@ -29,6 +29,8 @@
 
 #include "events.h"
 #include "analyzer.h"
+#include "analyzer_parallel.h"
+#include "analyzer_observed.h"
 
 using namespace std;
 
@@ -39,19 +41,15 @@ struct AnalyzerFollow {
     AnalysisState& state;
     NetworkStats& stats;
     CategoryGrouper& follow_ranks;
-    vector<double>& follow_probabilities;
-    vector<double>& updating_follow_probabilities;
 
     AgentTypeVector& agent_types;
-    MTwist& rng;
+    RandomStream& rng;
     HashTags& hashtags;
     // There are multiple 'Analyzer's, they each operate on parts of AnalysisState.
     AnalyzerFollow(AnalysisState& state) :
             network(state.network), state(state), stats(state.stats),
             config(state.config), follow_ranks(state.follow_ranks),
-            follow_probabilities(state.config.follow_probabilities),
-            updating_follow_probabilities(state.updating_follow_probabilities),
-            agent_types(state.agent_types), rng(state.rng), hashtags(state.hashtags) {
+            agent_types(state.agent_types), rng(state.rng.follow), hashtags(state.hashtags) {
     }
 
    /***************************************************************************
@@ -73,8 +71,17 @@ struct AnalyzerFollow {
        }
     }
     // Returns true if a follow is added that was not already added
+   template <bool OBSERVED>
    bool handle_follow(int id_actor, int id_target, int follow_method) {
        PERF_TIMER();
+       if (partition_is_remote(state, id_actor) || partition_is_remote(state, id_target)) {
+           RemoteEvent event(RemoteEvent::HANDLE_FOLLOW);
+           event.id_actor = id_actor;
+           event.id_target = id_target;
+           event.follow_method = follow_method;
+           partition_defer(state, event);
+           return false;
+       }
        Agent& A = network[id_actor];
        Agent& T = network[id_target];
        bool was_added = A.following_set.add(state, id_target);
@@ -87,7 +94,15 @@ struct AnalyzerFollow {
            if (config.stage1_unfollow) {
                update_chatiness(A, id_target);
            }
-           lua_hook_follow(state, id_actor, id_target);
+           if (OBSERVED) {
+               lua_hook_follow(state, id_actor, id_target);
+           }
+           if (config.use_barabasi && state.use_follow_endpoints()) {
+               partition_home(state, id_target).follow_endpoints.add(id_target);
+           }
+           if (config.activity_model == FOLLOWERS_ACTIVITY) {
+               analyzer_rate_followers_changed(partition_home(state, id_target), id_target);
+           }
            RECORD_STAT(state, A.agent_type, n_follows);
            RECORD_STAT(state, T.agent_type, n_followers);
            return true;
@@ -104,77 +119,21 @@ struct AnalyzerFollow {
        return rng.rand_int(n_agents);
    }
    
+   /* The share of the total preferential weight held by a category picked preferentially */
    double preferential_weight() {
-       double rand_num = rng.rand_real_not0();
-       double prob_sum = 0;
-       auto& updating_probs = updating_follow_probabilities;
-       
-       updating_probs.resize(follow_ranks.categories.size());
-       for (int i = 0; i < follow_ranks.categories.size(); i ++) {
-           CategoryAgentList& C = follow_ranks.categories[i];
-           updating_probs[i] = follow_ranks.categories[i].prob * C.agents.size();
-           prob_sum += follow_ranks.categories[i].prob * C.agents.size();
+       int i = follow_ranks.pick_weighted_category(rng);
+       if (i == -1) {
+           return 0;
        }
-       for (auto& p : updating_probs) {
-           p /= prob_sum;
-       }
-       int i = 0;
-       double val = 0;
-       for (auto& p : updating_probs) {
-           if (rand_num <= p) {
-               val = p;
-               break;
-           }
-           rand_num -= p;
-           i++;
-       }
-       return val;
+       return follow_ranks.weight(i) / follow_ranks.total_weight();
    }
 
-#ifdef REFACTORING
-   int preferential_barabasi_follow_method()
-   {
-       PERF_TIMER();
-
-       double rand_num = rng.rand_real_not0();
-       auto& bins = network.bins();
-       double den = network.denominator();
-       for (auto i = 0; i <= network.kmax(); ++i)
-       {
-           double probab = (double(i+1) * bins[i].size()) / den;
-           if (rand_num <= probab)
-           {
-               if (!bins[i].empty())
-               {
-                   auto agent_id = bins[i].cbegin();
-                   std::advance(agent_id, rng.rand_int(bins[i].size()));
-                   return *agent_id;
-               }
-           }
-           rand_num -= probab;
-       }
-       return -1;
-   }
-#else
    int preferential_barabasi_follow_method() {
        PERF_TIMER();
 
-       double rand_num = rng.rand_real_not0();
-       // if we want to use a preferential follow method
-       int agent_to_follow = -1;
-       double sum_of_weights = 0;
-       updating_follow_probabilities.resize(follow_probabilities.size());
-       /* search through the probabilities for each threshold and find
-       the right bin to land in */
-
-       for (int i = 0; i < follow_probabilities.size(); i++){
-           // look at each category
-           CategoryAgentList& C = follow_ranks.categories[i];
-           updating_follow_probabilities[i] = follow_probabilities[i] * C.agents.size();
-           sum_of_weights += C.agents.size()*follow_probabilities[i];
-       }
-       for (int i = 0; i < follow_probabilities.size(); i++){
-           updating_follow_probabilities[i] /= sum_of_weights;
+       if (state.use_follow_endpoints()) {
+           // Exact linear preferential attachment: one entry per agent and per follower
+           return state.follow_endpoints.pick_random_uniform(rng);
        }
 
 #ifdef REFACTORING_DEBUG_OUTPUT
@@ -182,16 +141,15 @@ struct AnalyzerFollow {
        std::ostringstream name;
        name << "output/org/" << std::setfill('0') << std::setw(5) << n++ << ".txt";
        std::ofstream out(name.str());
-       out << "# Random Number: " << rand_num << std::endl;
        out << "# Number of Agents: " << network.size() << std::endl;
-       out << "# Denominator: " << sum_of_weights << std::endl;
+       out << "# Denominator: " << follow_ranks.total_weight() << std::endl;
        out << "\n# Degree (k)\tCount\tk*Count\tProbability (k*Count/Den)\tAgent Ids\n";
-       for (auto i = 0; i < updating_follow_probabilities.size(); ++i)
+       for (auto i = 0; i < follow_ranks.categories.size(); ++i)
        {
-           out << std::setw(7) << follow_probabilities[i] << ' ';
+           out << std::setw(7) << follow_ranks.categories[i].prob << ' ';
            out << std::setw(6) << follow_ranks.categories[i].agents.size() << ' ';
-           out << std::setw(6) << follow_probabilities[i] * follow_ranks.categories[i].agents.size() << ' ';
-           out << std::setw(15) << updating_follow_probabilities[i];
+           out << std::setw(6) << follow_ranks.weight(i) << ' ';
+           out << std::setw(15) << follow_ranks.weight(i) / follow_ranks.total_weight();
            out << '\t';
            for (auto followed : follow_ranks.categories[i].agents)
                out << followed << ',';
@@ -199,23 +157,10 @@ struct AnalyzerFollow {
        }
 #endif  // REFACTORING_DEBUG_OUTPUT
 
-       for (int i = 0; i < updating_follow_probabilities.size(); i++) {
-           if (rand_num <= updating_follow_probabilities[i]) {
-               // point to the category we landed in
-               CategoryAgentList& C = follow_ranks.categories[i];
-               // make sure we're not pulling a agent from an empty list
-               if (C.agents.size() != 0) {
-                   // pull a random agent from whatever bin we landed in and break so we do not continue this loop
-                   agent_to_follow = C.agents[rng.rand_int(C.agents.size())];
-                   return agent_to_follow;
-               }
-           }
-           // part of the above search
-           rand_num -= updating_follow_probabilities[i];
-       }
-       return -1;
+       // Otherwise there is one category per follower count, weighted by
+       // (count + 1)^barabasi_exponent: pick one, then an agent within it
+       return follow_ranks.pick_weighted_agent(rng);
    }
-#endif  // REFACTORING
 
 #ifdef REFACTORING2
    int twitter_preferential_follow_method(Agent& e, double time_of_follow)
@@ -283,38 +228,23 @@ struct AnalyzerFollow {
        if (!rng.random_chance(follow_prob)) {
            return -1;
        }
-       
-       double rand_num = rng.rand_real_not0();
-       double prob_sum = 0;
-       auto& updating_probs = updating_follow_probabilities;
-       
-       updating_probs.resize(follow_ranks.categories.size());
-       for (int i = 0; i < follow_ranks.categories.size(); i ++) {
-           CategoryAgentList& C = follow_ranks.categories[i];
-           updating_probs[i] = follow_ranks.categories[i].prob * C.agents.size();
-           prob_sum += follow_ranks.categories[i].prob * C.agents.size();
-       }
-       for (auto& p : updating_probs) {
-           p /= prob_sum;
-       }
 
 #ifdef REFACTORING_DEBUG_OUTPUT
        static unsigned n = 0;
        std::ostringstream name;
        name << "output/org/" << std::setfill('0') << std::setw(5) << n++ << ".txt";
        std::ofstream out(name.str());
-       out << "# Random Number: " << rand_num << std::endl;
        out << "# Number of Agents: " << network.size() << std::endl;
        out << "# Number of Categories: " << follow_ranks.categories.size() << std::endl;
-       out << "# Denominator: " << prob_sum << std::endl;
+       out << "# Denominator: " << follow_ranks.total_weight() << std::endl;
        out << "\n# Degree (k)\tCount\tProb\tCount*Prob\tProbability (Prob*Count/Den)\tAgent Ids\n";
        for (auto i = 0; i < follow_ranks.categories.size(); ++i)
        {
            out << std::setw(7) << i+1 << ' ';
            out << std::setw(6) << follow_ranks.categories[i].agents.size() << ' ';
            out << std::setw(6) << follow_ranks.categories[i].prob << ' ';
-           out << std::setw(6) << follow_ranks.categories[i].prob * follow_ranks.categories[i].agents.size() << ' ';
-           out << std::setw(15) << updating_probs[i];
+           out << std::setw(6) << follow_ranks.weight(i) << ' ';
+           out << std::setw(15) << follow_ranks.weight(i) / follow_ranks.total_weight();
            out << '\t';
            for (auto followed : follow_ranks.categories[i].agents)
                out << followed << ',';
@@ -322,18 +252,8 @@ struct AnalyzerFollow {
        }
 #endif  // REFACTORING_DEBUG_OUTPUT
 
-       int i = 0;
-       for (auto& p : updating_probs) {
-           if (rand_num <= p) {
-               CategoryAgentList& C = follow_ranks.categories[i];
-               // pull a random agent from whatever bin we landed in and break so we do not continue this loop
-               int agent_to_follow = C.agents[rng.rand_int(C.agents.size())];
-               return agent_to_follow;
-           }
-           rand_num -= p;
-           i++;
-       }
-       return -1;
+       // Pick a category in proportion to prob * size, then an agent within it
+       return follow_ranks.pick_weighted_agent(rng);
    }
 #endif  // REFACTORING2
 
@@ -371,29 +291,8 @@ struct AnalyzerFollow {
        for (int i = 0; i < agent_types.size(); i++) {
            if (rand_num <= agent_types[i].prob_follow) {
 
-               double another_rand_num = rng.rand_real_not0();
-               // make sure we're not pulling from an empty list
-               AgentType& et = agent_types[i];
-               vector<double>& up = et.updating_probs;
-               up.resize(et.follow_ranks.categories.size());
-               double prob_sum = 0;
-               for (int j = 0; j < et.follow_ranks.categories.size(); j ++) {
-                   CategoryAgentList& C = et.follow_ranks.categories[j];
-                   up[j] = et.follow_ranks.categories[j].prob * C.agents.size();
-                   prob_sum += et.follow_ranks.categories[j].prob * C.agents.size();
-               }
-               for (int j = 0; j < up.size(); j ++) {                        
-                   up[j] /= prob_sum;
-               }
-               for (int j = 0; j < up.size(); j ++) {
-                   if (another_rand_num <= up[j]) {
-                       CategoryAgentList& C = et.follow_ranks.categories[j];
-                       // pull a random agent from whatever bin we landed in and break so we do not continue this loop                            
-                       agent_to_follow = C.agents[rng.rand_int(C.agents.size())];
-                       break;
-                   }
-                   another_rand_num -= up[j];
-               }
+               // Pick within the agent type, in proportion to the prob * size of its follow categories
+               agent_to_follow = agent_types[i].follow_ranks.pick_weighted_agent(rng);
            }
            if (agent_to_follow != -1){
                Agent& try_agent = network[agent_to_follow];
@@ -431,7 +330,7 @@ struct AnalyzerFollow {
            4 - hashtag follow
            5 - referral follow
        */
-       int follow_method = rng.kmc_select(&config.model_weights[0], N_FOLLOW_MODELS);
+       int follow_method = config.model_sampler.pick(rng);
        if (follow_method == 0) {
            // Random follow method:
            return random_follow_method(e, network.size());
@@ -448,10 +347,28 @@ struct AnalyzerFollow {
     }
     
    // Returns false to signify that nothing occurred.
-    bool follow_agent(int id_follower, double time_of_follow) {
+    template <bool OBSERVED>
+    bool follow_agent(int id_follower, double time_of_follow, bool choose_region) {
         Agent& e = network[id_follower];
         int agent_to_follow = -1;
 
+        // A region partition only knows the agents of its own region, so the region
+        // of the followed agent is chosen first, and other regions are asked to follow.
+        if (state.partition && choose_region) {
+            int region = partition_pick_follow_region(state);
+            if (region != state.partition->region) {
+                if (partition_in_window(state)) {
+                    RemoteEvent event(RemoteEvent::FOLLOW_IN_REGION);
+                    event.id_actor = id_follower;
+                    event.region = region;
+                    event.time = time_of_follow;
+                    partition_defer(state, event);
+                    return false;
+                }
+                return analyzer_follow_agent(partition_of_region(state, region), id_follower, time_of_follow, false);
+            }
+        }
+
         /* Dispatch to the appropriate follower logic: */
         const int follow_model = config.follow_model;
         if (follow_model == RANDOM_FOLLOW) {
@@ -496,50 +413,63 @@ struct AnalyzerFollow {
         bool same_language = (e.language == network[agent_to_follow].language);
         // check and make sure we are not following ourself, or we are following agent -1
         if (LIKELY(!same_agent && same_language)) {
-            perf_timer_begin("AnalyzerFollower.follow_agent(handle_follow)");
-            // point to the agent who is being followed
-            if (handle_follow(id_follower, agent_to_follow, follow_model)) {
-                /* FEATURE: Follow-back based on target's prob_followback.
-                 * Set in INFILE.yaml as followback_probability. */
-                int et_id = network[agent_to_follow].agent_type;
-                AgentType& et = agent_types[et_id];
-                
-                // TODO this followback process has to be another follow method that happens naturally at some other time, possibly another 'spike' in the rate
-                // TODO AD -- I think we can just queue an event, at some time frame in the future, and activate it
-                // when KMC crosses that time.
-                if (config.use_followback && rng.random_chance(et.prob_followback)) {
-                    analyzer_followback(state, id_follower, agent_to_follow);
-                }
-                // based on the number of followers the followed-agent has, check to make sure we're still categorized properly
-                Agent& target = network[agent_to_follow];
-                // We were able to add the follow:
-                et.follow_ranks.categorize(agent_to_follow, target.follower_set.size());
-                follow_ranks.categorize(agent_to_follow, target.follower_set.size());
-#ifdef REFACTORING
-                network.connect(agent_to_follow, id_follower);
-#endif // REFACTORING
-
-                return true;
+            if (partition_is_remote(state, agent_to_follow)) {
+                RemoteEvent event(RemoteEvent::FOLLOW);
+                event.id_actor = id_follower;
+                event.id_target = agent_to_follow;
+                event.follow_method = follow_model;
+                partition_defer(state, event);
+                return false;
+            }
+            return complete_follow<OBSERVED>(id_follower, agent_to_follow, follow_model);
+        }
+
+        return false; // Return 'false' to signify that nothing happened.
+    }
+
+    template <bool OBSERVED>
+    bool complete_follow(int id_follower, int agent_to_follow, int follow_model) {
+        perf_timer_begin("AnalyzerFollower.follow_agent(handle_follow)");
+        // point to the agent who is being followed
+        if (handle_follow<OBSERVED>(id_follower, agent_to_follow, follow_model)) {
+            /* FEATURE: Follow-back based on target's prob_followback.
+             * Set in INFILE.yaml as followback_probability. */
+            int et_id = network[agent_to_follow].agent_type;
+            // The categories of a region partition only hold its own agents
+            AnalysisState& home = partition_home(state, agent_to_follow);
+            AgentType& et = home.agent_types[et_id];
+            
+            // TODO this followback process has to be another follow method that happens naturally at some other time, possibly another 'spike' in the rate
+            // TODO AD -- I think we can just queue an event, at some time frame in the future, and activate it
+            // when KMC crosses that time.
+            if (config.use_followback && rng.random_chance(et.prob_followback)) {
+                followback<OBSERVED>(id_follower, agent_to_follow);
             }
-            perf_timer_end("AnalyzerFollower.follow_agent(handle_follow)");
+            // based on the number of followers the followed-agent has, check to make sure we're still categorized properly
+            Agent& target = network[agent_to_follow];
+            // We were able to add the follow:
+            et.follow_ranks.categorize(agent_to_follow, target.follower_set.size());
+            home.follow_ranks.categorize(agent_to_follow, target.follower_set.size());
+
+            return true;
         }
+        perf_timer_end("AnalyzerFollower.follow_agent(handle_follow)");
 
         return false; // Return 'false' to signify that nothing happened.
     }
 
+    template <bool OBSERVED>
     bool followback(int prev_actor_id, int prev_target_id) {
         // now the previous target will follow the previous actor back
         Agent& prev_actor = network[prev_actor_id];
         Agent& prev_target = network[prev_target_id];
-        if (handle_follow(prev_target_id, prev_actor_id,N_FOLLOW_MODELS + 1)) {
+        if (handle_follow<OBSERVED>(prev_target_id, prev_actor_id,N_FOLLOW_MODELS + 1)) {
             
             int et_id = network[prev_actor_id].agent_type;
-            AgentType& et = agent_types[et_id];
+            AnalysisState& home = partition_home(state, prev_actor_id);
+            AgentType& et = home.agent_types[et_id];
             et.follow_ranks.categorize(prev_actor_id, prev_actor.follower_set.size());
-            follow_ranks.categorize(prev_actor_id, prev_actor.follower_set.size());
-#ifdef REFACTORING
-            network.connect(prev_actor_id, prev_target_id);
-#endif // REFACTORING
+            home.follow_ranks.categorize(prev_actor_id, prev_actor.follower_set.size());
             RECORD_STAT(state, prev_target.agent_type, n_followback);
             return true;
         }
@@ -555,6 +485,14 @@ struct AnalyzerFollow {
 
 		DEBUG_CHECK(id_unfollower != -1, "Should not be -1 after choice!");
 
+		if (partition_is_remote(state, id_unfollowed) || partition_is_remote(state, id_unfollower)) {
+		    RemoteEvent event(RemoteEvent::UNFOLLOW);
+		    event.id_actor = id_unfollower;
+		    event.id_target = id_unfollowed;
+		    partition_defer(state, event);
+		    return true;
+		}
+
     // Remove our target from our actor's follows:
     bool had_follower = candidate_followers.remove(network[id_unfollower]);
 		 DEBUG_CHECK(had_follower, "unfollow: Did not exist in follower list");
@@ -562,15 +500,51 @@ struct AnalyzerFollow {
         // Remove our unfollowed person from our target's followers:
 		Agent& e_lost_follower = network[id_unfollower];
 		bool had_follow = e_lost_follower.following_set.remove(state, id_unfollowed);
-#ifdef REFACTORING
-        network.disconnect(id_unfollowed, id_unfollower);
-#endif // REFACTORING
          DEBUG_CHECK(had_follow, "unfollow: Did not exist in follow list");
+        if (state.use_follow_endpoints()) {
+            partition_home(state, id_unfollowed).follow_endpoints.remove(id_unfollowed);
+        }
+        if (config.activity_model == FOLLOWERS_ACTIVITY) {
+            analyzer_rate_followers_changed(partition_home(state, id_unfollowed), id_unfollowed);
+        }
 		RECORD_STAT(state, e_lost_follower.agent_type, n_unfollows);
 		return true;
 	}
 };
 
+// The follow code compiled for observed and unobserved simulations, see analyzer_observed.h
+struct FollowFunctions {
+    bool (*handle_follow)(AnalysisState& state, int id_actor, int id_target, int follow_method);
+    bool (*follow_agent)(AnalysisState& state, int agent, double time_of_follow, bool choose_region);
+    bool (*complete_follow)(AnalysisState& state, int id_actor, int id_target, int follow_method);
+    bool (*followback)(AnalysisState& state, int follower, int followed);
+};
+
+template <bool OBSERVED>
+struct FollowEntry {
+    static bool handle_follow(AnalysisState& state, int id_actor, int id_target, int follow_method) {
+        AnalyzerFollow analyzer(state);
+        return analyzer.handle_follow<OBSERVED>(id_actor, id_target, follow_method);
+    }
+    static bool follow_agent(AnalysisState& state, int agent, double time_of_follow, bool choose_region) {
+        AnalyzerFollow analyzer(state);
+        return analyzer.follow_agent<OBSERVED>(agent, time_of_follow, choose_region);
+    }
+    static bool complete_follow(AnalysisState& state, int id_actor, int id_target, int follow_method) {
+        AnalyzerFollow analyzer(state);
+        return analyzer.complete_follow<OBSERVED>(id_actor, id_target, follow_method);
+    }
+    static bool followback(AnalysisState& state, int follower, int followed) {
+        AnalyzerFollow analyzer(state);
+        return analyzer.followback<OBSERVED>(follower, followed);
+    }
+    static FollowFunctions value() {
+        return {&handle_follow, &follow_agent, &complete_follow, &followback};
+    }
+};
+
+static const ObservedTable<FollowFunctions, FollowEntry> FOLLOW_FUNCTIONS;
+
 double preferential_weight(AnalysisState& state) {
     AnalyzerFollow analyzer(state);
     return analyzer.preferential_weight();
@@ -578,8 +552,7 @@ double preferential_weight(AnalysisState& state) {
 
 bool analyzer_handle_follow(AnalysisState& state, int id_actor, int id_target, int follow_method) {
     PERF_TIMER();
-    AnalyzerFollow analyzer(state);
-    return analyzer.handle_follow(id_actor, id_target, follow_method);
+    return FOLLOW_FUNCTIONS[state.observed].handle_follow(state, id_actor, id_target, follow_method);
 }
 
 bool analyzer_handle_unfollow(AnalysisState& state, int id_actor, int id_target) {
@@ -588,14 +561,17 @@ bool analyzer_handle_unfollow(AnalysisState& state, int id_actor, int id_target)
     return analyzer.action_unfollow(id_target, id_actor);
 }
 
-bool analyzer_follow_agent(AnalysisState& state, int agent, double time_of_follow) {
+bool analyzer_follow_agent(AnalysisState& state, int agent, double time_of_follow, bool choose_region) {
     PERF_TIMER();
-    AnalyzerFollow analyzer(state);
-    return analyzer.follow_agent(agent, time_of_follow);
+    return FOLLOW_FUNCTIONS[state.observed].follow_agent(state, agent, time_of_follow, choose_region);
+}
+
+bool analyzer_complete_follow(AnalysisState& state, int id_actor, int id_target, int follow_method) {
+    PERF_TIMER();
+    return FOLLOW_FUNCTIONS[state.observed].complete_follow(state, id_actor, id_target, follow_method);
 }
 
 bool analyzer_followback(AnalysisState& state, int follower, int followed) {
     PERF_TIMER();
-    AnalyzerFollow analyzer(state);
-    return analyzer.followback(follower, followed);
+    return FOLLOW_FUNCTIONS[state.observed].followback(state, follower, followed);
 }
@@ -30,6 +30,7 @@
 #include <iomanip>
 #include <cmath>
 #include <deque>
+#include <algorithm>
 
 // Local includes:
 #include "analyzer.h"
@@ -41,28 +42,42 @@
 
 #include "config_static.h"
 
+#include "dependencies/lcommon/strformat.h"
 #include "dependencies/lcommon/Timer.h"
 #include "dependencies/lcommon/perf_timer.h"
 
 #include "interactive_mode.h"
 #include "FollowerSet.h"
+#include "analyzer_parallel.h"
+#include "analyzer_observed.h"
 
 #include <signal.h>
+#include <mutex>
 
 using namespace std;
 
-volatile int SIGNAL_ATTEMPTS = 0;
+// Signals are received by the whole process, so we only count them here.
+// Every simulation keeps its own count of the signals it has handled (see AnalysisState::signal_attempts).
+static volatile sig_atomic_t SIGNAL_COUNT = 0;
+// The signal count when an interrupt was last handled by any simulation
+static volatile sig_atomic_t SIGNAL_COUNT_HANDLED = 0;
 
 static const int SIGNAL_ATTEMPTS_TO_ABORT = 3;
+// With tau-leaping, leaps expected to contain fewer events are performed as exact steps
+static const double TAU_LEAP_MIN_EVENTS = 10;
 // Handler for singals -- sent by eg Ctrl-C on command-line. Allows us to stop our program gracefully!
 static void signal_handler(int __dummy) {
-    SIGNAL_ATTEMPTS++;
-    if (SIGNAL_ATTEMPTS >= SIGNAL_ATTEMPTS_TO_ABORT) {
+    SIGNAL_COUNT++;
+    if (SIGNAL_COUNT - SIGNAL_COUNT_HANDLED >= SIGNAL_ATTEMPTS_TO_ABORT) {
         error_exit("User demands abort!");
         signal(SIGINT, SIG_DFL);
     }
 }
 
+int analyzer_signal_count() {
+    return SIGNAL_COUNT;
+}
+
 static bool ends_with(const std::string& str, const std::string& ending) {
     if (str.length() >= ending.length()) {
         return (0 == str.compare (str.length() - ending.length(), ending.length(), ending));
@@ -71,12 +86,23 @@ static bool ends_with(const std::string& str, const std::string& ending) {
     }
 }
 
+// Ensemble replicas install and uninstall the handlers concurrently;
+// the defaults are only restored once the last running simulation is done.
+static mutex signal_handlers_mutex;
+static int signal_handlers_users = 0;
+
 static void signal_handlers_uninstall(AnalysisState& state) {
+   lock_guard<mutex> lock(signal_handlers_mutex);
+   if (--signal_handlers_users > 0) {
+       return;
+   }
    signal(SIGINT, SIG_DFL);
    signal(SIGUSR1 , SIG_DFL); // For custom interaction
 }
 
 static void signal_handlers_install(AnalysisState& state) {
+   lock_guard<mutex> lock(signal_handlers_mutex);
+   signal_handlers_users++;
    if (state.config.handle_ctrlc) {
        signal(SIGINT, signal_handler);
    }
@@ -109,8 +135,8 @@ struct Analyzer {
     MostPopularTweet& most_pop_tweet;
     HashTags& hashtags;
 
-    /* Mersenne-twister random number generator */
-    MTwist& rng;
+    /* Random streams, one for each subsystem */
+    RandomStreams& rng;
 
     // Times the interval between prints to the console
     Timer stdout_milestone_timer;
@@ -125,11 +151,19 @@ struct Analyzer {
     }
 
     ofstream DATA_TIME; // Output file to plot data
+    ofstream CASCADE_STATS; // The cascades of the released tweet contents, over time
 
     double& time;
 
     Timer max_sim_timer;
 
+    // For region partitions: the time of the next event, if it was drawn in an earlier window
+    double next_event_time = -1;
+
+    // For tau-leaping: the events of the current leap, and their times
+    vector<EventType> leap_events;
+    vector<double> leap_times;
+
     /***************************************************************************
      * Initialization functions
      ***************************************************************************/
@@ -146,11 +180,26 @@ struct Analyzer {
             rng(state.rng), time(state.time), add_rates(state.config.add_rates), tweet_bank(state.tweet_bank),
             most_pop_tweet(state.most_pop_tweet), hashtags(state.hashtags), output_time_checker(output_time_checker_from_config(state.config)) {
 
+        if (state.partition) {
+            // A region partition: the network, its agents and the output belong to the main state
+            state.old_tweets.open(format("%s/old_tweets_region_%d.dat", config.output_directory.c_str(), state.partition->region));
+            analyzer_rate_update(state);
+            return;
+        }
+
         // The following allocates a memory chunk proportional to max_agents:
         network.allocate(config.max_agents);
 
-        DATA_TIME.open("output/DATA_vs_TIME");
-        
+        ensure_directory(config.output_directory);
+        DATA_TIME.open((config.output_directory + "/DATA_vs_TIME").c_str());
+        if (config.main_stats) {
+            CASCADE_STATS.open(config.output_directory + "/cascade_stats.dat");
+            CASCADE_STATS << "#Retweet cascades: all the tweets of one tweet content.\n"
+                    << "#Size = number of tweets, Depth = longest retweet chain, Breadth = most tweets at one depth\n\n"
+                    << "#The cascades of the tweet contents released so far, over time\n";
+        }
+        state.old_tweets.open(config.output_directory + "/old_tweets.dat");
+
         set_initial_agents();
         analyzer_rate_update(state);
         init_referral_rate_function(config);
@@ -164,7 +213,7 @@ struct Analyzer {
     }
     void set_initial_agents() {
         for (int i = 0; i < config.initial_agents; i++) {
-             action_create_agent();
+             action_create_agent<true>();
         }
     }
 
@@ -178,7 +227,7 @@ struct Analyzer {
      * Returns end-time. */
     double main(Timer& timer) {
         if (config.enable_query_api) {
-            spawn_stdin_command_queueing_thread_for_api();
+            spawn_stdin_command_queueing_thread_for_api(state);
         }
         if (config.load_network_on_startup && file_exists(config.save_file)) {
             load_network_state(config.save_file.c_str());
@@ -186,6 +235,7 @@ struct Analyzer {
             lua_hook_new_network(state);
         }
         run_network_simulation(timer);
+        tweet_bank.release_unadded();
         if (config.most_popular_tweet_content) {
             find_most_popular_tweet();
         }
@@ -201,10 +251,11 @@ struct Analyzer {
         return (max_sim_timer.get_microseconds() < (config.max_real_time * MINUTE_TO_MICROSECOND));
     }
     void interrupt_reset() {
-        SIGNAL_ATTEMPTS = 0;
+        state.signals_handled = SIGNAL_COUNT;
+        SIGNAL_COUNT_HANDLED = SIGNAL_COUNT;
     }
     bool interrupt_check() {
-        return (SIGNAL_ATTEMPTS == 0);
+        return (state.signal_attempts() == 0);
     }
 
     vector<int> zeros(int size) {
@@ -224,17 +275,16 @@ struct Analyzer {
             Agent& a = n[i];
             if (!ids[i]) {
                 auto& region = R.regions[a.region_bin];
-                a.language = (Language) rng.kmc_select(region.language_probs);
+                a.language = (Language) region.language_sampler.pick(rng.creation);
                 ids[i] ++;
             }
             auto temp = network.follower_set(a.id).as_vector();
-            FollowerSet empty_follower_set;
-            a.follower_set = empty_follower_set;
+            a.follower_set.clear();
             for (int j = 0; j < temp.size(); j ++) {
                 Agent& f = n[temp[j]];
                 if (!ids[j]) {
                     auto& region = R.regions[f.region_bin];
-                    f.language = (Language) rng.kmc_select(region.language_probs);
+                    f.language = (Language) region.language_sampler.pick(rng.creation);
                     ids[temp[j]] ++;
                 }
                 analyzer_handle_follow(state, f.id, a.id, 0);
@@ -245,6 +295,16 @@ struct Analyzer {
     template <typename Archive>
     void load_network_state(ifstream& file) {
         Archive reader {state, file};
+        int format_version = -1;
+        try {
+            reader(NVP(format_version));
+        } catch (const cereal::Exception&) {
+            // Saved before the format was versioned
+        }
+        if (format_version != NETWORK_STATE_FORMAT_VERSION) {
+            error_exit("Error, the network state was saved in a different format than this version of hashkat reads!\n"
+                    "It has to be generated again with this version.\nExiting...");
+        }
         // Deserialize the INFILE:
         string saved_config_file = config.entire_config_file;
         reader(NVP(saved_config_file));
@@ -254,6 +314,9 @@ struct Analyzer {
         }
         // Deserialize the state:
         reader(NVP(state));
+        for (tweet_ref_t ref : tweet_bank.as_ref_vector()) {
+            tweet_bank.get(ref).content->cascade.sink = &state.cascade_stats;
+        }
 
         /* Synchronize rates from the loaded configuration.
          * This is done because, although we can load a new configuration,
@@ -262,6 +325,7 @@ struct Analyzer {
 
         lua_hook_load_network(state);
         fix_agents_upon_resubmission(state);
+        state.rebuild_follow_endpoints();
     }
 
     void load_network_state(std::string fname) {
@@ -278,6 +342,8 @@ struct Analyzer {
     void save_network_state(ofstream& file) {
         Archive writer {state, file};
         lua_hook_save_network(state);
+        int format_version = NETWORK_STATE_FORMAT_VERSION;
+        writer(NVP(format_version));
         // Serialize the INFILE:
         std::string saved_config_file;
         writer(NVP(saved_config_file));
@@ -299,7 +365,7 @@ struct Analyzer {
     // ROOT ANALYSIS ROUTINE
     /* Run the main analysis routine using this config. */
     void run_network_simulation(Timer& timer) {
-        if (config.output_stdout_summary)
+        if (config.output_stdout_summary && config.output_console)
             cout << setw(25)
             << "Simulation Time (min)" << setw(25)
             << "Agents" << setw(25)
@@ -310,6 +376,31 @@ struct Analyzer {
             << "Unfollows" << setw(25)
             << "Cumulative-Rate" << setw(25)
             << "Real Time (s)" << "\n\n";
+        // The features used by this simulation are known from here on, see analyzer_observed.h
+        state.observed = analyzer_is_observed(config, state.event_callbacks);
+        if (config.parallel_regions) {
+            analyzer_parallel_begin(state);
+        }
+        static const ObservedTable<SimulationLoop, SimulationLoopEntry> simulation_loops;
+        (this->*simulation_loops[state.observed])(timer);
+        if (config.parallel_regions) {
+            analyzer_parallel_end(state);
+        }
+        if (config.save_network_on_timeout) {
+            save_network_state(config.save_file.c_str());
+        }
+    }
+
+    typedef void (Analyzer::*SimulationLoop)(Timer& timer);
+    template <bool OBSERVED>
+    struct SimulationLoopEntry {
+        static SimulationLoop value() {
+            return &Analyzer::simulation_loop<OBSERVED>;
+        }
+    };
+
+    template <bool OBSERVED>
+    void simulation_loop(Timer& timer) {
         while (sim_time_check() && real_time_check() && !stats.user_did_exit) {
             if (!interrupt_check()) {
                 interrupt_reset();
@@ -322,16 +413,15 @@ struct Analyzer {
                     break;
                 }
             }
-        	if (!step_analysis(timer)) {
-        	    break;
-        	}
-        }
-        if (config.save_network_on_timeout) {
-            save_network_state(config.save_file.c_str());
+            bool stepped = config.parallel_regions ? step_parallel(timer) : step_analysis<OBSERVED>(timer);
+            if (!stepped) {
+                break;
+            }
         }
     }
 
     /* Create a new agent at the next index. */
+    template <bool OBSERVED>
     bool action_create_agent() {
         PERF_TIMER();
 
@@ -351,33 +441,39 @@ struct Analyzer {
         // Determine abstract location:
         auto& R = state.config.regions;
         ASSERT(R.regions.size() <= N_BIN_REGIONS, "Too many regions!");
-        int region_bin = rng.kmc_select(R.add_probs);
+        // A region partition only creates agents of its own region
+        int region_bin = state.partition ? state.partition->region : R.add_sampler.pick(rng.creation);
         auto& region = R.regions[region_bin];
 
         e.region_bin = region_bin;
-        e.ideology_bin = rng.kmc_select(region.ideology_probs);
+        e.ideology_bin = region.ideology_sampler.pick(rng.creation);
         e.creation_time = creation_time;
-        e.language = (Language) rng.kmc_select(region.language_probs);
+        e.language = (Language) region.language_sampler.pick(rng.creation);
         // For now, either always mark ideology, or never
-        e.ideology_tweet_percent = rng.random_chance(0.5) ? 1.0 : 0.0;
-        e.preference_class = rng.kmc_select(region.preference_class_probs);
-
-        double rand_num = rng.rand_real_not0();
-        for (int et = 0; et < agent_types.size(); et++) {
-            AgentType& type = agent_types[et];
-            if (rand_num <= type.prob_add) {
-                e.agent_type = et;
-                type.agent_list.push_back(id);
-                follow_ranks.categorize(id, e.follower_set.size());
-                type.follow_ranks.categorize(id, e.follower_set.size());
-                break;
-            }
-            rand_num -= agent_types[et].prob_add;
+        e.ideology_tweet_percent = rng.creation.random_chance(0.5) ? 1.0 : 0.0;
+        e.preference_class = region.preference_class_sampler.pick(rng.creation);
+
+        int et = state.agent_type_sampler.pick(rng.creation);
+        AgentType& type = agent_types[et];
+        e.agent_type = et;
+        type.agent_list.push_back(id);
+        follow_ranks.categorize(id, e.follower_set.size());
+        type.follow_ranks.categorize(id, e.follower_set.size());
+        if (config.use_barabasi && state.use_follow_endpoints()) {
+            state.follow_endpoints.add(id);
+        }
+        if (config.activity_model == LOGNORMAL_ACTIVITY) {
+            // Lognormal with a mean of 1
+            double sigma = config.activity_sigma;
+            e.activity = exp(sigma * rng.creation.rand_normal() - sigma * sigma / 2);
         }
+        analyzer_rate_add_agent(state, id);
 
-        lua_hook_add(state, id);
+        if (OBSERVED) {
+            lua_hook_add(state, id);
+        }
 
-        if (config.use_barabasi){
+        if (config.use_barabasi) {
             // follow so many times depending on setting
             for (int i = 0; i < config.barabasi_connections; i ++) {
                 analyzer_follow_agent(state, id, creation_time);
@@ -386,24 +482,26 @@ struct Analyzer {
         return true;
     }
 
-    shared_ptr<TweetContent> generate_tweet_content(int id_original_author) {
+    TweetContentRef generate_tweet_content(int id_original_author) {
         Agent& e_original_author = network[id_original_author];
         int agent = e_original_author.agent_type;
         AgentType& agent_type = agent_types[agent];
 
-        shared_ptr<TweetContent> ti(new TweetContent);
-        ti->id = stats.global_stats.n_original_tweets;
+        TweetContentRef ti = TweetContentRef::make();
+        ti->id = partition_unique_id(state, stats.global_stats.n_original_tweets);
         ti->id_original_author = id_original_author;
         ti->time_of_tweet = time;
+        ti->used_agents.set_approximate(config.approximate_retweeters);
+        ti->cascade.sink = &state.cascade_stats;
 //        ti->type = agent_type;
         ti->ideology_bin = e_original_author.ideology_bin;
-        ti->type = (TweetType)rng.kmc_select(agent_type.tweet_type_probs, N_TWEET_TYPES);
+        ti->type = (TweetType)agent_type.tweet_type_sampler.pick(rng.tweet);
         // TODO: Pick
         Language lang = e_original_author.language;
 
         // For bilingual tweeters, tweet both languages with equal probability:
         if (lang == LANG_FRENCH_AND_ENGLISH) {
-            lang = rng.random_chance(0.5) ? LANG_ENGLISH : LANG_FRENCH;
+            lang = rng.tweet.random_chance(0.5) ? LANG_ENGLISH : LANG_FRENCH;
         }
         ti->language = lang;
         RECORD_STAT(state, agent, n_original_tweets);
@@ -411,21 +509,25 @@ struct Analyzer {
     }
     
     bool include_hashtag() {
-        return rng.random_chance(config.hashtag_prob);
+        return rng.tweet.random_chance(config.hashtag_prob);
     }
 
-    Tweet generate_tweet(int id_tweeter, int id_link, int generation, const std::shared_ptr<TweetContent>& content) {
+    // The tweet is built in place in the tweet bank
+    // 'cascade_parent' is the cascade node of the retweeted tweet, -1 for original content
+    tweet_ref_t generate_tweet(int id_tweeter, int id_link, int generation, int cascade_parent, const TweetContentRef& content) {
         PERF_TIMER();
         Agent& e_tweeter = network[id_tweeter];
         Agent& e_author = network[content->id_original_author];
 
-        Tweet tweet;
-        tweet.id_tweet = stats.global_stats.n_tweets;
+        tweet_ref_t ref = tweet_bank.alloc();
+        Tweet& tweet = tweet_bank.get(ref);
+        tweet.id_tweet = partition_unique_id(state, stats.global_stats.n_tweets);
         tweet.content = content;
         tweet.creation_time = time;
         tweet.id_tweeter = id_tweeter;
         tweet.id_link = id_link;
         tweet.generation = generation;
+        tweet.cascade_node = content->cascade.append(cascade_parent, id_tweeter);
         // if this is a hashtag and not a retweet, we have to add the agent id into 
         // the circular buffer. 
         if (include_hashtag() && generation == 0) {
@@ -443,13 +545,14 @@ struct Analyzer {
 
         /* Only consider tweets that can actually be retweeted. */
         if (total_weight != 0) {
-            state.tweet_bank.add(tweet);
+            tweet_bank.add(ref);
         }
 
-        return tweet;
+        return ref;
     }
 
 	// function to handle the tweeting
+	template <bool OBSERVED>
 	bool action_tweet(int id_tweeter) {
 	    PERF_TIMER();
 
@@ -457,13 +560,15 @@ struct Analyzer {
             Agent& e = network[id_tweeter];
             tweet_ranks.categorize(id_tweeter, e.n_tweets);
             e.n_tweets++;
-            Tweet tweet = generate_tweet(id_tweeter, id_tweeter, 0, generate_tweet_content(id_tweeter));
-            analyzer_api_tweet(state, tweet);
-            lua_hook_tweet(state, id_tweeter, tweet);
+            tweet_ref_t tweet = generate_tweet(id_tweeter, id_tweeter, 0, -1, generate_tweet_content(id_tweeter));
+            if (OBSERVED) {
+                analyzer_api_tweet(state, tweet);
+                lua_hook_tweet(state, id_tweeter, tweet);
+            }
             // Generate the tweet content:
             // increase the number of tweets the agent had by one
             if (e.n_tweets / (time - e.creation_time) >= config.unfollow_tweet_rate) {
-                action_unfollow(id_tweeter);
+                action_unfollow<OBSERVED>(id_tweeter);
             }
 
             RECORD_STAT(state, e.agent_type, n_tweets);
@@ -473,7 +578,8 @@ struct Analyzer {
 
 	// Despite being called action_retweet, may result in follow
 	// depending on probability encoded in PreferenceClass, if not first-generation tweet.
-	bool action_retweet(RetweetChoice choice, double time_of_retweet) {
+	template <bool OBSERVED>
+	bool action_retweet(RetweetChoice choice, const TweetContentRef& content, double time_of_retweet) {
 	    PERF_TIMER();
 		Agent& e_observer = network[choice.id_observer];
 
@@ -485,18 +591,21 @@ struct Analyzer {
     		    // Note this is not attempted for first-generation tweets because the observer
     		    // would necessarily be in the authors follower set already.
                 double val = preferential_weight(state);
-                if (rng.random_chance(val)) {
+                if (rng.follow.random_chance(val)) {
                     // Return success of follow:
                     RECORD_STAT(state, e_observer.agent_type, n_retweet_follows);
-                    return analyzer_handle_follow(state, choice.id_observer, choice.id_author, N_FOLLOW_MODELS + 2);
+                    // Counted after the follow models, before the followbacks
+                    return analyzer_handle_follow(state, choice.id_observer, choice.id_author, N_FOLLOW_MODELS);
                 }
     		}
         }
 
-        Tweet tweet = generate_tweet(choice.id_observer, choice.id_link, choice.generation, *choice.content);
+        tweet_ref_t tweet = generate_tweet(choice.id_observer, choice.id_link, choice.generation, choice.cascade_parent, content);
 
         e_observer.n_retweets ++;
-        lua_hook_retweet(state, choice.id_observer, tweet);
+        if (OBSERVED) {
+            lua_hook_retweet(state, choice.id_observer, tweet);
+        }
         RECORD_STAT(state, e_observer.agent_type, n_retweets);
 
         return true;
@@ -504,19 +613,28 @@ struct Analyzer {
 
 	// Causes 'id_unfollowed' to lose a follower
 	// Returns true if a follower was removed, false if there was no follower to remove
+	template <bool OBSERVED>
 	bool action_unfollow(int id_unfollowed) {
 	    PERF_TIMER();
 
 		FollowerSet& candidate_followers = network.follower_set(id_unfollowed);
 
 		int id_lost_follower = -1; // The agent to unfollow us
-		if (!candidate_followers.pick_random_uniform(rng, id_lost_follower)) {
+		if (!candidate_followers.pick_random_uniform(rng.follow, id_lost_follower)) {
 		    perf_timer_end("action_unfollow");
 		    return false; // Empty
 		}
 
 		DEBUG_CHECK(id_lost_follower != -1, "Should not be -1 after choice!");
 
+		if (partition_is_remote(state, id_lost_follower)) {
+		    RemoteEvent event(RemoteEvent::UNFOLLOW);
+		    event.id_actor = id_lost_follower;
+		    event.id_target = id_unfollowed;
+		    partition_defer(state, event);
+		    return false;
+		}
+
         // Remove our target from our actor's follows:
         bool had_follower = candidate_followers.remove(network[id_lost_follower]);
 		DEBUG_CHECK(had_follower, "unfollow: Did not exist in follower list");
@@ -525,31 +643,100 @@ struct Analyzer {
 		Agent& e_lost_follower = network[id_lost_follower];
 		bool had_follow = e_lost_follower.following_set.remove(state, id_unfollowed);
 		DEBUG_CHECK(had_follow, "unfollow: Did not exist in follow list");
+		if (config.use_barabasi && state.use_follow_endpoints()) {
+		    partition_home(state, id_unfollowed).follow_endpoints.remove(id_unfollowed);
+		}
+		if (config.activity_model == FOLLOWERS_ACTIVITY) {
+		    analyzer_rate_followers_changed(partition_home(state, id_unfollowed), id_unfollowed);
+		}
 
-		lua_hook_unfollow(state, id_lost_follower, id_unfollowed);
+		if (OBSERVED) {
+		    lua_hook_unfollow(state, id_lost_follower, id_unfollowed);
+		}
 		RECORD_STAT(state, e_lost_follower.agent_type, n_unfollows);
 
 		return true;
 	}
 
-	// Helper for step_analysis.
-	// Subtracts from a 'double' variable, 'var' by 'increment', and returns the new value.
-	static double subtract_var(double& var, double increment) {
-	    var -= increment;
-	    return var;
-	}
+    /***************************************************************************
+     * Event channels, see EventRateTree.h
+     ***************************************************************************/
+
+    // Each action receives the remainder of the event selection draw,
+    // which lies within [0, rate of the event channel).
+    typedef bool (Analyzer::*EventAction)(double rand_num);
+    // Indexed by EventType
+    template <bool OBSERVED>
+    static const EventAction* event_actions() {
+        static const EventAction actions[N_EVENT_TYPES] = {
+            &Analyzer::event_add<OBSERVED>,
+            &Analyzer::event_follow<OBSERVED>,
+            &Analyzer::event_tweet<OBSERVED>,
+            &Analyzer::event_retweet<OBSERVED>
+        };
+        return actions;
+    }
+
+    // The agent creation event
+    template <bool OBSERVED>
+    bool event_add(double rand_num) {
+        return action_create_agent<OBSERVED>();
+    }
+
+    // The follow event
+    template <bool OBSERVED>
+    bool event_follow(double rand_num) {
+        int agent = analyzer_select_agent(state, FOLLOW_SELECT, rand_num);
+        if (agent == -1) {
+            return false;
+        }
+        return analyzer_follow_agent(state, agent, time);
+    }
+
+    // The tweet event
+    template <bool OBSERVED>
+    bool event_tweet(double rand_num) {
+        int agent = analyzer_select_agent(state, TWEET_SELECT, rand_num);
+        if (agent == -1) {
+            return false;
+        }
+        return action_tweet<OBSERVED>(agent);
+    }
+
+    // The retweet event
+    template <bool OBSERVED>
+    bool event_retweet(double rand_num) {
+        RetweetChoice choice = analyzer_select_tweet_to_retweet(state, RETWEET_SELECT, rand_num);
+        if (choice.id_author == -1) {
+            return false;
+        }
+        // The store does not move tweets, so this stays valid while the retweet is made
+        const TweetContentRef& content = tweet_bank.get(choice.tweet).content;
+        if (partition_is_remote(state, choice.id_observer)) {
+            // Retweeted by the observer's partition once the window ends
+            RemoteEvent event(RemoteEvent::RETWEET);
+            event.id_actor = choice.id_observer;
+            event.id_target = choice.id_author;
+            event.id_link = choice.id_link;
+            event.generation = choice.generation;
+            event.cascade_parent = choice.cascade_parent;
+            event.content = content;
+            partition_defer(state, event);
+            return false;
+        }
+        return action_retweet<OBSERVED>(choice, content, time);
+    }
 
     // Performs one step of the analysis routine.
     // Takes old time, returns new time
+    template <bool OBSERVED>
     bool step_analysis(Timer& timer) {
         PERF_TIMER();
 
         // Exit case 1:
         // We opt to inform the user of a stagnant network rather than trying continuously:
-        if (stats.event_rate == 0) {
-            cout << "WARNING: The simulator's total event rate was 0, i.e., it had nothing to do. Conceptually, this is like a network no one uses anymore.\n" << 
-                "This can be intended, for example if the agent add, follow and tweet rates all legitimately drop to 0 at some point in time.\n" <<
-                "More likely, especially if this happened quickly, this is a problem in the configuration file (eg, INFILE.yaml) and the rates there should be reviewed.\n" << endl;
+        if (stats.event_rate <= 0) {
+            warn_zero_event_rate();
             return false;
         }
 
@@ -560,7 +747,9 @@ struct Analyzer {
         }
 
         // Check for incoming api_requests, if enabled.
-        analyzer_handle_outstanding_api_request(state);
+        if (OBSERVED) {
+            analyzer_handle_outstanding_api_request(state);
+        }
 
         /*
          * Fix for Github issue #3:
@@ -576,62 +765,233 @@ struct Analyzer {
          * Retrying as we did before (ie, not moving time forward) caused some underestimation in the time of events.
          */
 
-        bool network_has_changed = false;
-
-        lua_hook_step_analysis(state);
-
-        // Get a random number within [0,1).
-        double r = rng.rand_real_not0(); // 
-        // Decide what action corresponds to our random number.
-        if (subtract_var(r, stats.prob_add) <= ZEROTOL) {
-            // The agent creation event
-            network_has_changed = action_create_agent();
-        } else if (subtract_var(r, stats.prob_follow) <= ZEROTOL) {
-            // The follow event
-            int agent = analyzer_select_agent(state, FOLLOW_SELECT);
-            if (agent != -1) {
-                network_has_changed = analyzer_follow_agent(state, agent, time);
+        if (OBSERVED) {
+            lua_hook_step_analysis(state);
+        }
+
+        double tau = config.use_tau_leaping ? leap_interval() : 0;
+        if (tau > 0) {
+            // Approximate step, performing every event of the leap at once
+            leap<OBSERVED>(tau, timer);
+        } else {
+            // A single draw selects the event channel, and then continues
+            // down into the channel to select the agent or tweet involved.
+            double rand_num = rng.events.rand_real_not1() * stats.event_rates.total_rate();
+            EventType event = stats.event_rates.pick_weighted(rand_num);
+            (this->*event_actions<OBSERVED>()[event])(rand_num);
+
+            step_time(timer);
+            stats.n_steps++;
+        }
+
+        // Update the rates. Agent creation was already accounted for in the rate ledger,
+        // so this is cheap except when a month boundary is crossed.
+        analyzer_rate_update(state);
+
+        return true;
+    }
+
+    void warn_zero_event_rate() {
+        cout << "WARNING: The simulator's total event rate was 0, i.e., it had nothing to do. Conceptually, this is like a network no one uses anymore.\n" << 
+            "This can be intended, for example if the agent add, follow and tweet rates all legitimately drop to 0 at some point in time.\n" <<
+            "More likely, especially if this happened quickly, this is a problem in the configuration file (eg, INFILE.yaml) and the rates there should be reviewed.\n" << endl;
+    }
+
+    // Performs one window of a region-partitioned simulation, see analyzer_parallel.cpp.
+    // The statistics of the main state are kept summed over the partitions.
+    bool step_parallel(Timer& timer) {
+        if (stats.event_rate <= 0) {
+            warn_zero_event_rate();
+            return false;
+        }
+        if (stats.n_steps >= config.max_analysis_steps) {
+            return false;
+        }
+        // The window ends once the next summary row may be due, so that the row is not written late
+        analyzer_parallel_window(state, next_output_row_time());
+        if (!config.output_stdout_summary) {
+            return true;
+        }
+        if (config.summary_output_rate_real_minutes) {
+            if (output_time_checker.has_past(time)) {
+                output_summary_stats(timer);
+            }
+            return true;
+        }
+        // Checked after each event that passed an output time, in time order, as in a serial run
+        for (double event_time : state.region_partitions->output_times) {
+            if (output_time_checker.has_past(event_time)) {
+                output_summary_stats(timer);
+            }
+        }
+        return true;
+    }
+
+    typedef void (Analyzer::*WindowLoop)(double window_end);
+    template <bool OBSERVED>
+    struct WindowLoopEntry {
+        static WindowLoop value() {
+            return &Analyzer::window_loop<OBSERVED>;
+        }
+    };
+
+    // Performs the events of a region partition up to 'window_end'.
+    void run_window(double window_end) {
+        static const ObservedTable<WindowLoop, WindowLoopEntry> window_loops;
+        (this->*window_loops[state.observed])(window_end);
+    }
+
+    template <bool OBSERVED>
+    void window_loop(double window_end) {
+        while (stats.event_rate > 0) {
+            if (next_event_time < 0) {
+                next_event_time = time + time_increment();
             }
-        } else if (subtract_var(r, stats.prob_tweet) <= ZEROTOL) {
-            // The tweet event
-            int agent = analyzer_select_agent(state, TWEET_SELECT);
-            if (agent != -1) {
-                network_has_changed = action_tweet(agent);
+            if (next_event_time >= window_end) {
+                if (config.use_random_time_increment) {
+                    // The rates will change at the window boundary. As KMC is memoryless,
+                    // we may simply draw again in the next window.
+                    next_event_time = -1;
+                }
+                break;
             }
-        } else if (subtract_var(r, stats.prob_retweet) <= ZEROTOL ) {
-            // The retweet event
-            RetweetChoice choice = analyzer_select_tweet_to_retweet(state, RETWEET_SELECT);
-            if (choice.id_author != -1) {
-                network_has_changed = action_retweet(choice, time);
+            time = next_event_time;
+            next_event_time = -1;
+
+            double rand_num = rng.events.rand_real_not1() * stats.event_rates.total_rate();
+            EventType event = stats.event_rates.pick_weighted(rand_num);
+            (this->*event_actions<OBSERVED>()[event])(rand_num);
+            stats.n_steps++;
+            // The main state checks the summary outputs at these times, once the window ends.
+            // (Partitions write no summary of their own, so 'output_stdout_summary' is off here.)
+            if (!config.summary_output_rate_real_minutes && output_time_checker.has_past(time)) {
+                state.partition->output_times.push_back(time);
             }
-        } else {
-            error_exit("step_analysis: event out of bounds");
+            analyzer_rate_update(state);
         }
+        time = window_end;
+    }
 
-        step_time(timer);
-        stats.n_steps++;
+    // The current rate of an event channel. Within a leap, the channel rates
+    // in stats.event_rates are frozen while the ledger and the tweet bank move on.
+    double channel_rate(EventType event) {
+        RateLedger& ledger = state.rate_ledger;
+        if (event == EVENT_FOLLOW) {
+            return ledger.follow_rate;
+        } else if (event == EVENT_TWEET) {
+            return ledger.tweet_rate;
+        } else if (event == EVENT_RETWEET) {
+            return max(0.0, analyzer_total_retweet_rate(state));
+        }
+        return config.rate_add;
+    }
 
-        //update the rates if n_agents has changed
-        analyzer_rate_update(state);
+    /* Chooses the length of a leap over which every rate changes by at most
+     * a fraction 'tau_leap_epsilon' of itself. Returns 0 if an exact step should be taken instead. */
+    double leap_interval() {
+        RateLedger& ledger = state.rate_ledger;
+        EventRateTree& event_rates = stats.event_rates;
+        double epsilon = config.tau_leap_epsilon;
+        double tau = INFINITY;
+
+        // The follow and tweet rates grow with every agent created
+        double agent_rate_growth = 0;
+        for (int i = 0; i < agent_types.size(); i++) {
+            agent_rate_growth += agent_types[i].prob_add * (ledger.per_new_follow_rate[i] + ledger.per_new_tweet_rate[i]);
+        }
+        agent_rate_growth *= config.rate_add;
+        if (agent_rate_growth > 0) {
+            tau = min(tau, epsilon * (ledger.follow_rate + ledger.tweet_rate) / agent_rate_growth);
+        }
 
-        return true;
+        // The retweet rate grows with every tweet and retweet, and decays as the tweets are rebinned
+        double tweet_flux = event_rates.rate(EVENT_TWEET) + event_rates.rate(EVENT_RETWEET);
+        if (tweet_flux > 0) {
+            tau = min(tau, max(epsilon * tweet_bank.n_active_tweets(), 1.0) / tweet_flux);
+        }
+        if (event_rates.rate(EVENT_RETWEET) > 0) {
+            tau = min(tau, RETWEET_REBIN_MAX_LEAP);
+        }
+
+        // Every rate is recomputed at month boundaries
+        tau = min(tau, (state.n_months() + 1) * APPROX_MONTH - time);
+        tau = min(tau, config.max_sim_time - time);
+
+        if (tau * stats.event_rate < TAU_LEAP_MIN_EVENTS) {
+            return 0;
+        }
+        return tau;
     }
 
-    /* Step our KMC simulation proportionally to the global event rate. */
-    void step_time(Timer& timer) {
+    /* Performs the events of a leap of length 'tau'. The number of events of each channel is
+     * Poisson-distributed. The agent or tweet of each event is then selected within the channel,
+     * which is the same as drawing independent Poisson counts per agent type and monthly cohort. */
+    template <bool OBSERVED>
+    void leap(double tau, Timer& timer) {
+        PERF_TIMER();
+        leap_events.clear();
+        for (int i = 0; i < N_EVENT_TYPES; i++) {
+            EventType event = (EventType) i;
+            int n_events = rng.events.rand_poisson(stats.event_rates.rate(event) * tau);
+            leap_events.insert(leap_events.end(), n_events, event);
+        }
+
+        // Interleave the channels, each event happening at a uniformly distributed time within the leap
+        for (int i = (int) leap_events.size() - 1; i > 0; i--) {
+            swap(leap_events[i], leap_events[rng.events.rand_int(i + 1)]);
+        }
+        double leap_end = time + tau;
+        leap_times.resize(leap_events.size());
+        for (double& event_time : leap_times) {
+            event_time = time + tau * rng.events.rand_real_not1();
+        }
+        sort(leap_times.begin(), leap_times.end());
+
+        for (int i = 0; i < leap_events.size(); i++) {
+            if (stats.n_steps >= config.max_analysis_steps) {
+                // The clock stays at the last event performed
+                return;
+            }
+            time = leap_times[i];
+            double rand_num = rng.events.rand_real_not1() * channel_rate(leap_events[i]);
+            (this->*event_actions<OBSERVED>()[leap_events[i]])(rand_num);
+            stats.n_steps++;
+            // The summary outputs are checked after every event, as with exact steps
+            if (config.output_stdout_summary && output_time_checker.has_past(time)) {
+                output_summary_stats(timer);
+            }
+        }
+        time = leap_end;
+    }
+
+    double time_increment() {
         if (config.use_random_time_increment) {
             // increment by random time
-            double increment = -log(rng.rand_real_not0()) / stats.event_rate;
-            time += increment;
+            return -log(rng.time.rand_real_not0()) / stats.event_rate;
         } else {
-            time += 1.0 / stats.event_rate;
+            return 1.0 / stats.event_rate;
         }
+    }
+
+    /* Step our KMC simulation proportionally to the global event rate. */
+    void step_time(Timer& timer) {
+        time += time_increment();
 
         if (config.output_stdout_summary && output_time_checker.has_past(time)) {
             output_summary_stats(timer);
         } 
     }
 
+    /* The earliest simulated time by which the next DATA_vs_TIME row may be due: a row is written
+     * on every STDOUT_OUTPUT_RATE-th output, and at most one output is counted per output period. */
+    double next_output_row_time() {
+        if (!config.output_stdout_summary) {
+            return INFINITY;
+        }
+        int n_skipped = (STDOUT_OUTPUT_RATE - stats.n_outputs % STDOUT_OUTPUT_RATE) % STDOUT_OUTPUT_RATE;
+        return output_time_checker.time_to_pass(time, n_skipped + 1);
+    }
+
     /***************************************************************************
      * Helper functions
      ***************************************************************************/
@@ -641,33 +1001,26 @@ struct Analyzer {
         return fs.contains(followee);
     }
     
-    bool is_path(Tweet& tweet, vector<Tweet>& atl) {
-        int gen = tweet.generation;
-        vector<Tweet> tweet_list;
-        for (auto& t : atl) {
-            if (t.content == tweet.content && t.id_tweeter != tweet.id_tweeter && t.generation == gen - 1) {
-                tweet_list.push_back(t);
-            }
-        }
-        // check and see if we are connected to the previous generation
-        for (auto& t : tweet_list) {
-            if (is_following(tweet.id_tweeter, t.id_tweeter)) {
-                return true;
-            }
+    // Whether a retweet follows the tweeter it retweeted, from its cascade
+    bool is_path(Tweet& tweet) {
+        const TweetCascade& cascade = tweet.content->cascade;
+        const TweetCascade::Node& node = cascade.node(tweet.cascade_node);
+        if (node.parent == -1) {
+            return false;
         }
-        return false;
+        int id_parent = cascade.node(node.parent).id_tweeter;
+        return node.depth == tweet.generation && is_following(tweet.id_tweeter, id_parent);
     }
     
     bool retweet_checks() {
-        // atl --- active tweet list
-        vector<Tweet> atl = tweet_bank.as_vector();
-        for (auto& tweet : atl) {
+        for (tweet_ref_t ref : tweet_bank.as_ref_vector()) {
+            Tweet& tweet = tweet_bank.get(ref);
             // if it is a retweet
-            if (tweet.creation_time != tweet.content->time_of_tweet) {
-                if (is_path(tweet, atl)) {
+            if (tweet.generation > 0) {
+                if (is_path(tweet)) {
                     return true;
                 } 
-            } else if (tweet.creation_time == tweet.content->time_of_tweet) {
+            } else {
                 return true;
             }
         }
@@ -695,13 +1048,39 @@ struct Analyzer {
     void output_tweets() {
         vector<Tweet> atl = tweet_bank.as_vector();
         ofstream output;
-        output.open("output/tweets.dat");
+        output.open((config.output_directory + "/tweets.dat").c_str());
         output << "\nID\t\torigID\t\ttime\t\torigtime\n\n";
         for (auto& t : atl) {
             output << t.id_tweeter << "\t\t" << t.content->id_original_author << "\t\t" << t.creation_time << "\t\t" << t.content->time_of_tweet << "\n";
         }
     }
 
+    int n_active_tweets() {
+        if (state.region_partitions) {
+            return analyzer_parallel_active_tweets(state);
+        }
+        return tweet_bank.n_active_tweets();
+    }
+
+    CascadeStats released_cascades() {
+        if (state.region_partitions) {
+            return analyzer_parallel_cascade_stats(state);
+        }
+        return state.cascade_stats;
+    }
+
+    void output_cascade_stats() {
+        CascadeStats cascades = released_cascades();
+        CASCADE_STATS << scientific << setprecision(8) << setw(25)
+        << time << setw(25)
+        << cascades.n_cascades << setw(25)
+        << (cascades.n_cascades == 0 ? 0.0 : cascades.total_size / (double) cascades.n_cascades) << setw(25)
+        << cascades.max_size << setw(25)
+        << cascades.max_depth << setw(25)
+        << cascades.max_breadth << "\n";
+        flush(CASCADE_STATS);
+    }
+
     void output_summary_stats(ostream& stream, bool newline, Timer& timer) {
         if (newline) {
             stream << scientific << setprecision(8) << setw(25)
@@ -709,7 +1088,7 @@ struct Analyzer {
             << network.size() << setw(25)
             << stats.global_stats.n_follows << setw(25)
             << stats.global_stats.n_tweets << setw(25)
-            << state.tweet_bank.n_active_tweets() << setw(25)
+            << n_active_tweets() << setw(25)
             << stats.global_stats.n_retweets << setw(25)
             << stats.global_stats.n_unfollows << setw(25)
             << stats.event_rate << setw(25)
@@ -721,7 +1100,7 @@ struct Analyzer {
             << (double) network.size() << setw(25)
             << (double) stats.global_stats.n_follows << setw(25)
             << (double) stats.global_stats.n_tweets << setw(25)
-            << (double) state.tweet_bank.n_active_tweets() << setw(25)
+            << (double) n_active_tweets() << setw(25)
             << (double) stats.global_stats.n_retweets << setw(25)
             << (double) stats.global_stats.n_unfollows << setw(25)
             << stats.event_rate << setw(25)
@@ -742,11 +1121,25 @@ struct Analyzer {
             << "Unfollows" << setw(25)
             << "Cumulative-Rate" << setw(25)
             << "Real Time (s)" << "\n";
+            if (CASCADE_STATS.is_open()) {
+                CASCADE_STATS << "#" << setw(25)
+                << "Simulation Time (min)" << setw(25)
+                << "Cascades" << setw(25)
+                << "Average Size" << setw(25)
+                << "Max Size" << setw(25)
+                << "Max Depth" << setw(25)
+                << "Max Breadth" << "\n";
+            }
         }
 
         if (stats.n_outputs % STDOUT_OUTPUT_RATE == 0) {
             output_summary_stats(DATA_TIME, true, timer);
-            output_summary_stats(cout, false, timer);
+            if (CASCADE_STATS.is_open()) {
+                output_cascade_stats();
+            }
+            if (config.output_console) {
+                output_summary_stats(cout, false, timer);
+            }
         }
 
         stats.n_outputs++;
@@ -755,7 +1148,21 @@ struct Analyzer {
 
 bool analyzer_create_agent(AnalysisState& state) {
     ASSERT(state.analyzer.get(), "Analysis is not active!");
-    return state.analyzer->action_create_agent();
+    return state.analyzer->action_create_agent<true>();
+}
+
+void analyzer_partition_init(AnalysisState& state) {
+    state.analyzer.reset(new Analyzer(state));
+}
+
+void analyzer_partition_run_window(AnalysisState& state, double window_end) {
+    ASSERT(state.analyzer.get(), "Analysis is not active!");
+    state.analyzer->run_window(window_end);
+}
+
+bool analyzer_retweet(AnalysisState& state, RetweetChoice choice, const TweetContentRef& content) {
+    ASSERT(state.analyzer.get(), "Analysis is not active!");
+    return state.analyzer->action_retweet<true>(choice, content, state.time);
 }
 
 bool analyzer_sim_time_check(AnalysisState& state) {
@@ -793,9 +1200,13 @@ void analyzer_main(AnalysisState& state) {
     // >> The main analysis function:
     state.analyzer->main(timer);
 
-    signal_handlers_uninstall(state);
+    if (state.config.handle_ctrlc) {
+        signal_handlers_uninstall(state);
+    }
     lua_hook_exit(state);
 
     // Print summary time:
-    printf("'analyzer_main' took %.2f milliseconds.\n", timer.get_microseconds() / 1000.0);
+    if (state.config.output_console) {
+        printf("'analyzer_main' took %.2f milliseconds.\n", timer.get_microseconds() / 1000.0);
+    }
 }
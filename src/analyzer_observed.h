@@ -0,0 +1,71 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#ifndef ANALYZER_OBSERVED_H_
+#define ANALYZER_OBSERVED_H_
+
+#include "capi.h"
+#include "config_dynamic.h"
+
+/* Observed simulations:
+ *
+ * Whether the event code must check the Lua hooks, the event callbacks and the query API
+ * (which locks the API queue) on every event. The event loop (analyzer_main.cpp) and the
+ * follow code (analyzer_follow.cpp) are templated on this one flag, 'OBSERVED'. It is chosen
+ * once, when the simulation starts (see analyzer_is_observed), so that the usual configuration
+ * runs without these checks.
+ *
+ * The configuration flags (follow model, use_barabasi, ...) are read from the configuration
+ * as usual; each is a well-predicted branch per event. */
+
+inline bool has_event_callbacks(const EventCallbacks& callbacks) {
+    return callbacks.on_add || callbacks.on_follow || callbacks.on_unfollow || callbacks.on_tweet
+            || callbacks.on_retweet || callbacks.on_exit || callbacks.on_step_analysis
+            || callbacks.on_load_network || callbacks.on_save_network;
+}
+
+// Whether a simulation about to start may be observed or changed from outside the event loop
+// (Lua hooks, interactive mode, the query API, event callbacks)
+inline bool analyzer_is_observed(const ParsedConfig& config, const EventCallbacks& callbacks) {
+    return config.enable_lua_hooks || config.enable_interactive_mode || config.enable_query_api
+            || has_event_callbacks(callbacks);
+}
+
+/* ObservedTable:
+ Holds 'Entry<OBSERVED>::value()' for both values of the flag, indexed by it.
+ Code compiled for either is entered through the table, with a single indirect call. */
+template <typename T, template <bool> class Entry>
+struct ObservedTable {
+    ObservedTable() {
+        entries[false] = Entry<false>::value();
+        entries[true] = Entry<true>::value();
+    }
+    const T& operator[](bool observed) const {
+        return entries[observed];
+    }
+private:
+    T entries[2];
+};
+
+#endif
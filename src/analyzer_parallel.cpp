@@ -0,0 +1,624 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#include <vector>
+#include <map>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <cmath>
+
+#include "analyzer.h"
+#include "analyzer_parallel.h"
+#include "io.h"
+
+using namespace std;
+
+/***************************************************************************
+ * Hooks for the event code of a partition
+ ***************************************************************************/
+
+RegionPartitions::~RegionPartitions() {
+    stop_workers();
+}
+
+AnalysisState& RegionPartitions::home(int id_agent) {
+    Network& network = regions[0]->state->network;
+    return *regions[network[id_agent].region_bin]->state;
+}
+
+void RegionPartitions::start_workers() {
+    for (int region = 1; region < regions.size(); region++) {
+        workers.emplace_back(&RegionPartitions::worker_loop, this, region);
+    }
+}
+
+void RegionPartitions::run_workers(double end) {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        window_end = end;
+        n_running = workers.size();
+        n_windows++;
+    }
+    window_started.notify_all();
+    // The first region runs on this thread
+    analyzer_partition_run_window(*regions[0]->state, end);
+    unique_lock<std::mutex> lock(mutex);
+    window_finished.wait(lock, [this]() {
+        return n_running == 0;
+    });
+}
+
+void RegionPartitions::stop_workers() {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    window_started.notify_all();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+    stopping = false;
+}
+
+void RegionPartitions::worker_loop(int region) {
+    int n_windows_run = 0;
+    unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        window_started.wait(lock, [&]() {
+            return stopping || n_windows > n_windows_run;
+        });
+        if (stopping) {
+            break;
+        }
+        n_windows_run = n_windows;
+        double end = window_end;
+        lock.unlock();
+        analyzer_partition_run_window(*regions[region]->state, end);
+        lock.lock();
+        if (--n_running == 0) {
+            window_finished.notify_one();
+        }
+    }
+}
+
+bool partition_in_window(AnalysisState& state) {
+    return state.partition != NULL && state.partition->partitions.in_window;
+}
+
+bool partition_is_remote(AnalysisState& state, int id_agent) {
+    return partition_in_window(state) && state.network[id_agent].region_bin != state.partition->region;
+}
+
+AnalysisState& partition_home(AnalysisState& state, int id_agent) {
+    if (state.partition == NULL) {
+        return state;
+    }
+    return state.partition->partitions.home(id_agent);
+}
+
+AnalysisState& partition_of_region(AnalysisState& state, int region) {
+    if (state.partition == NULL) {
+        return state;
+    }
+    return *state.partition->partitions.regions[region]->state;
+}
+
+int partition_pick_follow_region(AnalysisState& state) {
+    return state.rng.follow.kmc_select(state.partition->partitions.region_weights);
+}
+
+void partition_defer(AnalysisState& state, const RemoteEvent& event) {
+    DEBUG_CHECK(partition_in_window(state), "Events are only deferred within a window!");
+    state.partition->outbox.push_back(event);
+}
+
+int64 partition_unique_id(AnalysisState& state, int64 local_count) {
+    if (state.partition == NULL) {
+        return local_count;
+    }
+    RegionPartitions& P = state.partition->partitions;
+    // Above any id handed out before the partitions were created
+    return P.base_global_stats.n_tweets + local_count * P.regions.size() + state.partition->region;
+}
+
+/***************************************************************************
+ * The coordinator
+ ***************************************************************************/
+
+struct AnalyzerParallel {
+    //** Note: Only use reference types here! State will not persist.
+    AnalysisState& state;
+    ParsedConfig& config;
+    Network& network;
+    AgentTypeVector& agent_types;
+    RegionPartitions& P;
+    RandomStreams& rng;
+    // There are multiple 'Analyzer's, they each operate on parts of AnalysisState.
+    AnalyzerParallel(AnalysisState& state) :
+            state(state), config(state.config), network(state.network),
+            agent_types(state.agent_types), P(*state.region_partitions), rng(state.rng) {
+    }
+
+    AnalysisState& region_state(int region) {
+        return *P.regions[region]->state;
+    }
+
+    // Give 'id_agent' the same category in 'to' as it has in 'from'
+    static void copy_category(CategoryGrouper& from, CategoryGrouper& to, int id_agent) {
+        if (id_agent >= from.categorizations.size() || from.categorizations[id_agent].category == -1) {
+            return;
+        }
+        if (to.categorizations.size() <= id_agent) {
+            to.categorizations.resize(id_agent + 1);
+        }
+        to.categorizations[id_agent] = to.add(id_agent, from.categorizations[id_agent].category);
+    }
+
+    /* Split the agents of the main state by region. */
+    void create_partitions() {
+        P.base_global_stats = state.stats.global_stats;
+        for (AgentType& et : agent_types) {
+            P.base_type_stats.push_back(et.stats);
+        }
+        P.base_steps = state.stats.n_steps;
+
+        ParsedConfig partition_config = config;
+        // The console, the output files and the saved network belong to the main state
+        partition_config.output_stdout_basic = false;
+        partition_config.output_stdout_summary = false;
+        partition_config.output_console = false;
+        partition_config.degree_distributions = false;
+        partition_config.region_connection_matrix = false;
+        partition_config.save_network_on_timeout = false;
+
+        for (int region = 0; region < config.regions.regions.size(); region++) {
+            RegionPartition* partition = new RegionPartition(P, region);
+            P.regions.emplace_back(partition);
+            partition->state.reset(new AnalysisState(partition_config, rng.seed, network, region + 1));
+            AnalysisState& S = *partition->state;
+            S.partition = partition;
+            S.observed = state.observed;
+            S.time = state.time;
+            S.hashtags = state.hashtags;
+            S.tweet_ranks = state.tweet_ranks;
+            S.follow_ranks = state.follow_ranks;
+            S.retweet_ranks = state.retweet_ranks;
+            S.tweet_ranks.clear_agents();
+            S.follow_ranks.clear_agents();
+            S.retweet_ranks.clear_agents();
+            for (int type = 0; type < agent_types.size(); type++) {
+                split_agent_type(S, type);
+            }
+        }
+        // Only now that every partition exists, as a partition's rates
+        // may be computed before its first window
+        for (auto& partition : P.regions) {
+            analyzer_partition_init(*partition->state);
+        }
+    }
+
+    void split_agent_type(AnalysisState& S, int type) {
+        int region = S.partition->region;
+        AgentType& et = agent_types[type];
+        AgentType& pt = S.agent_types[type];
+        pt.follow_ranks = et.follow_ranks;
+        pt.follow_ranks.clear_agents();
+        // At time 0, the partition starts its own first month
+        bool copy_months = (state.time != 0);
+        if (copy_months) {
+            pt.age_ranks = et.age_ranks;
+            pt.age_ranks.clear_agents();
+        }
+
+        // agent_cap holds the size of agent_list at the start of every month
+        int month = 0;
+        for (int i = 0; i < et.agent_list.size(); i++) {
+            for (; copy_months && month < et.agent_cap.size() && et.agent_cap[month] == i; month++) {
+                pt.agent_cap.push_back(pt.agent_list.size());
+            }
+            int id = et.agent_list[i];
+            if (network[id].region_bin != region) {
+                continue;
+            }
+            pt.agent_list.push_back(id);
+            if (S.use_follow_endpoints()) {
+                S.add_follow_endpoints(id);
+            }
+            copy_category(et.follow_ranks, pt.follow_ranks, id);
+            copy_category(state.tweet_ranks, S.tweet_ranks, id);
+            copy_category(state.follow_ranks, S.follow_ranks, id);
+            copy_category(state.retweet_ranks, S.retweet_ranks, id);
+            if (copy_months) {
+                copy_category(et.age_ranks, pt.age_ranks, id);
+            }
+        }
+        for (; copy_months && month < et.agent_cap.size(); month++) {
+            pt.agent_cap.push_back(pt.agent_list.size());
+        }
+    }
+
+    /* One window of all partitions. */
+    void run_window(double window_limit) {
+        double window_start = state.time;
+        double window_end = min(min(window_start + config.parallel_window, config.max_sim_time), window_limit);
+        int month = state.n_months();
+
+        // Followed agents are sought in each region in proportion to its size
+        P.region_weights.assign(P.regions.size(), 0.0);
+        double n_agents = 0;
+        for (int region = 0; region < P.regions.size(); region++) {
+            for (AgentType& pt : region_state(region).agent_types) {
+                P.region_weights[region] += pt.agent_list.size();
+            }
+            n_agents += P.region_weights[region];
+        }
+        for (double& weight : P.region_weights) {
+            weight = (n_agents > 0 ? weight / n_agents : 1.0 / P.regions.size());
+        }
+
+        P.in_window = true;
+        P.run_workers(window_end);
+        P.in_window = false;
+        state.time = window_end;
+
+        // Serially, in partition order:
+        P.output_times.clear();
+        for (auto& partition : P.regions) {
+            for (RemoteEvent& event : partition->outbox) {
+                apply_remote_event(*partition, event);
+            }
+            partition->outbox.clear();
+            P.output_times.insert(P.output_times.end(), partition->output_times.begin(), partition->output_times.end());
+            partition->output_times.clear();
+        }
+        sync_shared_contents();
+        create_agents(window_start, window_end);
+        sort(P.output_times.begin(), P.output_times.end());
+        for (auto& partition : P.regions) {
+            analyzer_rate_update(*partition->state);
+        }
+        sync_hashtags();
+        sync_stats();
+
+        if (state.n_months() != month && config.degree_distributions) {
+            degree_distributions(network, state);
+            if (config.region_connection_matrix) {
+                region_stats(network, state);
+            }
+        }
+    }
+
+    // 'from' is the partition that deferred the event
+    void apply_remote_event(RegionPartition& from, RemoteEvent& event) {
+        if (event.kind == RemoteEvent::FOLLOW_IN_REGION) {
+            analyzer_follow_agent(region_state(event.region), event.id_actor, event.time, false);
+        } else if (event.kind == RemoteEvent::FOLLOW) {
+            analyzer_complete_follow(P.home(event.id_actor), event.id_actor, event.id_target, event.follow_method);
+        } else if (event.kind == RemoteEvent::HANDLE_FOLLOW) {
+            analyzer_handle_follow(P.home(event.id_actor), event.id_actor, event.id_target, event.follow_method);
+        } else if (event.kind == RemoteEvent::RETWEET) {
+            remote_retweet(from, event);
+        } else if (event.kind == RemoteEvent::UNFOLLOW) {
+            // The follow may have been removed in the meantime
+            if (network.following_set(event.id_actor).contains(event.id_target)) {
+                analyzer_handle_unfollow(P.home(event.id_actor), event.id_actor, event.id_target);
+            }
+        }
+    }
+
+    /* The used agents and cascade of a content are only ever touched by one partition.
+     * A retweet in another region is made in that region's copy of the content,
+     * which is kept, and used for every later retweet there. */
+    void remote_retweet(RegionPartition& from, RemoteEvent& event) {
+        RegionPartition& to = *P.regions[network[event.id_actor].region_bin];
+        const TweetContentRef& source = event.content;
+        if (from.shared_contents.emplace(source->id, source).second) {
+            // Counted once joined with its copies
+            source->cascade.sink = NULL;
+        }
+        TweetContentRef& content = to.shared_contents[source->id];
+        if (!content) {
+            content = copy_shared_content(*source);
+        }
+        // The agent may have retweeted it within its region already
+        if (!content->used_agents.insert(event.id_actor)) {
+            return;
+        }
+        int depth = source->cascade.node(event.cascade_parent).depth;
+        int parent = content->cascade.remote_parent(from.region, event.cascade_parent, depth);
+        RetweetChoice choice(event.id_target, event.id_actor, event.id_link, event.generation, parent, NO_TWEET);
+        analyzer_retweet(*to.state, choice, content);
+    }
+
+    // A copy of 'content' with no retweeters and no tweets yet
+    static TweetContentRef copy_shared_content(const TweetContent& content) {
+        TweetContentRef copy = TweetContentRef::make();
+        copy->id = content.id;
+        copy->type = content.type;
+        copy->time_of_tweet = content.time_of_tweet;
+        copy->language = content.language;
+        copy->ideology_bin = content.ideology_bin;
+        copy->hashtag_bin = content.hashtag_bin;
+        copy->id_original_author = content.id_original_author;
+        copy->used_agents.set_approximate(content.used_agents.is_approximate());
+        return copy;
+    }
+
+    // The copies of each shared content, by content id, then by region (NULL where there is none)
+    map<int, vector<TweetContent*>> shared_content_copies() {
+        map<int, vector<TweetContent*>> copies;
+        for (auto& partition : P.regions) {
+            for (auto& shared : partition->shared_contents) {
+                vector<TweetContent*>& content_copies = copies[shared.first];
+                content_copies.resize(P.regions.size(), NULL);
+                content_copies[partition->region] = shared.second.get();
+            }
+        }
+        return copies;
+    }
+
+    static TweetCascade join_cascades(const vector<TweetContent*>& copies, vector<int>& offsets) {
+        vector<const TweetCascade*> cascades;
+        for (TweetContent* copy : copies) {
+            cascades.push_back(copy != NULL ? &copy->cascade : NULL);
+        }
+        return TweetCascade::join(cascades, offsets);
+    }
+
+    /* Once no tweet refers to any copy of a shared content, their cascades are joined and counted,
+     * and the copies dropped. Otherwise, each copy learns how many retweeters the others hold. */
+    void sync_shared_contents() {
+        for (auto& shared : shared_content_copies()) {
+            vector<TweetContent*>& copies = shared.second;
+            bool referred = false;
+            int n_retweeters = 0;
+            for (TweetContent* copy : copies) {
+                if (copy != NULL) {
+                    // The partition's own reference aside
+                    referred |= (copy->n_refs > 1);
+                    n_retweeters += copy->used_agents.size();
+                }
+            }
+            if (referred) {
+                for (TweetContent* copy : copies) {
+                    if (copy != NULL) {
+                        copy->n_remote_retweeters = n_retweeters - copy->used_agents.size();
+                    }
+                }
+                continue;
+            }
+            vector<int> offsets;
+            TweetCascade cascade = join_cascades(copies, offsets);
+            bool counted = false;
+            for (auto& partition : P.regions) {
+                if (copies[partition->region] == NULL) {
+                    continue;
+                }
+                if (!counted) {
+                    partition->state->cascade_stats.add(cascade);
+                    counted = true;
+                }
+                partition->shared_contents.erase(shared.first);
+            }
+        }
+    }
+
+    double add_time_increment() {
+        if (config.use_random_time_increment) {
+            return -log(rng.time.rand_real_not0()) / config.rate_add;
+        }
+        return 1.0 / config.rate_add;
+    }
+
+    /* The agents created within the window, in the region given by add_probs. */
+    void create_agents(double window_start, double window_end) {
+        config.rate_add = config.add_rates.RF.monthly_rates[state.n_months()];
+        if (config.rate_add <= 0) {
+            P.next_add_time = -1;
+            return;
+        }
+        if (P.next_add_time < 0) {
+            P.next_add_time = window_start + add_time_increment();
+        }
+        while (P.next_add_time < window_end) {
+            AnalysisState& S = region_state(config.regions.add_sampler.pick(rng.creation));
+            S.time = P.next_add_time;
+            analyzer_create_agent(S);
+            S.time = window_end;
+            P.output_times.push_back(P.next_add_time);
+            P.next_add_time += add_time_increment();
+        }
+    }
+
+    /* Every partition sees the hashtags of the other regions as of the last window boundary.
+     * The agents found through them are followed at the end of the window. */
+    void sync_hashtags() {
+        for (auto& from : P.regions) {
+            for (auto& to : P.regions) {
+                if (from == to) {
+                    continue;
+                }
+                for (int ideology = 0; ideology < N_BIN_IDEOLOGIES; ideology++) {
+                    to->state->hashtags.hashtag_groups[ideology][from->region] = from->state->hashtags.hashtag_groups[ideology][from->region];
+                }
+            }
+        }
+    }
+
+    /* The main state's statistics are the sum over the partitions. */
+    void sync_stats() {
+        NetworkStats& stats = state.stats;
+        stats.global_stats = P.base_global_stats;
+        stats.n_steps = P.base_steps;
+        stats.event_rate = config.rate_add;
+        for (auto& partition : P.regions) {
+            NetworkStats& partition_stats = partition->state->stats;
+            stats.global_stats.add(partition_stats.global_stats);
+            stats.n_steps += partition_stats.n_steps;
+            stats.event_rate += partition_stats.event_rate;
+        }
+    }
+
+    /* Merge the partitions back into the main state. */
+    void merge_partitions() {
+        sync_stats();
+        for (int type = 0; type < agent_types.size(); type++) {
+            AgentType& et = agent_types[type];
+            et.agent_list.clear();
+            et.agent_cap.clear();
+            et.new_agents = 0;
+            et.stats = P.base_type_stats[type];
+            et.age_ranks = region_state(0).agent_types[type].age_ranks;
+            et.age_ranks.clear_agents();
+            et.follow_ranks.clear_agents();
+            for (auto& partition : P.regions) {
+                AgentType& pt = partition->state->agent_types[type];
+                et.agent_list.insert(et.agent_list.end(), pt.agent_list.begin(), pt.agent_list.end());
+                if (et.agent_cap.size() < pt.agent_cap.size()) {
+                    et.agent_cap.resize(pt.agent_cap.size(), 0);
+                }
+                for (int month = 0; month < pt.agent_cap.size(); month++) {
+                    et.agent_cap[month] += pt.agent_cap[month];
+                }
+                et.new_agents += pt.new_agents;
+                et.stats.add(pt.stats);
+            }
+            sort(et.agent_list.begin(), et.agent_list.end());
+        }
+        state.rebuild_follow_endpoints();
+
+        state.tweet_ranks.clear_agents();
+        state.follow_ranks.clear_agents();
+        state.retweet_ranks.clear_agents();
+        for (int id = 0; id < network.size(); id++) {
+            AnalysisState& S = P.home(id);
+            AgentType& et = agent_types[network[id].agent_type];
+            AgentType& pt = S.agent_types[network[id].agent_type];
+            copy_category(S.tweet_ranks, state.tweet_ranks, id);
+            copy_category(S.follow_ranks, state.follow_ranks, id);
+            copy_category(S.retweet_ranks, state.retweet_ranks, id);
+            copy_category(pt.follow_ranks, et.follow_ranks, id);
+            copy_category(pt.age_ranks, et.age_ranks, id);
+        }
+
+        // The copies of each shared content are joined into the first, to which the
+        // tweets of the others then refer, their cascade nodes following its own
+        map<TweetContent*, pair<TweetContentRef, int>> joined_copies;
+        for (auto& shared : shared_content_copies()) {
+            vector<TweetContent*>& copies = shared.second;
+            vector<int> offsets;
+            TweetCascade cascade = join_cascades(copies, offsets);
+            TweetContentRef joined;
+            for (auto& partition : P.regions) {
+                TweetContent* copy = copies[partition->region];
+                if (copy == NULL) {
+                    continue;
+                }
+                if (!joined) {
+                    joined = partition->shared_contents[shared.first];
+                } else {
+                    joined->used_agents.merge(copy->used_agents);
+                }
+                joined_copies[copy] = {joined, offsets[partition->region]};
+            }
+            joined->cascade = cascade;
+            joined->cascade.sink = &state.cascade_stats;
+            joined->n_remote_retweeters = 0;
+        }
+
+        vector<Tweet> active_tweets;
+        vector<TweetLog*> old_tweet_logs;
+        for (auto& partition : P.regions) {
+            AnalysisState& S = *partition->state;
+            S.tweet_bank.release_unadded();
+            state.cascade_stats.add(S.cascade_stats);
+            old_tweet_logs.push_back(&S.old_tweets);
+            vector<Tweet> tweets = S.tweet_bank.as_vector();
+            for (Tweet& tweet : tweets) {
+                auto joined = joined_copies.find(tweet.content.get());
+                if (joined != joined_copies.end()) {
+                    tweet.content = joined->second.first;
+                    tweet.cascade_node += joined->second.second;
+                }
+            }
+            active_tweets.insert(active_tweets.end(), tweets.begin(), tweets.end());
+            for (int ideology = 0; ideology < N_BIN_IDEOLOGIES; ideology++) {
+                state.hashtags.hashtag_groups[ideology][partition->region] = S.hashtags.hashtag_groups[ideology][partition->region];
+            }
+        }
+        state.old_tweets.merge(old_tweet_logs);
+        for (TweetLog* log : old_tweet_logs) {
+            log->discard();
+        }
+        stable_sort(active_tweets.begin(), active_tweets.end(), [](const Tweet& a, const Tweet& b) {
+            return a.creation_time < b.creation_time;
+        });
+        for (Tweet& tweet : active_tweets) {
+            tweet.content->cascade.sink = &state.cascade_stats;
+            state.tweet_bank.add(tweet);
+        }
+    }
+};
+
+void analyzer_parallel_begin(AnalysisState& state) {
+    state.region_partitions.reset(new RegionPartitions);
+    AnalyzerParallel analyzer(state);
+    analyzer.create_partitions();
+    analyzer.sync_stats();
+    state.region_partitions->start_workers();
+}
+
+void analyzer_parallel_window(AnalysisState& state, double window_limit) {
+    AnalyzerParallel analyzer(state);
+    analyzer.run_window(window_limit);
+}
+
+void analyzer_parallel_end(AnalysisState& state) {
+    state.region_partitions->stop_workers();
+    {
+        AnalyzerParallel analyzer(state);
+        analyzer.merge_partitions();
+    }
+    state.region_partitions.reset();
+    state.rate_ledger.invalidate();
+    analyzer_rate_update(state);
+}
+
+int analyzer_parallel_active_tweets(AnalysisState& state) {
+    int n_active_tweets = 0;
+    for (auto& partition : state.region_partitions->regions) {
+        n_active_tweets += partition->state->tweet_bank.n_active_tweets();
+    }
+    return n_active_tweets;
+}
+
+CascadeStats analyzer_parallel_cascade_stats(AnalysisState& state) {
+    CascadeStats stats = state.cascade_stats;
+    for (auto& partition : state.region_partitions->regions) {
+        stats.add(partition->state->cascade_stats);
+    }
+    return stats;
+}
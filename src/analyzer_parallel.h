@@ -0,0 +1,168 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#ifndef ANALYZER_PARALLEL_H_
+#define ANALYZER_PARALLEL_H_
+
+#include <cmath>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "analyzer.h"
+
+/* Region-partitioned simulation (analysis.parallel_regions):
+ *
+ * Every region is simulated by its own AnalysisState, with its own agent lists,
+ * categories, tweet bank, rate tree and random number stream. The partitions
+ * share the Network, and run concurrently over conservative time windows of
+ * analysis.parallel_window simulated minutes.
+ *
+ * Within a window, a partition only ever mutates its own region's agents.
+ * Whatever touches an agent of another region (a follow, a retweet, an unfollow)
+ * is queued as a RemoteEvent, and applied serially at the window boundary,
+ * in partition order. Agents are also created at the window boundaries.
+ * The results are thus deterministic for a given seed, regardless of scheduling.
+ * The first region runs on the calling thread, every other region on a worker
+ * thread that lives as long as the partitions and waits for each window.
+ *
+ * A tweet content retweeted by an agent of another region gets one copy in that
+ * region's partition, holding the region's retweeters and the tweets made there.
+ * The copies are joined into one content once no tweet refers to any of them,
+ * or when the partitions are merged. */
+
+struct RegionPartitions;
+
+// An action on agents of more than one region, deferred to the window boundary
+struct RemoteEvent {
+    enum Kind {
+        // Select and follow an agent of region 'region', see analyzer_follow_agent
+        FOLLOW_IN_REGION,
+        // Follow 'id_target', including the follow-back and categorization
+        FOLLOW,
+        // Follow 'id_target', only adding the edge, see analyzer_handle_follow
+        HANDLE_FOLLOW,
+        // 'id_actor' retweets 'content' from 'id_link'
+        RETWEET,
+        // 'id_actor' unfollows 'id_target'
+        UNFOLLOW
+    };
+    Kind kind;
+    int id_actor = -1, id_target = -1;
+    int region = -1, follow_method = -1;
+    int id_link = -1, generation = -1, cascade_parent = -1;
+    double time = 0;
+    TweetContentRef content;
+
+    RemoteEvent(Kind kind) : kind(kind) {
+    }
+};
+
+// A region, simulated by its own AnalysisState
+struct RegionPartition {
+    int region;
+    RegionPartitions& partitions;
+    std::unique_ptr<AnalysisState> state;
+    // Filled during a window, drained at its end
+    std::vector<RemoteEvent> outbox;
+    // The times of the events after which a summary output may be due, filled during a window
+    std::vector<double> output_times;
+    // This partition's copy of each content retweeted across regions, by content id
+    std::unordered_map<int, TweetContentRef> shared_contents;
+
+    RegionPartition(RegionPartitions& partitions, int region) :
+            region(region), partitions(partitions) {
+    }
+};
+
+struct RegionPartitions {
+    std::vector<std::unique_ptr<RegionPartition>> regions;
+    // True while the partitions are running a window concurrently
+    bool in_window = false;
+    // The share of the network in each region, as of the start of the window
+    std::vector<double> region_weights;
+    // Agents are created serially, at the window boundaries
+    double next_add_time = -1;
+    // The output times of every partition and agent creation in the last window, in time order
+    std::vector<double> output_times;
+    // The main state's statistics when the partitions were created
+    AgentStats base_global_stats;
+    std::vector<AgentStats> base_type_stats;
+    int base_steps = 0;
+
+    ~RegionPartitions();
+    AnalysisState& home(int id_agent);
+    // Start one worker per region after the first
+    void start_workers();
+    // Run every partition up to 'window_end', returning once all are done
+    void run_workers(double window_end);
+    void stop_workers();
+private:
+    void worker_loop(int region);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable window_started, window_finished;
+    // The windows started so far, the end of the last one, and the workers still running it
+    int n_windows = 0;
+    double window_end = 0;
+    int n_running = 0;
+    bool stopping = false;
+};
+
+/* The coordinator, called by the main Analyzer */
+
+// Split the main state's agents into one partition per region
+void analyzer_parallel_begin(AnalysisState& state);
+// Run one window on all partitions, then apply the deferred events and create the new agents.
+// The window ends early at 'window_limit', if that comes first.
+void analyzer_parallel_window(AnalysisState& state, double window_limit = INFINITY);
+// Merge the partitions back into the main state
+void analyzer_parallel_end(AnalysisState& state);
+// Active tweets, summed over the partitions
+int analyzer_parallel_active_tweets(AnalysisState& state);
+// The cascades of the released tweet contents, summed over the partitions
+CascadeStats analyzer_parallel_cascade_stats(AnalysisState& state);
+
+/* Hooks for the event code of a partition. With no partitions, these do nothing. */
+
+// Is this a partition running a window?
+bool partition_in_window(AnalysisState& state);
+// Is 'id_agent' owned by another partition, while this one runs a window?
+bool partition_is_remote(AnalysisState& state, int id_agent);
+// The state owning 'id_agent'
+AnalysisState& partition_home(AnalysisState& state, int id_agent);
+// The state simulating 'region'
+AnalysisState& partition_of_region(AnalysisState& state, int region);
+// Choose the region of a followed agent, in proportion to the regions' sizes
+int partition_pick_follow_region(AnalysisState& state);
+// Queue an event for the end of the window
+void partition_defer(AnalysisState& state, const RemoteEvent& event);
+// Partitions interleave their tweet ids, so that they remain unique
+int64 partition_unique_id(AnalysisState& state, int64 local_count);
+
+#endif
@@ -24,6 +24,7 @@
 
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 
 #include "analyzer.h"
 #include "io.h"
@@ -99,48 +100,163 @@ struct AnalyzerRates {
         }
     }
 
-    void update_rate(AgentType& et, vector<double>& vec, double& rate) {
+    // The rate of each monthly cohort of an agent type, indexed by the age of the cohort
+    void cohort_rates(AgentType& et, vector<double>& vec, vector<double>& cohorts) {
         int n_months = state.n_months();
+        cohorts.resize(n_months + 1);
+        cohorts[0] = et.new_agents * vec[0];
         // Iterate two vectors in opposite directions
-        rate += et.new_agents * vec[0];
         for (int i = 1, e_i = n_months; i <= n_months; i++, e_i--) {
-            rate += vec[i] * (et.agent_cap[e_i] - et.agent_cap[e_i - 1]);
+            cohorts[i] = vec[i] * (et.agent_cap[e_i] - et.agent_cap[e_i - 1]);
         }
     }
 
-    // after every iteration, make sure the rates are updated accordingly
-    Rates set_rates(AgentType& et) {
+    // Recompute the rates of an agent type from scratch, summing over every monthly cohort.
+    // Also records the rate that one more agent of this type contributes this month,
+    // and fills the cohort trees used to select agents.
+    Rates set_rates(AgentType& et, Rates& per_new_agent,
+            FenwickTree<double>& follow_cohorts, FenwickTree<double>& tweet_cohorts) {
         double overall_follow_rate = 0, overall_tweet_rate = 0;
         et.new_agents = et.agent_list.size() - et.agent_cap.back();
         if (config.rate_add == 0) {
-            overall_follow_rate += et.agent_list.size() * et.RF[0].monthly_rates[state.n_months()];
-            overall_tweet_rate += et.agent_list.size() * et.RF[1].monthly_rates[state.n_months()];
+            // Every agent follows the current month's rate
+            per_new_agent = Rates(et.RF[0].monthly_rates[state.n_months()], et.RF[1].monthly_rates[state.n_months()]);
+            overall_follow_rate += et.agent_list.size() * per_new_agent.overall_follow_rate;
+            overall_tweet_rate += et.agent_list.size() * per_new_agent.overall_tweet_rate;
+            follow_cohorts = FenwickTree<double>();
+            tweet_cohorts = FenwickTree<double>();
         } else {
-            update_rate(et, et.RF[0].monthly_rates, overall_follow_rate);
-            update_rate(et, et.RF[1].monthly_rates, overall_tweet_rate);
+            // New agents are always in the most recent cohort
+            per_new_agent = Rates(et.RF[0].monthly_rates[0], et.RF[1].monthly_rates[0]);
+            vector<double> cohorts;
+            cohort_rates(et, et.RF[0].monthly_rates, cohorts);
+            follow_cohorts.assign(cohorts);
+            cohort_rates(et, et.RF[1].monthly_rates, cohorts);
+            tweet_cohorts.assign(cohorts);
+            overall_follow_rate = follow_cohorts.total();
+            overall_tweet_rate = tweet_cohorts.total();
         }
         return Rates(overall_follow_rate, overall_tweet_rate);
     }
 
-    void set_rates() {
+    // Full recomputation of the ledger. Only needed when a month boundary is
+    // crossed (cohorts shift to their next monthly rate) or the configuration was reloaded.
+    void recompute_ledger() {
         create_new_months_if_needed();
-        
+        config.rate_add = add_rates.RF.monthly_rates[state.n_months()];
+
+        RateLedger& ledger = state.rate_ledger;
+        ledger.type_follow_rate.resize(agent_types.size());
+        ledger.type_tweet_rate.resize(agent_types.size());
+        ledger.per_new_follow_rate.resize(agent_types.size());
+        ledger.per_new_tweet_rate.resize(agent_types.size());
+        ledger.follow_cohorts.resize(agent_types.size());
+        ledger.tweet_cohorts.resize(agent_types.size());
+
         Rates global(0, 0);
-        for (auto& et : agent_types) {
-            set_rates (et);
-            Rates rates = set_rates(et);
+        for (int i = 0; i < agent_types.size(); i++) {
+            Rates per_new_agent(0, 0);
+            Rates rates = set_rates(agent_types[i], per_new_agent,
+                    ledger.follow_cohorts[i], ledger.tweet_cohorts[i]);
             global.add(rates); // Sum the rates
+            ledger.type_follow_rate[i] = rates.overall_follow_rate;
+            ledger.type_tweet_rate[i] = rates.overall_tweet_rate;
+            ledger.per_new_follow_rate[i] = per_new_agent.overall_follow_rate;
+            ledger.per_new_tweet_rate[i] = per_new_agent.overall_tweet_rate;
+        }
+        ledger.follow_rate = global.overall_follow_rate;
+        ledger.tweet_rate = global.overall_tweet_rate;
+        ledger.month = state.n_months();
+
+        if (state.use_agent_activity()) {
+            state.activity.clear();
+            for (AgentType& et : agent_types) {
+                for (int id : et.agent_list) {
+                    set_agent_activity(id);
+                }
+            }
+            sync_activity_rates();
+        }
+    }
+
+    /* With a non-uniform activity_distribution, an agent's rates are those of its
+     * type and age, scaled by its activity multiplier. */
+    void set_agent_activity(int id) {
+        Agent& e = network[id];
+        AgentType& et = agent_types[e.agent_type];
+        int n_months = state.n_months();
+        // Mirrors set_rates(): without agent creation, every agent follows the current month's rate
+        int age = n_months;
+        if (config.rate_add != 0) {
+            age = max(0, n_months - (int) (e.creation_time / APPROX_MONTH));
         }
+        double multiplier = e.activity;
+        if (config.activity_model == FOLLOWERS_ACTIVITY) {
+            multiplier = e.follower_set.size() + 1;
+        }
+        state.activity.set_rates(id, multiplier * et.RF[0].monthly_rates[age],
+                multiplier * et.RF[1].monthly_rates[age]);
+    }
+    // The event channels take their rates from the activity trees
+    void sync_activity_rates() {
+        RateLedger& ledger = state.rate_ledger;
+        ledger.follow_rate = state.activity.follow_rate();
+        ledger.tweet_rate = state.activity.tweet_rate();
+    }
+
+    // O(log N) update of the ledger for an agent whose followers changed.
+    void followers_changed(int id) {
+        if (!state.rate_ledger.valid() || config.activity_model != FOLLOWERS_ACTIVITY) {
+            return;
+        }
+        set_agent_activity(id);
+        sync_activity_rates();
+    }
+
+    // O(log months) update of the ledger for a newly created agent,
+    // O(log N) with a non-uniform activity_distribution.
+    void add_agent(int id) {
+        RateLedger& ledger = state.rate_ledger;
+        if (!ledger.valid()) {
+            return; // Picked up by the next full recomputation
+        }
+        int agent_type = network[id].agent_type;
+        agent_types[agent_type].new_agents++;
+        ledger.type_follow_rate[agent_type] += ledger.per_new_follow_rate[agent_type];
+        ledger.type_tweet_rate[agent_type] += ledger.per_new_tweet_rate[agent_type];
+        if (ledger.follow_cohorts[agent_type].size() > 0) {
+            // The agent joins the cohort of the current month
+            ledger.follow_cohorts[agent_type].add(0, ledger.per_new_follow_rate[agent_type]);
+            ledger.tweet_cohorts[agent_type].add(0, ledger.per_new_tweet_rate[agent_type]);
+        }
+        ledger.follow_rate += ledger.per_new_follow_rate[agent_type];
+        ledger.tweet_rate += ledger.per_new_tweet_rate[agent_type];
+        if (state.use_agent_activity()) {
+            set_agent_activity(id);
+            sync_activity_rates();
+        }
+    }
+
+    // after every iteration, make sure the rates are updated accordingly
+    void set_rates() {
+        RateLedger& ledger = state.rate_ledger;
+        if (!ledger.valid() || ledger.month != state.n_months()) {
+            recompute_ledger();
+        }
+
         update_retweets(state);
-        config.rate_add = add_rates.RF.monthly_rates[state.n_months()]; 
-        double overall_retweet_rate = analyzer_total_retweet_rate(state);
-        stats.event_rate = config.rate_add + global.total_rate() + overall_retweet_rate;
-
-        // Normalize the rates
-        stats.prob_add = config.rate_add / stats.event_rate;
-        stats.prob_follow = global.overall_follow_rate / stats.event_rate;
-        stats.prob_tweet = global.overall_tweet_rate / stats.event_rate;
-        stats.prob_retweet = overall_retweet_rate / stats.event_rate;
+        // The tweet bank's total can drift slightly below zero when it empties
+        double overall_retweet_rate = max(0.0, analyzer_total_retweet_rate(state));
+
+        // No normalization needed, the events are selected directly from the channel rates
+        EventRateTree& event_rates = stats.event_rates;
+        // Region partitions leave agent creation to the window boundaries, see analyzer_parallel.cpp
+        event_rates.set_rate(EVENT_ADD, state.partition ? 0 : config.rate_add);
+        event_rates.set_rate(EVENT_FOLLOW, ledger.follow_rate);
+        event_rates.set_rate(EVENT_TWEET, ledger.tweet_rate);
+        event_rates.set_rate(EVENT_RETWEET, overall_retweet_rate);
+        event_rates.sync_total();
+        stats.event_rate = event_rates.total_rate();
     }
 };
 
@@ -148,3 +264,13 @@ void analyzer_rate_update(AnalysisState& state) {
     AnalyzerRates analyzer(state);
     analyzer.set_rates();
 }
+
+void analyzer_rate_add_agent(AnalysisState& state, int id_agent) {
+    AnalyzerRates analyzer(state);
+    analyzer.add_agent(id_agent);
+}
+
+void analyzer_rate_followers_changed(AnalysisState& state, int id_agent) {
+    AnalyzerRates analyzer(state);
+    analyzer.followers_changed(id_agent);
+}
@@ -27,6 +27,7 @@
 #include <vector>
 
 #include "analyzer.h"
+#include "analyzer_parallel.h"
 
 using namespace std;
 
@@ -37,11 +38,11 @@ struct AnalyzerRetweet {
     AnalysisState& state;
     NetworkStats& stats;
     AgentTypeVector& agent_types;
-    MTwist& rng;
+    RandomStream& rng;
     // There are multiple 'Analyzer's, they each operate on parts of AnalysisState.
     AnalyzerRetweet(AnalysisState& state) :
             network(state.network), state(state), stats(state.stats),
-            config(state.config), agent_types(state.agent_types), rng(state.rng) {
+            config(state.config), agent_types(state.agent_types), rng(state.rng.retweet) {
     }
     void update_all_retweets() {
         PERF_TIMER();
@@ -54,11 +55,16 @@ struct AnalyzerRetweet {
         return state.tweet_bank.get_total_rate();
     }
 
-    RetweetChoice tweet_to_retweet_selection() {
+    // 'rand_num' lies within [0, total retweet rate)
+    RetweetChoice tweet_to_retweet_selection(double rand_num) {
         PERF_TIMER();
         TweetBank& tweet_bank = state.tweet_bank;
+        if (tweet_bank.n_active_tweets() == 0) {
+            return RetweetChoice();
+        }
 
-        Tweet& tweet = tweet_bank.pick_random_weighted(rng);
+        tweet_ref_t ref = tweet_bank.pick_weighted(rand_num);
+        Tweet& tweet = tweet_bank.get(ref);
         UsedAgents& used = tweet.content->used_agents;
 
         Agent& e = network[tweet.id_tweeter];
@@ -68,15 +74,19 @@ struct AnalyzerRetweet {
             return RetweetChoice();
         }
 
-        if (!used.contains(agent_retweeting)) {
+        // An agent of another region partition is only recorded by its own partition,
+        // in its copy of the content, when the retweet is made (see analyzer_parallel.cpp)
+        bool is_new = partition_is_remote(state, agent_retweeting) ?
+                !used.contains(agent_retweeting) : used.insert(agent_retweeting);
+        if (is_new) {
             // Agent has NOT already retweeted this tweet
-            used.insert(agent_retweeting);
             return RetweetChoice(
                 tweet.content->id_original_author,
                 agent_retweeting,
                 tweet.id_tweeter,
                 tweet.generation + 1,
-                &tweet.content // Returning pointer is small optimization
+                tweet.cascade_node,
+                ref
             );
         }
 
@@ -93,7 +103,7 @@ double analyzer_total_retweet_rate(AnalysisState& state) {
     AnalyzerRetweet analyzer(state);
     return analyzer.total_retweet_rate();
 }
-RetweetChoice analyzer_select_tweet_to_retweet(AnalysisState& state, SelectionType type) {
+RetweetChoice analyzer_select_tweet_to_retweet(AnalysisState& state, SelectionType type, double rand_num) {
     AnalyzerRetweet analyzer(state);
-    return analyzer.tweet_to_retweet_selection();
+    return analyzer.tweet_to_retweet_selection(rand_num);
 }
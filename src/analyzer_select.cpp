@@ -25,6 +25,7 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <algorithm>
 
 #include "analyzer.h"
 
@@ -37,11 +38,12 @@ struct AnalyzerSelect {
     AnalysisState& state;
     NetworkStats& stats;
     AgentTypeVector& agent_types;
-    MTwist& rng;
+    RateLedger& ledger;
+    RandomStream& rng;
     // There are multiple 'Analyzer's, they each operate on parts of AnalysisState.
     AnalyzerSelect(AnalysisState& state) :
             network(state.network), state(state), stats(state.stats),
-            config(state.config), agent_types(state.agent_types), rng(state.rng) {
+            config(state.config), agent_types(state.agent_types), ledger(state.rate_ledger), rng(state.rng.events) {
     }
 
     vector<double>& selection_rate_vector(AgentType& type, SelectionType event) {
@@ -53,24 +55,22 @@ struct AnalyzerSelect {
         throw "selection_vector: Logic Error";
     }
 
-    double calc_rate_sum(SelectionType event) {
-        double rate_sum = 0;
-        if (stats.prob_add == 0) {
-            for (AgentType& et : agent_types) {
-                vector<double>& rates = selection_rate_vector(et, event);
-                // TODO Comment Why is state.n_months() used?
-                rate_sum += rates[state.n_months()] * et.prob_add;
-            }
-        } else {
-            for (AgentType& et : agent_types) {
-                vector<double>& rates = selection_rate_vector(et, event);
-                for (int i = 0; i <= state.n_months(); i++) {
-                    // TODO Comment Why is state.n_months() used?
-                    rate_sum += rates[state.n_months()] * et.prob_add;
-                }
-            }
+    vector<double>& type_rate_vector(SelectionType event) {
+        if (event == FOLLOW_SELECT) {
+            return ledger.type_follow_rate;
+        } else if (event == TWEET_SELECT) {
+            return ledger.type_tweet_rate;
         }
-        return rate_sum;
+        throw "type_rate_vector: Logic Error";
+    }
+
+    FenwickTree<double>& cohort_tree(int type, SelectionType event) {
+        if (event == FOLLOW_SELECT) {
+            return ledger.follow_cohorts[type];
+        } else if (event == TWEET_SELECT) {
+            return ledger.tweet_cohorts[type];
+        }
+        throw "cohort_tree: Logic Error";
     }
 
     int CHECK(int agent) {
@@ -78,76 +78,70 @@ struct AnalyzerSelect {
         return agent;
     }
 
-    int agent_selection(AgentType& et, vector<double>& rates, double& rand_num, double rate_sum) {
-        if (stats.prob_add == 0) {
+    // Every agent within [range_min, range_max) of the agent list has rate 'agent_rate'.
+    // 'rand_num' lies within [0, (range_max - range_min) * agent_rate).
+    int agent_in_range(AgentType& et, int range_min, int range_max, double rand_num, double agent_rate) {
+        if (range_min >= range_max) {
+            return -1; // Have nothing to choose
+        }
+        int offset = (int) (rand_num / agent_rate);
+        // Guard against rounding error at either end of the range
+        offset = max(0, min(offset, range_max - range_min - 1));
+        return CHECK(et.agent_list[range_min + offset]);
+    }
+
+    // Mirrors the rate calculation in analyzer_rates.cpp.
+    // 'rand_num' lies within [0, rate of the agent type).
+    int agent_selection(int type, SelectionType event, double rand_num) {
+        AgentType& et = agent_types[type];
+        vector<double>& rates = selection_rate_vector(et, event);
+        int n_months = state.n_months();
+        if (config.rate_add == 0) {
             // If add rate is 0, we do not need to consider the different months of user addition
-	    if (et.agent_list.empty()) {
-		return -1;
-            }
-            int agent = rng.pick_random_uniform(et.agent_list);
-            return CHECK(agent);
-        } else {
-            vector<int>& caps = et.agent_cap;
-            int cap_i = caps.size() - 1; // Iterate backwards
-            bool first_month = true;
-            for (int i = 0; i <= state.n_months(); i++) {
-                double adjusted_add_rate = (rates[i] * et.prob_add) / rate_sum;
-                if (rand_num <= adjusted_add_rate) {
-                    if (first_month) {
-                        int agent = -1;
-                        if (state.n_months() == 0) {
-                            if (et.new_agents == 0) {
-                                return -1;
-                            }
-                            agent = et.agent_list[rng.rand_int(et.new_agents)];
-                            DEBUG_CHECK(network.is_valid_id(agent), "Invalid agent selection!");
-                        } else {
-                            if (et.agent_list.empty()) {
-                                return -1;
-                            }
-                            agent = et.agent_list[et.agent_list.size() - 1 - rng.rand_int(et.new_agents)];
-                        }
-                        return CHECK(agent);
-                    } else {
-                        int range_min = caps.at(cap_i), range_max = caps.at(cap_i + 1);
-                        if (range_min == range_max) {
-                            return -1; // Have nothing to choose
-                        }
-                        int agent = et.agent_list[rng.rand_int(range_min, range_max)];
-                        return CHECK(agent);
-                    }
-                }
-                // Since probabilities are not cumulative, we subtract the previous add rates.
-                // This allows us to choose within the appropriate month.
-                rand_num -= adjusted_add_rate;
-                first_month = false;
-                cap_i--;
-            }
+            return agent_in_range(et, 0, et.agent_list.size(), rand_num, rates[n_months]);
         }
-        return -1;
+
+        // Find the cohort, by its age in months
+        FenwickTree<double>& cohorts = cohort_tree(type, event);
+        int age = cohorts.find(rand_num);
+        if (age >= cohorts.size()) {
+            return -1;
+        }
+        rand_num -= cohorts.prefix_sum(age);
+
+        vector<int>& caps = et.agent_cap;
+        if (age == 0) {
+            // The agents added this month
+            return agent_in_range(et, caps.back(), et.agent_list.size(), rand_num, rates[0]);
+        }
+        // The agents added 'age' months ago
+        int e_i = n_months + 1 - age;
+        return agent_in_range(et, caps[e_i - 1], caps[e_i], rand_num, rates[age]);
     }
 
-    int agent_selection(SelectionType event) {
-        double rate_sum = calc_rate_sum(event);
-        double rand_num = rng.rand_real_not0();
+    int agent_selection(SelectionType event, double rand_num) {
+        if (state.use_agent_activity()) {
+            // Every agent has its own rate
+            if (event == FOLLOW_SELECT) {
+                return state.activity.pick_follow(rand_num);
+            }
+            return state.activity.pick_tweet(rand_num);
+        }
+        vector<double>& type_rates = type_rate_vector(event);
 
         for (int e = 0; e < agent_types.size(); e++) {
-            if (rand_num < agent_types[e].prob_add) {
-                vector<double>& rates = selection_rate_vector(agent_types[e], event);
-                int agent = agent_selection(agent_types[e], rates, rand_num, rate_sum);
-                if (agent != -1) {
-                    return agent;
-                }
+            if (rand_num < type_rates[e]) {
+                return agent_selection(e, event, rand_num);
             }
-            rand_num -= agent_types[e].prob_add;
+            rand_num -= type_rates[e];
         }
 
         return -1;
     }
 };
 
-int analyzer_select_agent(AnalysisState& state, SelectionType type) {
+int analyzer_select_agent(AnalysisState& state, SelectionType type, double rand_num) {
     PERF_TIMER();
     AnalyzerSelect analyzer(state);
-    return analyzer.agent_selection(type);
+    return analyzer.agent_selection(type, rand_num);
 }
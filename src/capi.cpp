@@ -135,8 +135,10 @@ void hashkat_dump_free(struct AnalysisState* state, const char* dump) {
 }
 }
 
+// A Tweet or a TweetRecord
+template <typename T>
 struct TweetApiProxy {
-    Tweet tweet;
+    T tweet;
     template <typename Archive>
     void serialize(Archive& ar) {
         tweet.api_serialize(ar);
@@ -155,11 +157,12 @@ const char* hashkat_dump_summary(AnalysisState* state) {
         following_sets.push_back(agent.following_set.as_vector());
     }
 
-    vector<TweetApiProxy> old_tweets, live_tweets;
+    vector<TweetApiProxy<TweetRecord>> old_tweets;
+    vector<TweetApiProxy<Tweet>> live_tweets;
 
-    for (auto& t : state->oldTweets) {
-        old_tweets.push_back({t});
-    }
+    state->old_tweets.for_each([&](const TweetRecord& record) {
+        old_tweets.push_back({record});
+    });
     for (auto& t : state->tweet_bank.as_vector()) {
         live_tweets.push_back({t});
     }
@@ -56,6 +56,22 @@ static inline void parse_opt(const Node& node, const char* key, T& value) {
     parse(node, key, value, true);
 }
 
+/* Convert from a text node to the activity model, uniform if not given. */
+static ActivityModel parse_activity_model(const Node& node) {
+    string activity = "uniform";
+    parse_opt(node, "activity_distribution", activity);
+    if (activity == "uniform") {
+        return UNIFORM_ACTIVITY;
+    } else if (activity == "lognormal") {
+        return LOGNORMAL_ACTIVITY;
+    } else if (activity == "followers") {
+        return FOLLOWERS_ACTIVITY;
+    } else {
+        throw YAML::RepresentationException(node.GetMark(),
+                format("'%s' is not a valid activity distribution!", activity.c_str()));
+    }
+}
+
 /* Convert from a text node to the number representing
  * the follow model. */
 static FollowModel parse_follow_model(const Node& node) {
@@ -180,6 +196,13 @@ static void parse_analysis_configuration(ParsedConfig& config, const Node& node)
     parse(node, "use_followback", config.use_followback);
     parse(node, "use_follow_via_retweets", config.use_follow_via_retweets);
     parse(node, "use_random_time_increment", config.use_random_time_increment);
+    parse_opt(node, "parallel_regions", config.parallel_regions);
+    parse_opt(node, "parallel_window", config.parallel_window);
+    parse_opt(node, "use_tau_leaping", config.use_tau_leaping);
+    parse_opt(node, "tau_leap_epsilon", config.tau_leap_epsilon);
+    config.activity_model = parse_activity_model(node);
+    parse_opt(node, "activity_sigma", config.activity_sigma);
+    parse_opt(node, "approximate_retweeters", config.approximate_retweeters);
     parse(node, "enable_interactive_mode", config.enable_interactive_mode);
     parse(node, "enable_lua_hooks", config.enable_lua_hooks);
     parse(node, "lua_script", config.lua_script);
@@ -201,6 +224,7 @@ static Add_Rates parse_rates_configuration(ParsedConfig& config, const Node& nod
 }
 
 static void parse_output_configuration(ParsedConfig& config, const Node& node) {
+    parse_opt(node, "output_directory", config.output_directory);
     parse(node, "stdout_basic", config.output_stdout_basic);
     parse(node, "stdout_summary", config.output_stdout_summary);
     parse(node, "summary_output_rate_real_minutes", config.summary_output_rate_real_minutes);
@@ -300,11 +324,10 @@ void parse_category_weights(ParsedConfig& config, const Node& node, CategoryGrou
 static void parse_category_configurations(ParsedConfig& config, const Node& node) {
     ASSERT(!config.agent_types.empty(), "Must have agent types!");
     if (config.use_barabasi) {
-        // One category per potential agent:
+        // One category per potential follower count, weighted by (count + 1)^barabasi_exponent:
         for (int i = 1; i < config.max_agents + 1; i ++) {
-            CategoryAgentList cat(i-1, i);
+            CategoryAgentList cat(i-1, pow(i, config.barabasi_exponent));
             config.follow_ranks.categories.push_back(cat);
-            config.follow_probabilities.push_back(pow(i,config.barabasi_exponent));
             for (int j = 0; j < config.agent_types.size(); j++ ) {
                 AgentType& type = config.agent_types[j];
                 type.follow_ranks.categories.push_back(cat);
@@ -477,6 +500,22 @@ static void check_configuration_integrity(ParsedConfig& config) {
         printf("Cannot enable both query request mode and interactive mode!\n");
         throw "Error";
     }
+    if (config.parallel_regions && (config.enable_query_api || config.enable_interactive_mode || config.enable_lua_hooks)) {
+        printf("Cannot use parallel_regions with query request mode, interactive mode or Lua hooks!\n");
+        throw "Error";
+    }
+    if (config.parallel_regions && config.parallel_window <= 0) {
+        printf("parallel_window must be positive!\n");
+        throw "Error";
+    }
+    if (config.use_tau_leaping && config.parallel_regions) {
+        printf("Cannot use use_tau_leaping with parallel_regions!\n");
+        throw "Error";
+    }
+    if (config.use_tau_leaping && (config.tau_leap_epsilon <= 0 || config.tau_leap_epsilon >= 1)) {
+        printf("tau_leap_epsilon must lie between 0 and 1!\n");
+        throw "Error";
+    }
 }
 
 /***************************************************************************
@@ -544,6 +583,24 @@ static void configure_agent_rates(ParsedConfig& config) {
     }
 }
 
+/* Build the samplers of the distributions that are fixed by the configuration */
+static void build_configuration_samplers(ParsedConfig& config) {
+    Regions& R = config.regions;
+    R.add_sampler.build(R.add_probs);
+    for (Region& region : R.regions) {
+        region.ideology_sampler.build(region.ideology_probs);
+        region.language_sampler.build(region.language_probs);
+        region.preference_class_sampler.build(region.preference_class_probs);
+    }
+    for (AgentType& et : config.agent_types) {
+        et.tweet_type_sampler.build(et.tweet_type_probs, N_TWEET_TYPES);
+    }
+    // Without the twitter follow model, the weights are unused (and all zero)
+    if (config.follow_model == TWITTER_FOLLOW) {
+        config.model_sampler.build(config.model_weights);
+    }
+}
+
 ParsedConfig parse_yaml_configuration(const char* file_name) {
     try {
         fstream file(file_name, fstream::in);
@@ -561,6 +618,7 @@ ParsedConfig parse_yaml_configuration(const char* file_name) {
         configure_add_rates(config);
         configure_agent_rates(config);
         check_configuration_integrity(config);
+        build_configuration_samplers(config);
         return config;
     } catch (const exception& e) {
         printf("Exception occurred while reading '%s': %s\n", file_name,
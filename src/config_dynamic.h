@@ -31,6 +31,7 @@
 #include "events.h"
 
 #include "FollowerSet.h"
+#include "AliasTable.h"
 
 enum FollowModel {
     RANDOM_FOLLOW,
@@ -41,6 +42,13 @@ enum FollowModel {
     TWITTER_FOLLOW
 };
 
+// How active agents are relative to the others of their type and creation month
+enum ActivityModel {
+    UNIFORM_ACTIVITY, // Equally active
+    LOGNORMAL_ACTIVITY, // A lognormal multiplier of mean 1, drawn at creation
+    FOLLOWERS_ACTIVITY // A multiplier of the number of followers plus one
+};
+
 struct PreferenceClass {
     std::string name;
     // Probability that a tweet reaction results in a follow, rather than a retweet:
@@ -59,6 +67,8 @@ struct Region {
     std::vector<double> ideology_probs;
     std::vector<double> language_probs;
     std::vector<double> preference_class_probs;
+    // Samplers for the above, built once the configuration is parsed
+    AliasTable ideology_sampler, language_sampler, preference_class_sampler;
 };
 
 struct Ideology {
@@ -67,6 +77,7 @@ struct Ideology {
 
 struct Regions {
     std::vector<double> add_probs; // For choosing a region, sums to 1
+    AliasTable add_sampler; // Sampler for add_probs
     std::vector<Region> regions;
     size_t size() {
         return regions.size();
@@ -88,6 +99,19 @@ struct ParsedConfig {
     double max_real_time = INFINITY;
     long long max_analysis_steps = (1LL << 53); // 2**53; impossibly large number.
     bool use_random_time_increment = false;
+    // Simulate each region on its own thread, synchronizing every 'parallel_window' simulated minutes
+    bool parallel_regions = false;
+    double parallel_window = 60;
+    // Approximate stepping, executing Poisson-distributed batches of events over leaps
+    // during which the rates change by at most a fraction 'tau_leap_epsilon'
+    bool use_tau_leaping = false;
+    double tau_leap_epsilon = 0.03;
+    // Scales the follow and tweet rates of each agent, see AgentActivity.h
+    ActivityModel activity_model = UNIFORM_ACTIVITY;
+    double activity_sigma = 1; // For LOGNORMAL_ACTIVITY, the standard deviation of the log of the multiplier
+    // Track the agents that retweeted a tweet in a growing Bloom filter once that is smaller
+    // than tracking them exactly, see UsedAgentSet.h
+    bool approximate_retweeters = false;
     bool use_preferential_follow = false;
     bool use_followback = false;
     bool use_follow_via_retweets = false;
@@ -103,6 +127,7 @@ struct ParsedConfig {
     double hashtag_prob = 0;
     FollowModel follow_model = RANDOM_FOLLOW;
     std::vector<double> model_weights;
+    AliasTable model_sampler; // Sampler for model_weights, with the twitter follow model
 
     bool save_network_on_timeout = false, load_network_on_startup = false;
     bool ignore_load_config_check = false;
@@ -114,7 +139,10 @@ struct ParsedConfig {
     double unfollow_tweet_rate = 0;
 
     // 'output' config options
+    std::string output_directory = "output";
     bool output_stdout_basic = false, output_stdout_summary = false;
+    // Not read from the INFILE; cleared for ensemble replicas, which share the console
+    bool output_console = true;
     bool output_visualize = false;
     bool degree_distributions = false;
     bool output_tweet_analysis = false;
@@ -134,7 +162,6 @@ struct ParsedConfig {
     CategoryGrouper retweet_ranks;
     Rate_Function referral_rate_function;
 
-    std::vector<double> follow_probabilities;
     Regions regions;
     // 'agents' config options
     // Note: Weights are filled, agent lists empty
@@ -103,5 +103,9 @@ const int N_BIN_AGENT_TYPES = 200;
 const int N_BIN_REGIONS = 3;
 const int N_BIN_IDEOLOGIES = 4;
 
+// Precision of the cumulative reaction weights stored with every tweet (see ReactWeights).
+// They only place a draw among the follower bins; the tweet's total rate is kept in double.
+typedef float react_weight_t;
+
 
 #endif
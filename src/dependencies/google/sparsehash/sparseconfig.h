@@ -11,6 +11,10 @@
 typedef unsigned short u_int16_t;
 #endif
 
+/* The default hash, needed by the hash maps (C++11 <functional>) */
+#define HASH_FUN_H <functional>
+#define SPARSEHASH_HASH std::hash
+
 /* Define to 1 if you have the <inttypes.h> header file. */
 #define HAVE_INTTYPES_H 1
 
@@ -88,7 +88,8 @@ void PerfTimer::clear() {
 	perf_map.clear();
 }
 
-static PerfTimer __global_timer;
+// One timer per thread, so that concurrent simulations do not race on the timing map
+static thread_local PerfTimer __global_timer;
 
 void perf_timer_begin(const char* funcname) {
 	__global_timer.begin(funcname);
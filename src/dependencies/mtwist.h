@@ -93,7 +93,6 @@ public:
     /* AD: Added for hashkat to generate integers without bias.
      * Grab an integer from 0 to max, non-inclusive (ie appropriate for array lengths). */
     int rand_int(int max) {
-        PERF_TIMER();
         // Avoids the modulo-bias problem. Translation of Java's Random.nextInt implementation.
         int raw = genrand_int31();
 
@@ -0,0 +1,112 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+/* Compares the edge set implementations under follow/unfollow churn:
+ *
+ *   hashkat --benchmark-edge-sets
+ *
+ * Each set is kept at a fixed size while elements are erased and inserted
+ * at random, as agents unfollow and follow, and is then timed for uniform
+ * picks and for full iterations. */
+
+#include <cstdio>
+#include <vector>
+
+#include "RandomStreams.h"
+#include "dependencies/lcommon/Timer.h"
+
+#include "util/HashedEdgeSet.h"
+#include "util/DenseEdgeSet.h"
+
+using namespace std;
+
+static const int SET_SIZES[] = {16, 256, 4096};
+static const int CHURN_ROUNDS = 20; // Churn operations per element of the set
+static const int N_PICKS = 1000000;
+static const int N_ITERATED = 10000000; // Elements visited by the iteration test
+
+template <typename EdgeSet>
+static void benchmark(const char* name, int size) {
+    RandomStream rng(1, 0);
+    EdgeSet set;
+    vector<int> members; // To choose the elements to erase
+    vector<char> is_member(size * 4, 0);
+    while (members.size() < size) {
+        int id = rng.rand_int(is_member.size());
+        if (!is_member[id]) {
+            is_member[id] = 1;
+            members.push_back(id);
+            set.insert(id);
+        }
+    }
+
+    Timer timer;
+    int n_churn = size * CHURN_ROUNDS;
+    for (int i = 0; i < n_churn; i++) {
+        // Unfollow a member ...
+        int slot = rng.rand_int(members.size());
+        set.erase(members[slot]);
+        is_member[members[slot]] = 0;
+        // ... and follow a non-member
+        int id;
+        do {
+            id = rng.rand_int(is_member.size());
+        } while (is_member[id]);
+        is_member[id] = 1;
+        members[slot] = id;
+        set.insert(id);
+    }
+    double churn_ns = timer.get_microseconds() * 1000.0 / n_churn;
+
+    timer.start();
+    long long checksum = 0;
+    for (int i = 0; i < N_PICKS; i++) {
+        int id = -1;
+        set.pick_random_uniform(rng, id);
+        checksum += id;
+    }
+    double pick_ns = timer.get_microseconds() * 1000.0 / N_PICKS;
+
+    timer.start();
+    int n_scans = N_ITERATED / size;
+    for (int i = 0; i < n_scans; i++) {
+        typename EdgeSet::iterator iter;
+        while (set.iterate(iter)) {
+            checksum += iter.get();
+        }
+    }
+    double iterate_ns = timer.get_microseconds() * 1000.0 / (n_scans * (double) size);
+
+    printf("%-14s %8d %14.1f %14.1f %18.2f   (checksum %lld)\n",
+            name, size, churn_ns, pick_ns, iterate_ns, checksum);
+}
+
+int edge_set_benchmark_main(int argc, char** argv) {
+    printf("%-14s %8s %14s %14s %18s\n", "Edge set", "Size", "Churn (ns/op)", "Pick (ns/op)", "Iterate (ns/elem)");
+    for (int size : SET_SIZES) {
+        benchmark<HashedEdgeSet<int>>("HashedEdgeSet", size);
+        benchmark<DenseEdgeSet<int>>("DenseEdgeSet", size);
+    }
+    return 0;
+}
@@ -0,0 +1,333 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+
+#include "dependencies/lcommon/strformat.h"
+#include "dependencies/lcommon/Timer.h"
+
+#include "analyzer.h"
+#include "io.h"
+#include "util.h"
+#include "ensemble.h"
+
+#include "util/StatCalc.h"
+
+using namespace std;
+
+// Columns of DATA_vs_TIME, see Analyzer::output_summary_stats
+static const char* DATA_VS_TIME_COLUMNS[] = {
+    "Simulation Time (min)", "Agents", "Follows", "Tweets", "Active Tweets",
+    "Retweets", "Unfollows", "Cumulative-Rate", "Real Time (s)"
+};
+static const int N_DATA_VS_TIME_COLUMNS = sizeof(DATA_VS_TIME_COLUMNS) / sizeof(*DATA_VS_TIME_COLUMNS);
+
+// What is kept of a finished replica, once its AnalysisState is gone
+struct ReplicaSummary {
+    bool completed = false;
+    // Rows of the replica's DATA_vs_TIME
+    vector< vector<double> > data_vs_time;
+    // Final degree distributions, as fractions of all agents
+    vector<double> out_degree, in_degree, cumulative_degree;
+    // The quantities of main_stats.dat, by name
+    vector< pair<string, double> > main_stats;
+};
+
+/***************************************************************************
+ * Summarizing a single replica
+ ***************************************************************************/
+
+static vector< vector<double> > read_data_vs_time(const string& fname) {
+    vector< vector<double> > rows;
+    ifstream file(fname.c_str());
+    string line;
+    while (getline(file, line)) {
+        if (line.find_first_not_of(" \t") == string::npos || line[line.find_first_not_of(" \t")] == '#') {
+            continue; // Blank line or header
+        }
+        vector<double> row;
+        stringstream values(line);
+        double value;
+        while (values >> value) {
+            row.push_back(value);
+        }
+        if (!row.empty()) {
+            rows.push_back(row);
+        }
+    }
+    return rows;
+}
+
+static void count_degree(vector<double>& distro, int degree) {
+    if (degree >= distro.size()) {
+        distro.resize(degree + 1, 0.0);
+    }
+    distro[degree]++;
+}
+
+static void normalize(vector<double>& distro, int n_agents) {
+    for (double& count : distro) {
+        count /= n_agents;
+    }
+}
+
+static void summarize_degrees(Network& network, ReplicaSummary& summary) {
+    for (int i = 0; i < network.size(); i++) {
+        count_degree(summary.out_degree, network.n_followings(i));
+        count_degree(summary.in_degree, network.n_followers(i));
+        count_degree(summary.cumulative_degree, network.n_followings(i) + network.n_followers(i));
+    }
+    normalize(summary.out_degree, network.size());
+    normalize(summary.in_degree, network.size());
+    normalize(summary.cumulative_degree, network.size());
+}
+
+// Mirrors the contents of main_stats.dat, see network_statistics in io.cpp
+static void summarize_main_stats(AnalysisState& state, ReplicaSummary& summary) {
+    AgentStats& S = state.stats.global_stats;
+    vector< pair<string, double> >& stats = summary.main_stats;
+    stats.push_back({"Agents", state.network.size()});
+    for (auto& et : state.agent_types) {
+        stats.push_back({"Agents (" + et.name + ")", et.agent_list.size()});
+    }
+    stats.push_back({"Tweets", S.n_tweets});
+    stats.push_back({"Hashtags", S.n_hashtags});
+    for (auto& et : state.agent_types) {
+        stats.push_back({"Tweets (" + et.name + ")", et.stats.n_tweets});
+    }
+    stats.push_back({"Retweets", S.n_retweets});
+    for (auto& et : state.agent_types) {
+        stats.push_back({"Retweets (" + et.name + ")", et.stats.n_retweets});
+    }
+    stats.push_back({"Follows", S.n_follows});
+    stats.push_back({"Random follows", S.n_random_follows});
+    stats.push_back({"Twitter_Suggest follows", S.n_preferential_follows});
+    stats.push_back({"Agent follows", S.n_agent_follows});
+    stats.push_back({"Preferential_Agent follows", S.n_pref_agent_follows});
+    stats.push_back({"Retweet follows", S.n_retweet_follows});
+    stats.push_back({"Hashtag follows", S.n_hashtag_follows});
+    stats.push_back({"Followbacks", S.n_followback});
+    for (auto& et : state.agent_types) {
+        stats.push_back({"Follows (" + et.name + ")", et.stats.n_follows});
+    }
+    stats.push_back({"Unfollows", S.n_unfollows});
+}
+
+static void run_replica(const ParsedConfig& config, int seed, int replica, ReplicaSummary& summary) {
+    ParsedConfig replica_config = config;
+    replica_config.output_directory = format("%s/replica_%03d", config.output_directory.c_str(), replica);
+    if (!ensure_directory(replica_config.output_directory)) {
+        error_exit("Could not create the replica output directory '" + replica_config.output_directory + "'!");
+    }
+    // The replicas share the console and standard input
+    replica_config.output_console = false;
+    replica_config.output_stdout_basic = false;
+    replica_config.enable_interactive_mode = false;
+    replica_config.enable_query_api = false;
+    // Every replica starts from scratch, and saves to its own directory
+    replica_config.load_network_on_startup = false;
+    string save_file = config.save_file.substr(config.save_file.find_last_of('/') + 1);
+    replica_config.save_file = replica_config.output_directory + "/" + save_file;
+
+    AnalysisState state(replica_config, seed + replica);
+    analyzer_main(state);
+    output_network_statistics(state);
+
+    summary.data_vs_time = read_data_vs_time(replica_config.output_directory + "/DATA_vs_TIME");
+    summarize_degrees(state.network, summary);
+    summarize_main_stats(state, summary);
+    summary.completed = true;
+}
+
+/***************************************************************************
+ * Ensemble averages
+ ***************************************************************************/
+
+// The row of 'rows' in effect at simulation time 't': the last one written by then
+static const vector<double>& row_at(const vector< vector<double> >& rows, double t) {
+    auto after = upper_bound(rows.begin(), rows.end(), t, [](double t, const vector<double>& row) {
+        return t < row[0];
+    });
+    return *(after - 1);
+}
+
+/* Each replica writes its rows when its own events pass the output times, so the replicas' rows
+ * fall at different simulation times, and may differ in number. Every replica is resampled onto
+ * one grid, carrying its last row forward, from the time all have written a row to the time
+ * the first stopped writing them. */
+static void output_ensemble_data_vs_time(const string& fname, const ParsedConfig& config,
+        vector<ReplicaSummary*>& replicas) {
+    int n_columns = N_DATA_VS_TIME_COLUMNS;
+    size_t max_rows = 0;
+    double start = 0, end = INFINITY;
+    for (ReplicaSummary* r : replicas) {
+        vector< vector<double> >& rows = r->data_vs_time;
+        if (rows.empty()) {
+            end = -INFINITY; // Nothing to average
+            continue;
+        }
+        for (auto& row : rows) {
+            n_columns = min(n_columns, (int)row.size());
+        }
+        max_rows = max(max_rows, rows.size());
+        start = max(start, rows.front()[0]);
+        end = min(end, rows.back()[0]);
+    }
+    // The grid has no more rows than the longest replica. Rows are written at most every
+    // STDOUT_OUTPUT_RATE output periods (fewer when periods pass without events), so in simulated
+    // time the grid is a whole number of these apart. Real time periods have no such length.
+    double interval = (max_rows > 1 && end > start ? (end - start) / (max_rows - 1) : 1);
+    if (!config.summary_output_rate_real_minutes) {
+        double row_interval = config.summary_output_rate * STDOUT_OUTPUT_RATE;
+        interval = ceil(interval / row_interval) * row_interval;
+    }
+
+    ofstream output(fname.c_str());
+    output << "# Average and 95% confidence interval over " << replicas.size() << " replicas\n#";
+    for (int c = 0; c < n_columns; c++) {
+        output << setw(25) << DATA_VS_TIME_COLUMNS[c] << setw(25) << "(+-)";
+    }
+    output << "\n";
+    for (int i = 0; start + i * interval <= end; i++) {
+        double t = start + i * interval;
+        output << " " << scientific << setprecision(8) << setw(25) << t << setw(25) << 0.0;
+        for (int c = 1; c < n_columns; c++) {
+            StatCalc calc;
+            for (ReplicaSummary* r : replicas) {
+                calc.add_element(row_at(r->data_vs_time, t)[c]);
+            }
+            output << setw(25) << calc.average << setw(25) << calc.confidence_interval();
+        }
+        output << "\n";
+    }
+}
+
+static void output_ensemble_degree_distribution(const string& fname, const char* name,
+        vector<ReplicaSummary*>& replicas, vector<double> ReplicaSummary::* distro) {
+    size_t max_degree = 0;
+    for (ReplicaSummary* r : replicas) {
+        max_degree = max(max_degree, (r->*distro).size());
+    }
+
+    ofstream output(fname.c_str());
+    output << "# This is the " << name << " degree distribution, averaged over " << replicas.size() << " replicas. The data order is:\n"
+           << "# degree, average normalized probability, 95% confidence interval, log of degree, log of average normalized probability\n\n"
+           << "#d\tn.prob\tci\tlog_d\tlog_np\n\n";
+    for (int d = 0; d < max_degree; d++) {
+        StatCalc calc;
+        for (ReplicaSummary* r : replicas) {
+            // Replicas that never reached this degree contribute a probability of 0
+            calc.add_element(d < (r->*distro).size() ? (r->*distro)[d] : 0.0);
+        }
+        output << d << "\t" << calc.average << "\t" << calc.confidence_interval() << "\t"
+               << log(d) << "\t" << log(calc.average) << "\n";
+    }
+}
+
+static void output_ensemble_main_stats(const string& fname, vector<ReplicaSummary*>& replicas) {
+    ofstream output(fname.c_str());
+    output << "-----------------------------\n| ENSEMBLE MAIN NETWORK STATS |\n-----------------------------\n\n";
+    output << "Replicas:\t" << replicas.size() << "\n";
+    output << "Each quantity is given as: average (+- 95% confidence interval)\n\n";
+    vector< pair<string, double> >& names = replicas[0]->main_stats;
+    for (int i = 0; i < names.size(); i++) {
+        StatCalc calc;
+        for (ReplicaSummary* r : replicas) {
+            calc.add_element(r->main_stats[i].second);
+        }
+        output << names[i].first << ":\t" << calc.average << "\t(+- " << calc.confidence_interval() << ")\n";
+    }
+}
+
+/***************************************************************************
+ * Entry point
+ ***************************************************************************/
+
+void ensemble_main(const ParsedConfig& config, int seed, int n_replicas, int n_threads) {
+    if (!ensure_directory(config.output_directory)) {
+        error_exit("Could not create the output directory '" + config.output_directory + "'!");
+    }
+
+    vector<ReplicaSummary> summaries(n_replicas);
+    atomic<int> next_replica(0);
+    // Once interrupted, the remaining replicas are not started
+    int signal_count = analyzer_signal_count();
+
+    // Each worker thread takes the next replica that has not been started yet
+    auto worker = [&]() {
+        int replica;
+        while ((replica = next_replica++) < n_replicas && analyzer_signal_count() == signal_count) {
+            Timer timer;
+            try {
+                run_replica(config, seed, replica, summaries[replica]);
+                printf("Replica %d (seed '%d') took %.2fms.\n", replica, seed + replica, timer.get_microseconds() / 1000.0);
+            } catch (const char* msg) {
+                printf("Replica %d (seed '%d') failed: %s\n", replica, seed + replica, msg);
+            } catch (const std::exception& err) {
+                printf("Replica %d (seed '%d') failed: %s\n", replica, seed + replica, err.what());
+            }
+        }
+    };
+
+    vector<thread> threads;
+    for (int i = 0; i < min(n_threads, n_replicas); i++) {
+        threads.push_back(thread(worker));
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+
+    vector<ReplicaSummary*> completed;
+    for (ReplicaSummary& summary : summaries) {
+        if (summary.completed) {
+            completed.push_back(&summary);
+        }
+    }
+    printf("%d out of %d replicas completed.\n", (int)completed.size(), n_replicas);
+    if (completed.empty()) {
+        return;
+    }
+
+    const string& dir = config.output_directory;
+    if (config.output_stdout_summary) {
+        output_ensemble_data_vs_time(dir + "/ensemble_DATA_vs_TIME", config, completed);
+    }
+    if (config.degree_distributions) {
+        output_ensemble_degree_distribution(dir + "/ensemble_out-degree_distribution.dat", "out", completed, &ReplicaSummary::out_degree);
+        output_ensemble_degree_distribution(dir + "/ensemble_in-degree_distribution.dat", "in", completed, &ReplicaSummary::in_degree);
+        output_ensemble_degree_distribution(dir + "/ensemble_cumulative-degree_distribution.dat", "cumulative", completed, &ReplicaSummary::cumulative_degree);
+    }
+    if (config.main_stats) {
+        output_ensemble_main_stats(dir + "/ensemble_main_stats.dat", completed);
+    }
+}
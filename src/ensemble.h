@@ -0,0 +1,39 @@
+/*
+ * This file is part of the #KAT Social Network Simulator.
+ *
+ * The #KAT Social Network Simulator is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * The #KAT Social Network Simulator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with the #KAT Social Network Simulator.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Addendum:
+ *
+ * Under this license, derivations of the #KAT Social Network Simulator typically must be provided in source
+ * form. The #KAT Social Network Simulator and derivations thereof may be relicensed by decision of 
+ * the original authors (Kevin Ryczko & Adam Domurad, Isaac Tamblyn), as well, in the case of a derivation,
+ * subsequent authors. 
+ */
+
+#ifndef ENSEMBLE_H_
+#define ENSEMBLE_H_
+
+#include "config_dynamic.h"
+
+/* Run an ensemble of independent simulations of the same configuration,
+ * which is parsed only once. Up to 'n_threads' replicas run at a time.
+ *
+ * Replica i is seeded with 'seed + i' and writes its usual analysis files to
+ * <output_directory>/replica_<i>. Once all replicas are done, the average and
+ * 95% confidence interval of DATA_vs_TIME, the final degree distributions and
+ * the main statistics are written to <output_directory>/ensemble_*. */
+void ensemble_main(const ParsedConfig& config, int seed, int n_replicas, int n_threads);
+
+#endif
@@ -53,7 +53,8 @@ void lua_hook_unfollow(AnalysisState& state, int id_follower, int id_followed) {
     }
 }
 
-void lua_hook_tweet(AnalysisState& state, int id_tweeter, Tweet& tweet) {
+void lua_hook_tweet(AnalysisState& state, int id_tweeter, tweet_ref_t ref) {
+    Tweet& tweet = state.tweet_bank.get(ref);
     if (state.event_callbacks.on_tweet) {
         state.event_callbacks.on_tweet(hashkat_dump_tweet(&state, &tweet));
     }
@@ -62,7 +63,8 @@ void lua_hook_tweet(AnalysisState& state, int id_tweeter, Tweet& tweet) {
     }
 }
 
-void lua_hook_retweet(AnalysisState& state, int id_tweeter, Tweet& tweet) {
+void lua_hook_retweet(AnalysisState& state, int id_tweeter, tweet_ref_t ref) {
+    Tweet& tweet = state.tweet_bank.get(ref);
     if (state.event_callbacks.on_retweet) {
         state.event_callbacks.on_retweet(hashkat_dump_tweet(&state, &tweet));
     }
@@ -34,12 +34,19 @@
 lua_State* init_lua_state(bool minimal = false);
 lua_State* get_lua_state(AnalysisState& state);
 
-/* State of the interactive mode. Holds a Lua context. */
+/* State of the interactive mode. Holds a Lua context.
+ * Each AnalysisState owns one, so that simulations can run side by side. */
 
 struct InteractiveModeLuaState {
     lua_State* L = NULL;
     AnalysisState* state;
 
+    ~InteractiveModeLuaState() {
+        if (L != NULL) {
+            lua_close(L);
+        }
+    }
+
     void ensure_init(AnalysisState& s) {
         if (L == NULL) {
             L = init_lua_state();
@@ -63,11 +70,17 @@ struct InteractiveModeLuaState {
     }
 };
 
-static InteractiveModeLuaState state;
+// The state whose simulation last called into Lua on this thread.
+// The bindings below are plain functions, and find their simulation through this.
+static thread_local InteractiveModeLuaState* active_state = NULL;
 
 lua_State* get_lua_state(AnalysisState& as) {
-    state.ensure_init(as);
-    return state.L;
+    if (!as.lua_state) {
+        as.lua_state.reset(new InteractiveModeLuaState);
+    }
+    active_state = as.lua_state.get();
+    active_state->ensure_init(as);
+    return active_state->L;
 }
 
 /*
@@ -83,22 +96,26 @@ lua_State* get_lua_state(AnalysisState& as) {
  * a script
  * */
 struct InteractiveModeBindings {
+    static InteractiveModeLuaState& state() {
+        return *active_state;
+    }
+
     static void sync_state(lua_State* L) {
         using namespace luawrap;
 
         LuaValue G = globals(L);
-        G["n_agents"] = state->network.size();
-        G["max_agents"] = state->network.max_size();
-        G["analysis_time"] = state->time;
-        G["analysis_step"] = state->stats.n_steps;
+        G["n_agents"] = state()->network.size();
+        G["max_agents"] = state()->network.max_size();
+        G["analysis_time"] = state()->time;
+        G["analysis_step"] = state()->stats.n_steps;
 
         // Output from stats:
-        auto& S = state->stats;
+        auto& S = state()->stats;
         G["rate_total"] = S.event_rate;
-        G["rate_add"] = S.event_rate * S.prob_add;
-        G["rate_follow"] = S.event_rate * S.prob_follow;
-        G["rate_retweet"] = S.event_rate * S.prob_retweet;
-        G["rate_tweet"] = S.event_rate * S.prob_tweet;
+        G["rate_add"] = S.event_rates.rate(EVENT_ADD);
+        G["rate_follow"] = S.event_rates.rate(EVENT_FOLLOW);
+        G["rate_retweet"] = S.event_rates.rate(EVENT_RETWEET);
+        G["rate_tweet"] = S.event_rates.rate(EVENT_TWEET);
 
         G["total_followings"] = S.global_stats.n_follows;
         G["total_followers"] = S.global_stats.n_followers;
@@ -132,37 +149,37 @@ struct InteractiveModeBindings {
 
     /* Interrupt menu functions: */
     static int n_followers(int id) {
-        return state->network.n_followers(id);
+        return state()->network.n_followers(id);
     }
 
     static void save_network_state(const char* fname) {
-        analyzer_save_network_state(*state, fname);
+        analyzer_save_network_state(*state(), fname);
     }
 
     static void load_network_state(const char* fname) {
-        analyzer_load_network_state(*state, fname);
+        analyzer_load_network_state(*state(), fname);
     }
 
     static LuaValue agent(int id) {
-        return agent_to_table(state->network[id]);
+        return agent_to_table(state()->network[id]);
     }
 
     static LuaValue create_agent(int id) {
-        if (analyzer_create_agent(*state)) {
-            return agent_to_table(state->network.back());
+        if (analyzer_create_agent(*state())) {
+            return agent_to_table(state()->network.back());
         }
-        return LuaValue::nil(state.L);
+        return LuaValue::nil(state().L);
     }
 
     static int n_followings(int agent) {
-        return state->network.n_followings(agent);
+        return state()->network.n_followings(agent);
     }
 
     static std::vector<int> followers(int agent) {
-        return state->network.follower_set(agent).as_vector();
+        return state()->network.follower_set(agent).as_vector();
     }
     static std::vector<int> followings(int agent) {
-        return state->network.following_set(agent).as_vector();
+        return state()->network.following_set(agent).as_vector();
     }
 
     // Can be used if simply dumping a direct member by name,
@@ -171,8 +188,8 @@ struct InteractiveModeBindings {
     value[#member] = obj. member
 
     static LuaValue agent_to_table(Agent& e) {
-        auto value = LuaValue::newtable(state.L);
-        value["agent_type"] = state.state->agent_types[e.agent_type].name;
+        auto value = LuaValue::newtable(state().L);
+        value["agent_type"] = state()->agent_types[e.agent_type].name;
         DUMP(e, preference_class);
         DUMP(e, region_bin);
         DUMP(e, ideology_tweet_percent);
@@ -183,7 +200,7 @@ struct InteractiveModeBindings {
         DUMP(e, avg_chatiness);
         DUMP(e, chatty_agents);
 
-        auto table = LuaValue::newtable(state.L);
+        auto table = LuaValue::newtable(state().L);
         value["location"] = table;
 
         value["language_id"] = (int)e.language;
@@ -193,12 +210,13 @@ struct InteractiveModeBindings {
     }
 
     static LuaValue tweet_to_table(Tweet& tweet) {
-        auto value = LuaValue::newtable(state.L);
+        auto value = LuaValue::newtable(state().L);
         DUMP(tweet, id_tweeter);
         DUMP(tweet, id_link);
         DUMP(tweet, retweet_next_rebin_time);
         DUMP(tweet, retweet_time_bin);
         DUMP(tweet, generation);
+        DUMP(tweet, cascade_node);
         DUMP(tweet, creation_time);
 
         value["id_original_author"] = tweet.content->id_original_author;
@@ -209,9 +227,9 @@ struct InteractiveModeBindings {
     }
 
     static LuaValue agents() {
-        auto value = LuaValue::newtable(state.L);
+        auto value = LuaValue::newtable(state().L);
 
-        for (auto& agent : state->network) {
+        for (auto& agent : state()->network) {
             value[value.objlen() + 1] = agent_to_table(agent);
         }
 
@@ -219,11 +237,13 @@ struct InteractiveModeBindings {
     }
 
     static LuaValue tweets() {
-        auto value = LuaValue::newtable(state.L);
+        auto value = LuaValue::newtable(state().L);
 
-        for (auto* node : state->tweet_bank.as_node_vector()) {
-            auto table = tweet_to_table(node->data);
-            table["rate_react_total"] = node->rates.tuple_sum;
+        TweetBank& tweet_bank = state()->tweet_bank;
+        for (tweet_ref_t ref : tweet_bank.as_ref_vector()) {
+            Tweet& tweet = tweet_bank.get(ref);
+            auto table = tweet_to_table(tweet);
+            table["rate_react_total"] = tweet_bank.tree.reaction_rate(tweet);
             value[value.objlen() + 1] = table;
         }
 
@@ -231,7 +251,7 @@ struct InteractiveModeBindings {
     }
 
     static void followers_print(int agent) {
-        state->network.follower_set(agent).print();
+        state()->network.follower_set(agent).print();
     }
 };
 
@@ -274,7 +294,7 @@ bool start_interactive_mode(AnalysisState& s) {
     sync_lua_state(s);
     bool menu = false;
     try {
-        menu = state.show_menu();
+        menu = s.lua_state->show_menu();
     } catch (std::runtime_error& err) {
         std::cout << err.what() << std::endl;
     } catch (...) {
@@ -56,6 +56,7 @@
 #include <algorithm>
 
 #include "dependencies/mtwist.h"
+#include "dependencies/lcommon/strformat.h"
 #include "analyzer.h"
 #include "io.h"
 #include "util.h"
@@ -79,13 +80,13 @@ void output_network_statistics(AnalysisState& state) {
     AgentTypeVector& et_vec = state.agent_types;
     NetworkStats& stats = state.stats;
     MostPopularTweet& mpt = state.most_pop_tweet;
-    vector<Tweet>& old_tweets = state.oldTweets;
+    TweetLog& old_tweets = state.old_tweets;
 
     //brief_agent_statistics(state);
 
     // Print why program stopped
     if (C.output_stdout_basic) {
-        if (SIGNAL_ATTEMPTS > 0) {
+        if (state.signal_attempts() > 0) {
             cout << "\nSimulation (Gracefully) Interrupted: ctrl-c was pressed\n";
         } else if (state.end_time >= C.max_sim_time) {
             cout << "\nSimulation Completed: desired duration reached\n";
@@ -110,14 +111,14 @@ void output_network_statistics(AnalysisState& state) {
 
     // Depending on our INFILE/configuration, we may output various analysis
     if (C.output_visualize) {
-        output_position(network, N_AGENTS);
+        output_position(network, N_AGENTS, C.output_directory);
     }
     /* ADD FUNCTIONS THAT RUN AFTER NETWORK IS BUILT HERE */
     if (C.categories_distro) {
-        Categories_Check(state.tweet_ranks, state.follow_ranks, state.retweet_ranks);
+        Categories_Check(state.tweet_ranks, state.follow_ranks, state.retweet_ranks, C.output_directory);
     }
     if (C.output_tweet_analysis) {
-        tweets_distribution(network, N_AGENTS);
+        tweets_distribution(network, N_AGENTS, C.output_directory);
     }
     // Better to manually check distributions, for low network sizes this will most likely throw an error
     /*if (agent_checks(et_vec, network, state, state.config.add_rates, initial_agents)) {
@@ -126,7 +127,7 @@ void output_network_statistics(AnalysisState& state) {
         cout << "Numbers are events are not valid, adjust the tolerance or check for errors.\n";
     }*/
     if (C.agent_stats) {
-        whos_following_who(et_vec, network);
+        whos_following_who(et_vec, network, C.output_directory);
     }
     if (C.output_stdout_basic) {
         cout << "Analysis complete!\n";
@@ -135,17 +136,18 @@ void output_network_statistics(AnalysisState& state) {
         degree_distributions(network, state);
     }
     if (C.retweet_viz) {
-        visualize_most_popular_tweet(mpt, network);
+        visualize_most_popular_tweet(mpt, network, C.output_directory);
     }
     if (C.main_stats) {
-        network_statistics(network, stats, et_vec);
-        tweet_info(old_tweets);
+        network_statistics(network, stats, et_vec, C.output_directory);
+        tweet_info(old_tweets, C.output_directory);
+        cascade_statistics(state, C.output_directory);
     }
     if (C.region_connection_matrix) {
         region_stats(network, state);
     }
     if (C.most_popular_tweet_content) {
-        most_popular_tweet_content(mpt, network);
+        most_popular_tweet_content(mpt, network, C.output_directory);
     }
     // cout << "\n\n\n\n\n\n\n";
     // print_n_agents_in_regions(network, state);
@@ -165,72 +167,77 @@ void output_network_statistics(AnalysisState& state) {
 
 // TWEET_INFO_DAT
 
-void tweet_info(vector<Tweet>& old_tweets) {
+void tweet_info(TweetLog& old_tweets, const string& output_dir) {
 
     std::vector<int> authors;
     std::vector<int> content;
     std::vector<int> hashtag;
     std::vector<int> popular_agent;
     std::vector<int> tweet_generation;
-    double average_time_retweeted, average_tweet_lifetime;    
+    double average_time_retweeted = 0, average_tweet_lifetime = 0;
     ofstream output1, output2;
-    output1.open("output/average_tweet_info.dat");
+    output1.open(output_dir + "/average_tweet_info.dat");
     output1 << "#Contains network information about tweets in the simulation.\n#Generation = length of longest path tweeter -> recipient\n#Generation 0 = original/root, 1 = retweeted one level, 2 = retweeted 2 levels\n\n";
-    for (auto& tweet : old_tweets) {
+    old_tweets.for_each([&](const TweetRecord& tweet) {
 
         authors.push_back (tweet.id_tweeter);
-        content.push_back (tweet.content->type);
+        content.push_back (tweet.type);
         hashtag.push_back (tweet.hashtag);
         popular_agent.push_back (tweet.id_link);
         tweet_generation.push_back (tweet.generation);
-        average_time_retweeted += tweet.content->used_agents.size();
+        average_time_retweeted += tweet.n_retweets;
         average_tweet_lifetime += tweet.deletion_time - tweet.creation_time;
 
-    }    
-
-    std::sort(authors.begin(), authors.end());
-    std::sort(content.begin(), content.end());
-    std::sort(hashtag.begin(), hashtag.end());
-    std::sort(popular_agent.begin(), popular_agent.end());
-    std::sort(tweet_generation.begin(), tweet_generation.end());
-    std::vector<vector<int>> collection = {authors, content, hashtag, popular_agent, tweet_generation};
-    std::vector<int> modes;
-
-    for (auto& x : collection) {
-        int value = x[0];
-        int mode = value;
-        int score = 1;
-        int count = 1;
-        for (auto& y : x) {
-            if (y == value) {
-                count++;
-            }
-            else {
-                if (count > score) {
-                    score = count;
-                    mode = value;
+    });
+
+    if (old_tweets.size() == 0) {
+        // No tweet has expired yet, there is nothing to take the modes and averages of
+        output1 << "No tweets have expired yet.\n";
+    } else {
+        std::sort(authors.begin(), authors.end());
+        std::sort(content.begin(), content.end());
+        std::sort(hashtag.begin(), hashtag.end());
+        std::sort(popular_agent.begin(), popular_agent.end());
+        std::sort(tweet_generation.begin(), tweet_generation.end());
+        std::vector<vector<int>> collection = {authors, content, hashtag, popular_agent, tweet_generation};
+        std::vector<int> modes;
+
+        for (auto& x : collection) {
+            int value = x[0];
+            int mode = value;
+            int score = 1;
+            int count = 1;
+            for (auto& y : x) {
+                if (y == value) {
+                    count++;
+                }
+                else {
+                    if (count > score) {
+                        score = count;
+                        mode = value;
+                    }
+                    count = 1;
+                    value = y;
                 }
-                count = 1;
-                value = y;
             }
+            modes.push_back (mode);
         }
-        modes.push_back (mode);
-    }
 
-    average_time_retweeted = average_time_retweeted / old_tweets.size();
-    average_tweet_lifetime = average_tweet_lifetime / old_tweets.size();
+        average_time_retweeted = average_time_retweeted / old_tweets.size();
+        average_tweet_lifetime = average_tweet_lifetime / old_tweets.size();
 
-    output1 << "Agent ID of Chattiest Tweeter (Tweets & Retweets):\t" << modes[0] << "\n"
-            << "Most Common Tweet_type in system:\t\t\t" << modes[1] << "\n"
-            << "Probability of Hashtag in system:\t\t\t" << modes[2] << "\n"
-            << "Agent ID Most Commonly Retweeted:\t\t\t" << modes[3] << "\n"
-            << "Most Common Retweet Generation:\t\t\t\t" << modes[4] << "\n"
-            << "Average Number of Times Retweeted:\t\t\t" << average_time_retweeted << "\n"
-            << "Average Tweet Lifetime (minutes):\t\t\t" << average_tweet_lifetime << "\n\n";
+        output1 << "Agent ID of Chattiest Tweeter (Tweets & Retweets):\t" << modes[0] << "\n"
+                << "Most Common Tweet_type in system:\t\t\t" << modes[1] << "\n"
+                << "Probability of Hashtag in system:\t\t\t" << modes[2] << "\n"
+                << "Agent ID Most Commonly Retweeted:\t\t\t" << modes[3] << "\n"
+                << "Most Common Retweet Generation:\t\t\t\t" << modes[4] << "\n"
+                << "Average Number of Times Retweeted:\t\t\t" << average_time_retweeted << "\n"
+                << "Average Tweet Lifetime (minutes):\t\t\t" << average_tweet_lifetime << "\n\n";
+    }
 
     output1.close();
 
-    output2.open("output/tweet_info.dat");
+    output2.open(output_dir + "/tweet_info.dat");
 
     output2 << "#Contains basic information relating to every tweet and retweet within the network simulation.\n\n"
             << "Tweet ID\t" << setw(25)
@@ -242,16 +249,16 @@ void tweet_info(vector<Tweet>& old_tweets) {
             << "Number of Times Retweeted\t" << setw(25)
             << "Tweet Lifetime (minutes)\n\n";
 
-    for (auto& tweet : old_tweets) {
+    old_tweets.for_each([&](const TweetRecord& tweet) {
         output2 << tweet.id_tweet << "\t" << setw(25)
                 << tweet.id_tweeter << "\t" << setw(25)
-                << tweet.content->type << "\t" << setw(25)
+                << tweet.type << "\t" << setw(25)
                 << tweet.hashtag << "\t" << setw(25)
                 << tweet.id_link << "\t" << setw(25)
                 << tweet.generation << "\t" << setw(25)
-                << tweet.content->used_agents.size() << "\t" << setw(25)
+                << tweet.n_retweets << "\t" << setw(25)
                 << tweet.deletion_time - tweet.creation_time << "\n";
-    }
+    });
     output2.close();
 
 }
@@ -335,9 +342,9 @@ void brief_agent_statistics(AnalysisState& state) {
 
 // NETWORK.GEXF edgelist for R (analysis), python executable (drawing), and gephi output file
 
-void output_position(Network& network, int n_agents) {
+void output_position(Network& network, int n_agents, const string& output_dir) {
     ofstream output1;
-    output1.open("output/network.gexf");
+    output1.open(output_dir + "/network.gexf");
     output1 << "<gexf version=\"1.2\">\n"
             << "<meta lastmodifieddate=\"2013-11-21\">\n"
             << "<creator> Kevin Ryczko </creator>\n"
@@ -397,7 +404,7 @@ void output_position(Network& network, int n_agents) {
 // NETWORK.DAT
 
     ofstream output;
-    output.open("output/network.dat");
+    output.open(output_dir + "/network.dat");
     output << "# Agent ID\tFollower ID\n\n";
     for (int id = 0; id < n_agents; id++) {
         for (int id_fol : network.follower_set(id).as_vector()) {
@@ -409,7 +416,7 @@ void output_position(Network& network, int n_agents) {
 // NETWORK.GRAPHML
 
     ofstream output2;
-    output2.open("output/network.graphml");
+    output2.open(output_dir + "/network.graphml");
     output2 << "# File used to graph the network, where 'nodes' correspond to agents in the network and 'edges' correspond to connections.\n\n";
     int count2 = 0;
     if (n_agents <= 10000) {
@@ -481,16 +488,11 @@ void degree_distributions(Network& network,AnalysisState& state) {
     int max_degree = max_following + max_followers;
 
     ofstream outdd, indd, cumuldd;//, scaled;
-    char out[100], in[100], cumul[100], scale[100];
-    sprintf(out, "output/out-degree_distribution_month_%03d.dat", state.n_months());
-    sprintf(in, "output/in-degree_distribution_month_%03d.dat", state.n_months());
-    sprintf(cumul, "output/cumulative-degree_distribution_month_%03d.dat", state.n_months());
-    //sprintf(scale, "output/scaled-degree_distribution_month_%03d.dat", state.n_months());
-    
-    string out_s = out;
-    string in_s = in;
-    string cumul_s = cumul;
-    //string scale_s = scale;
+    const char* dir = state.config.output_directory.c_str();
+    string out_s = format("%s/out-degree_distribution_month_%03d.dat", dir, state.n_months());
+    string in_s = format("%s/in-degree_distribution_month_%03d.dat", dir, state.n_months());
+    string cumul_s = format("%s/cumulative-degree_distribution_month_%03d.dat", dir, state.n_months());
+    //string scale_s = format("%s/scaled-degree_distribution_month_%03d.dat", dir, state.n_months());
 
     outdd.open(out_s.c_str());
     indd.open(in_s.c_str());
@@ -569,18 +571,18 @@ static void category_print(ofstream& output, const char* name, CategoryGrouper&
     output << '\n';
 }
 
-void Categories_Check(CategoryGrouper& tweeting, CategoryGrouper& following, CategoryGrouper& retweeting) {
+void Categories_Check(CategoryGrouper& tweeting, CategoryGrouper& following, CategoryGrouper& retweeting, const string& output_dir) {
     ofstream output;
-    output.open("output/Categories_Distro.dat");
+    output.open(output_dir + "/Categories_Distro.dat");
     category_print(output, "Tweeting", tweeting);
     category_print(output, "Following", following);
     category_print(output, "Retweeting", retweeting);
     output.close();
 }
 
-void agent_statistics(Network& network, int n_follows, int n_agents, int max_agents, AgentType* agenttype) {
+void agent_statistics(Network& network, int n_follows, int n_agents, int max_agents, AgentType* agenttype, const string& output_dir) {
     ofstream output;
-    output.open("output/agent_percentages.dat");
+    output.open(output_dir + "/agent_percentages.dat");
     vector<int> agent_counts(max_agents);
     vector<int> average_followers_from_network(max_agents);
     vector<int> average_followers_from_lists(max_agents);
@@ -638,10 +640,10 @@ void agent_statistics(Network& network, int n_follows, int n_agents, int max_age
 // TWEETS_DISTRO.DAT
 // RETWEETS_DISTRO.DAT
 
-void tweets_distribution(Network& network, int n_users) {
+void tweets_distribution(Network& network, int n_users, const string& output_dir) {
     ofstream tweet_output, retweet_output;
-    tweet_output.open("output/tweets_distro.dat");
-    retweet_output.open("output/retweets_distro.dat");
+    tweet_output.open(output_dir + "/tweets_distro.dat");
+    retweet_output.open(output_dir + "/retweets_distro.dat");
 
     int max_tweets = 0, max_retweets = 0;
     double tweets_sum = 0, retweets_sum = 0;
@@ -741,8 +743,8 @@ bool agent_checks(AgentTypeVector& ets, Network& network, AnalysisState& state,
 
 // AGENT_TYPE_INFO.DAT
 
-static void whos_following_who(AgentTypeVector& types, AgentType& type, Network& network) {
-    string filename = "output/" + type.name + "_info.dat";
+static void whos_following_who(AgentTypeVector& types, AgentType& type, Network& network, const string& output_dir) {
+    string filename = output_dir + "/" + type.name + "_info.dat";
     ofstream output;
     output.open(filename.c_str());
     int max_degree = 0;
@@ -808,18 +810,56 @@ static void whos_following_who(AgentTypeVector& types, AgentType& type, Network&
 // function that will plot degree distributions for every agent, and at the top
 // of the files gives you info about the percentage of each agent they are following
 
-void whos_following_who(AgentTypeVector& types, Network& network) {
+void whos_following_who(AgentTypeVector& types, Network& network, const string& output_dir) {
     for (int i = 0; i < types.size(); i ++ ) {
-        whos_following_who(types, types[i], network);
+        whos_following_who(types, types[i], network, output_dir);
     }
 }
 
+// CASCADE_STATS.DAT
+
+void cascade_statistics(AnalysisState& state, const string& output_dir) {
+    // The cascades still active are counted as they stand
+    CascadeStats stats = state.cascade_stats;
+    std::set<TweetContent*> active;
+    for (tweet_ref_t ref : state.tweet_bank.as_ref_vector()) {
+        TweetContent* content = state.tweet_bank.get(ref).content.get();
+        if (active.insert(content).second) {
+            stats.add(content->cascade);
+        }
+    }
+
+    // After the rows written over time, see Analyzer::output_cascade_stats
+    ofstream output;
+    output.open(output_dir + "/cascade_stats.dat", ios::app);
+    output << "\n#At the end, with the cascades still active\n";
+    output << "Cascades:\t" << stats.n_cascades << "\n";
+    output << "Average Size:\t" << (stats.n_cascades == 0 ? 0.0 : stats.total_size / (double) stats.n_cascades) << "\n";
+    output << "Max Size:\t" << stats.max_size << "\n";
+    output << "Max Depth:\t" << stats.max_depth << "\n";
+    output << "Max Breadth:\t" << stats.max_breadth << "\n";
+
+    output << "\n#Size from\tCascades\n";
+    for (int i = 0; i < stats.size_bins.size(); i++) {
+        output << (1LL << i) << "\t" << stats.size_bins[i] << "\n";
+    }
+    output << "\n#Depth\tCascades\n";
+    for (int i = 0; i < stats.depth_counts.size(); i++) {
+        output << i << "\t" << stats.depth_counts[i] << "\n";
+    }
+    output << "\n#Breadth from\tCascades\n";
+    for (int i = 0; i < stats.breadth_bins.size(); i++) {
+        output << (1LL << i) << "\t" << stats.breadth_bins[i] << "\n";
+    }
+    output.close();
+}
+
 // MOST_POPULAR_TWEET_CONTENT.DAT
 
-void most_popular_tweet_content(MostPopularTweet& mpt, Network& network) {
+void most_popular_tweet_content(MostPopularTweet& mpt, Network& network, const string& output_dir) {
     int id;
     ofstream output;
-    output.open("output/most_popular_tweet_content.dat");
+    output.open(output_dir + "/most_popular_tweet_content.dat");
     Tweet& t = mpt.most_popular_tweet;
     id = t.id_tweeter;
     Agent& a = network[id];
@@ -837,16 +877,18 @@ void most_popular_tweet_content(MostPopularTweet& mpt, Network& network) {
            << "Tweet Language:\t" << t.content->language << "\n"
            << "Tweet Type:\t" << t.content->type << "\n"
            << "Hashtag Present:\t" << std::boolalpha << t.hashtag << "\n"
-           << "Number of Retweeters:\t" << t.content->used_agents.size() << "\n";
+           << "Number of Retweeters:\t" << t.content->used_agents.size() << "\n"
+           << "Cascade Depth:\t" << t.content->cascade.max_depth() << "\n"
+           << "Cascade Breadth:\t" << t.content->cascade.max_breadth() << "\n";
 
     output.close();
 }
 
 // RETWEET_VIZ.GEXF
 
-void visualize_most_popular_tweet(MostPopularTweet& mpt, Network& network) {
+void visualize_most_popular_tweet(MostPopularTweet& mpt, Network& network, const string& output_dir) {
     ofstream output;
-    output.open("output/retweet_viz.gexf");
+    output.open(output_dir + "/retweet_viz.gexf");
     Tweet& t = mpt.most_popular_tweet;
     if (!t.content.get()) {
         return; // Nothing to see here
@@ -860,33 +902,26 @@ void visualize_most_popular_tweet(MostPopularTweet& mpt, Network& network) {
             << "<graph mode=\"static\" defaultedgetype=\"directed\">\n"
             << "<nodes>\n";
             
-    UsedAgents& used_set = t.content->used_agents;
-    for (int id_used : used_set.as_vector()) {
-        output << "<node id=\"" << id_used << "\" label=\"" << "Retweeters" << "\">\n";
-        output << "<viz:size value=\"2.5\"/>\n";
-        output << "</node>\n";
-        for (int id_fol : network.follower_set(id_used).as_vector()) {
-            output << "<node id=\"" << id_fol << "\" label=\"" << "Non-Retweeters" << "\" >\n";
-            output << "<viz:size value=\"2.0\"/>\n";
-            output << "</node>\n";
+    // The retweet cascade: an agent appears once, and an edge goes from each tweeter to its retweeters
+    const TweetCascade& cascade = t.content->cascade;
+    std::set<int> drawn;
+    for (int i = 0; i < cascade.size(); i++) {
+        int id = cascade.node(i).id_tweeter;
+        if (!drawn.insert(id).second) {
+            continue;
         }
+        bool is_root = (cascade.node(i).parent == -1);
+        output << "<node id=\"" << id << "\" label=\"" << (is_root ? "Main-Tweeter" : "Retweeters") << "\">\n";
+        output << "<viz:size value=\"" << (is_root ? "3.0" : "2.5") << "\"/>\n";
+        output << "</node>\n";
     }
-    output << "<node id=\"" << t.id_tweeter << "\" label=\"" << "Main-Tweeter" << "\" >\n";
-    output << "<viz:size value=\"3.0\"/>\n";
-    output << "</node>\n";
-    int count = 0;
     output << "</nodes>\n" << "<edges>\n";
 
-    for (int id : network.follower_set(t.id_tweeter).as_vector()) {
-        output << "<edge id=\"" << count << "\" source=\"" << id
-                << "\" target=\"" << t.id_tweeter << "\"/>\n";
-        count ++;
-    }
-    for (int id_used : used_set.as_vector()) {
-        for (int id_fol : network.follower_set(id_used).as_vector()) {
-            output << "<edge id=\"" << count << "\" source=\"" << id_fol
-                    << "\" target=\"" << id_used << "\"/>\n";
-            count ++;
+    for (int i = 0; i < cascade.size(); i++) {
+        const TweetCascade::Node& node = cascade.node(i);
+        if (node.parent != -1) {
+            output << "<edge id=\"" << i << "\" source=\"" << cascade.node(node.parent).id_tweeter
+                    << "\" target=\"" << node.id_tweeter << "\"/>\n";
         }
     }
     output << "</edges>\n" << "</graph>\n" << "</gexf>";
@@ -895,9 +930,9 @@ void visualize_most_popular_tweet(MostPopularTweet& mpt, Network& network) {
 
 // MAIN_STATS.DAT
 
-void network_statistics(Network& n, NetworkStats& net_stats, AgentTypeVector& etv) {
+void network_statistics(Network& n, NetworkStats& net_stats, AgentTypeVector& etv, const string& output_dir) {
     ofstream output;
-    output.open("output/main_stats.dat");
+    output.open(output_dir + "/main_stats.dat");
     output << "--------------------\n| MAIN NETWORK STATS |\n--------------------\n\n";
     output << "USERS\n_____\n\n";
     output << "Total:\t\t" << n.size() << "\n";
@@ -965,9 +1000,8 @@ bool region_stats(Network& n, AnalysisState& state) {
     holder region_self[N_BIN_REGIONS];
     int connections[N_BIN_REGIONS][N_BIN_REGIONS] = {};
     ofstream output;
-    char out[100];
-    sprintf(out, "output/region_connection_matrix_month_%03d.dat", state.n_months());
-    output.open(((string) out).c_str());
+    string out = format("%s/region_connection_matrix_month_%03d.dat", state.config.output_directory.c_str(), state.n_months());
+    output.open(out.c_str());
     
     for (int i = 0; i < n.size(); i++) {
         Agent& e = n[i];
@@ -1027,7 +1061,7 @@ void fraction_of_connections_distro(Network& network, AnalysisState& state, Netw
         
     } 
     ofstream output;
-    output.open("output/connections_vs_nodes.dat");
+    output.open(state.config.output_directory + "/connections_vs_nodes.dat");
     for (int i = 0; i < bin_grid; i ++) {
         output << i / (double)bin_grid << "\t" << (double)agent_counts[i] / (double)network.size() << "\t" << log(i / (double)bin_grid) << "\t" << log((double)agent_counts[i] / (double)network.size()) << "\n";
     }
@@ -1089,7 +1123,7 @@ void dd_by_age(Network& n, AnalysisState& as, NetworkStats& ns) {
         count ++;
     }
     ofstream output;
-    output.open("output/dd_by_year.dat");
+    output.open(as.config.output_directory + "/dd_by_year.dat");
 
     for (int i = 0; i < max_degree; i ++) {
         output << i << "\t" << log(i);
@@ -1133,7 +1167,7 @@ void dd_by_agent(Network& n, AnalysisState& as, NetworkStats& ns) {
     }
     
     ofstream output;
-    output.open("output/dd_by_agent_type.dat");
+    output.open(as.config.output_directory + "/dd_by_agent_type.dat");
     
     for (int i = 0; i < agent_types.size(); i ++) {
         output << "# Agent type: " << i << "  Size: " << agent_types[i].agent_ids.size() << "\n";
@@ -1183,7 +1217,7 @@ void dd_by_follow_method(Network& n, AnalysisState& as, NetworkStats& ns) {
     }
     
     ofstream output;
-    output.open("output/dd_by_follow_model.dat");
+    output.open(as.config.output_directory + "/dd_by_follow_model.dat");
     
     output << "This is the degree distribution by follow model. The data order is:\n- degree\n- log_of_degree\n- Random-normalized_probability\n- Random-log_of_normalized_probability"
     "\n- Twitter_Suggest-normalized_probability\n- Twitter_Suggest-log_of_normalized_probability"
@@ -26,32 +26,34 @@
 #define __IO_H_
 
 #include <fstream>
+#include <string>
 
 #include "analyzer.h"
 #include "network.h"
 
 
-void output_position(Network& network, int end_time);
+void output_position(Network& network, int end_time, const std::string& output_dir);
 void brief_agent_statistics(AnalysisState& state);
 void output_network_statistics(AnalysisState& state);
 
 int factorial(int input_number);
-void Categories_Check(CategoryGrouper& tweeting, CategoryGrouper& following, CategoryGrouper& retweeting);
-void agent_statistics(Network& network,int n_follows, int n_agents, int max_agents, AgentType* agenttype);
-void tweets_distribution(Network& network, int n_users);
+void Categories_Check(CategoryGrouper& tweeting, CategoryGrouper& following, CategoryGrouper& retweeting, const std::string& output_dir);
+void agent_statistics(Network& network,int n_follows, int n_agents, int max_agents, AgentType* agenttype, const std::string& output_dir);
+void tweets_distribution(Network& network, int n_users, const std::string& output_dir);
 int rand_int(int max);
 void degree_distributions(Network& network, AnalysisState& state);
 bool quick_rate_check(AgentTypeVector& ets, double& correct_val, int& i, int& j);
 bool agent_checks(AgentTypeVector& ets, Network& network, AnalysisState& state, Add_Rates& add_rates, int& initial_agents);
-void whos_following_who(AgentTypeVector& ets, Network& network);
-void visualize_most_popular_tweet(MostPopularTweet& mpt, Network& network);
-void network_statistics(Network& n, NetworkStats& stats, AgentTypeVector& etv);
+void whos_following_who(AgentTypeVector& ets, Network& network, const std::string& output_dir);
+void visualize_most_popular_tweet(MostPopularTweet& mpt, Network& network, const std::string& output_dir);
+void network_statistics(Network& n, NetworkStats& stats, AgentTypeVector& etv, const std::string& output_dir);
 bool region_stats(Network& n, AnalysisState& state);
 void fraction_of_connections_distro(Network& network, AnalysisState& state, NetworkStats& net_stats);
 void dd_by_age(Network& n, AnalysisState& as, NetworkStats& ns);
 void dd_by_agent(Network& n, AnalysisState& as, NetworkStats& ns);
 void dd_by_follow_method(Network& n, AnalysisState& as, NetworkStats& ns);
-void most_popular_tweet_content(MostPopularTweet& mpt, Network& network);
-void tweet_info(std::vector<Tweet>&);
+void most_popular_tweet_content(MostPopularTweet& mpt, Network& network, const std::string& output_dir);
+void tweet_info(TweetLog& old_tweets, const std::string& output_dir);
+void cascade_statistics(AnalysisState& state, const std::string& output_dir);
 void n_agents_in_regions(Network& n);
 #endif
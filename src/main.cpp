@@ -29,6 +29,8 @@
 #include <sstream>
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <algorithm>
 
 #include "dependencies/ini.h"
 #include "dependencies/UnitTest++.h"
@@ -43,6 +45,7 @@
 #include "network.h"
 #include "analyzer.h"
 #include "io.h"
+#include "ensemble.h"
 
 using namespace std;
 
@@ -68,6 +71,7 @@ const char* get_var_arg(int argc, char** argv, std::string test, const char* def
 
 //** we avoid creating a header by pasting the 'test_main' prototype here:
 int test_main(int argc, char** argv); // Defined in tests/main.cpp
+int edge_set_benchmark_main(int argc, char** argv); // Defined in edge_set_benchmark.cpp
 
 int main(int argc, char** argv) {
 #ifndef __sun
@@ -85,6 +89,8 @@ int main(int argc, char** argv) {
 	if (has_flag(argc, argv, "--tests")) {
 		// running tests:
 		return test_main(argc, argv);
+	} else if (has_flag(argc, argv, "--benchmark-edge-sets")) {
+		return edge_set_benchmark_main(argc, argv);
 	} else {
 	    printf("Starting #k@ network simulator (version %s)\n", HASHKAT_VERSION);
 	    // NOTE: We rely on hashkat_pre.py to create a -generated version of our input file!
@@ -105,16 +111,23 @@ int main(int argc, char** argv) {
         }
 
 
-        printf("Starting simulation with seed '%d'.\n", seed);
-        AnalysisState analysis_state(config, seed);
-
-        analyzer_main(analysis_state);
-        output_network_statistics(analysis_state);
-
-#ifdef REFACTORING
-        std::ofstream out("output/network_refactoring.dat");
-        analysis_state.network.print(out);
-#endif  // REFACTORING
+        // Run many seeds of the same configuration in this process?
+        int n_replicas = std::stoi(get_var_arg(argc, argv, "--ensemble", "0"));
+        if (n_replicas > 0) {
+            int n_threads = std::stoi(get_var_arg(argc, argv, "--threads", "0"));
+            if (n_threads <= 0) {
+                n_threads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            printf("Starting ensemble of %d simulations with seeds '%d' to '%d', using %d threads.\n",
+                    n_replicas, seed, seed + n_replicas - 1, n_threads);
+            ensemble_main(config, seed, n_replicas, n_threads);
+        } else {
+            printf("Starting simulation with seed '%d'.\n", seed);
+            AnalysisState analysis_state(config, seed);
+
+            analyzer_main(analysis_state);
+            output_network_statistics(analysis_state);
+        }
 
         printf("Analysis took %.2fms.\n", t.get_microseconds() / 1000.0);
 
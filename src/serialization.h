@@ -43,6 +43,14 @@
 
 #define NVP CEREAL_NVP
 
+/* The layout of a saved network state, written ahead of everything else.
+ * Bump this whenever the serialized state changes, so that a network state
+ * saved by another version is rejected instead of misread.
+ *  1: the unversioned layout of the MTwist releases, never written with a number
+ *  2: the named random streams, and the tweet storage built on them
+ *  3: the retweeter Bloom filter grown in slices */
+const int NETWORK_STATE_FORMAT_VERSION = 3;
+
 struct AnalysisState;
 
 template <typename Archive>
@@ -1,3 +1,6 @@
+#include <mutex>
+#include <type_traits>
+
 #include "tweets.h"
 #include "analyzer.h"
 
@@ -26,12 +29,90 @@ void Tweet::api_serialize(cereal::JSONOutputArchive& ar) {
 }
 
 int HashTags::select_agent(AnalysisState& state, bool region_choice, bool ideology_choice, int default_region, int default_ideology) {
-    int region_bin = choose_bin(state.rng, region_choice, default_region, state.config.regions.size());
-    int ideology_bin = choose_bin(state.rng, ideology_choice, default_ideology, state.config.ideologies.size());
+    int region_bin = choose_bin(state.rng.follow, region_choice, default_region, state.config.regions.size());
+    int ideology_bin = choose_bin(state.rng.follow, ideology_choice, default_ideology, state.config.ideologies.size());
     if (!hashtag_groups[ideology_bin][region_bin].circ_buffer.empty()) {
-        int agent_to_follow = hashtag_groups[ideology_bin][region_bin].circ_buffer.pick_random_uniform(state.rng);
+        int agent_to_follow = hashtag_groups[ideology_bin][region_bin].circ_buffer.pick_random_uniform(state.rng.follow);
         return agent_to_follow;
     }
     return -1;
 }
 
+
+/*****************************************************************************
+ * TweetContent pool
+ *****************************************************************************/
+
+typedef std::aligned_storage<sizeof(TweetContent), alignof(TweetContent)>::type ContentBlock;
+// The number of contents allocated at once
+const int CONTENT_CHUNK_SIZE = 256;
+
+// The chunks are never released, so that a content can be recycled by a
+// thread other than the one that made it, and outlive that thread.
+// Threads leave their free blocks in the reserve when they exit.
+static std::mutex content_reserve_mutex;
+static std::vector<ContentBlock*>& content_reserve() {
+    static std::vector<ContentBlock*>* reserve = new std::vector<ContentBlock*>();
+    return *reserve;
+}
+
+struct ContentPool {
+    std::vector<ContentBlock*> free_blocks;
+
+    ContentBlock* alloc() {
+        if (free_blocks.empty()) {
+            refill();
+        }
+        ContentBlock* block = free_blocks.back();
+        free_blocks.pop_back();
+        return block;
+    }
+    void refill() {
+        std::lock_guard<std::mutex> lock(content_reserve_mutex);
+        std::vector<ContentBlock*>& reserve = content_reserve();
+        if (!reserve.empty()) {
+            free_blocks.swap(reserve);
+            return;
+        }
+        ContentBlock* chunk = new ContentBlock[CONTENT_CHUNK_SIZE];
+        for (int i = CONTENT_CHUNK_SIZE - 1; i >= 0; i--) {
+            free_blocks.push_back(&chunk[i]);
+        }
+    }
+    ~ContentPool();
+};
+
+static thread_local ContentPool content_pool;
+// Contents dropped during thread exit, after content_pool is gone, go to the reserve
+static thread_local bool content_pool_gone = false;
+
+ContentPool::~ContentPool() {
+    std::lock_guard<std::mutex> lock(content_reserve_mutex);
+    std::vector<ContentBlock*>& reserve = content_reserve();
+    reserve.insert(reserve.end(), free_blocks.begin(), free_blocks.end());
+    content_pool_gone = true;
+}
+
+TweetContentRef TweetContentRef::make() {
+    return TweetContentRef(new (content_pool.alloc()) TweetContent());
+}
+
+TweetContentRef TweetContentRef::make(const TweetContent& content) {
+    TweetContent* copy = new (content_pool.alloc()) TweetContent(content);
+    copy->n_refs = 0;
+    return TweetContentRef(copy);
+}
+
+void TweetContentRef::recycle(TweetContent* content) {
+    if (content->cascade.sink != NULL) {
+        content->cascade.sink->add(content->cascade);
+    }
+    content->~TweetContent();
+    ContentBlock* block = reinterpret_cast<ContentBlock*>(content);
+    if (content_pool_gone) {
+        std::lock_guard<std::mutex> lock(content_reserve_mutex);
+        content_reserve().push_back(block);
+    } else {
+        content_pool.free_blocks.push_back(block);
+    }
+}
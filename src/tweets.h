@@ -29,7 +29,7 @@
 #include <cstdio>
 #include <memory>
 
-#include "mtwist.h"
+#include "RandomStreams.h"
 
 #include "events.h"
 #include "CircularBuffer.h"
@@ -37,8 +37,10 @@
 #include "serialization.h"
 
 #include "FollowerSet.h"
+#include "util/UsedAgentSet.h"
+#include "TweetCascade.h"
 
-typedef HashedEdgeSet<int> UsedAgents;
+typedef UsedAgentSet UsedAgents;
 
 // information for when a user tweets
 struct TweetContent {
@@ -50,6 +52,17 @@ struct TweetContent {
     int hashtag_bin = -1;
     int id_original_author = -1; // The agent that created the original content
     UsedAgents used_agents;
+    // The tweets of this content and whom they retweeted
+    TweetCascade cascade;
+    // The number of TweetContentRefs to this content, not serialized
+    int n_refs = 0;
+    // With region partitions, the retweeters held by the copies of this content in the
+    // other partitions, as of the last window boundary. Not serialized
+    int n_remote_retweeters = 0;
+
+    int n_retweeters() const {
+        return used_agents.size() + n_remote_retweeters;
+    }
 
     template <typename Archive>
     void serialize(Archive& ar) {
@@ -59,7 +72,97 @@ struct TweetContent {
 
         // Save/load used_agents:
         ar(NVP(used_agents));
+        ar(NVP(cascade));
+    }
+};
+
+/* A reference-counted TweetContent. Contents are allocated from a pool kept
+ * per thread, and go back to it when the last reference is dropped. The count
+ * is not atomic: a content must only be referenced from one thread at a time,
+ * which holds for the states of an ensemble and for the region partitions,
+ * which exchange contents only between windows. */
+class TweetContentRef {
+public:
+    TweetContentRef() : ptr(NULL) {
+    }
+    // A new content, default-constructed or copied from 'content'
+    static TweetContentRef make();
+    static TweetContentRef make(const TweetContent& content);
+
+    TweetContentRef(const TweetContentRef& o) : ptr(o.ptr) {
+        retain();
+    }
+    TweetContentRef(TweetContentRef&& o) : ptr(o.ptr) {
+        o.ptr = NULL;
+    }
+    TweetContentRef& operator=(TweetContentRef o) {
+        std::swap(ptr, o.ptr);
+        return *this;
+    }
+    ~TweetContentRef() {
+        reset();
+    }
+
+    void reset() {
+        if (ptr != NULL && --ptr->n_refs == 0) {
+            recycle(ptr);
+        }
+        ptr = NULL;
+    }
+
+    TweetContent* get() const {
+        return ptr;
+    }
+    TweetContent* operator->() const {
+        return ptr;
     }
+    TweetContent& operator*() const {
+        return *ptr;
+    }
+    explicit operator bool() const {
+        return ptr != NULL;
+    }
+    bool operator==(const TweetContentRef& o) const {
+        return ptr == o.ptr;
+    }
+    bool operator!=(const TweetContentRef& o) const {
+        return ptr != o.ptr;
+    }
+
+    // Like a std::shared_ptr, a content referred to several times is only stored once per archive
+    template <typename Archive>
+    void save(Archive& ar) const {
+        std::uint32_t id = ar.registerSharedPointer(ptr);
+        ar(cereal::make_nvp("id", id));
+        if (id & cereal::detail::msb_32bit) {
+            ar(cereal::make_nvp("data", *ptr));
+        }
+    }
+    template <typename Archive>
+    void load(Archive& ar) {
+        std::uint32_t id = 0;
+        ar(cereal::make_nvp("id", id));
+        if (id & cereal::detail::msb_32bit) {
+            *this = make();
+            ar(cereal::make_nvp("data", *ptr));
+            // The archive only looks the content up; the no-op deleter leaves it to the refs
+            ar.registerSharedPointer(id, std::shared_ptr<void>(ptr, [](void*) {}));
+        } else {
+            *this = TweetContentRef(static_cast<TweetContent*>(ar.getSharedPointer(id).get()));
+        }
+    }
+private:
+    explicit TweetContentRef(TweetContent* ptr) : ptr(ptr) {
+        retain();
+    }
+    void retain() {
+        if (ptr != NULL) {
+            ptr->n_refs++;
+        }
+    }
+    static void recycle(TweetContent* content);
+
+    TweetContent* ptr;
 };
 
 // Represents a tweet, either original, or a rebroadcast.
@@ -74,8 +177,10 @@ struct Tweet {
     int id_link = -1;
     // The generation of the tweet, 0 if the tweet was original content
     int generation = -1;
+    // The node of the tweet in its content's cascade
+    int cascade_node = -1;
     // A tweet is an orignal tweet if tweeter_id == content.author_id
-    std::shared_ptr<TweetContent> content;
+    TweetContentRef content;
 
     // The time the tweet was tweeted
     double creation_time = 0;
@@ -95,7 +200,7 @@ struct Tweet {
     /* Rates with which this tweet is retweeted: */
     FollowerSet::Weights react_weights;
 
-    explicit Tweet(const std::shared_ptr<TweetContent>& content = {}) {
+    explicit Tweet(const TweetContentRef& content = TweetContentRef()) {
         this->content = content;
     }
 
@@ -109,10 +214,9 @@ struct Tweet {
 
     template <typename Archive>
     void serialize(Archive& ar) {
-        ar(NVP(id_tweet), NVP(id_tweeter), NVP(id_link), NVP(generation));
+        ar(NVP(id_tweet), NVP(id_tweeter), NVP(id_link), NVP(generation), NVP(cascade_node));
         ar(NVP(content));
         ar(NVP(creation_time), NVP(deletion_time), NVP(retweet_time_bin), NVP(hashtag), NVP(retweet_next_rebin_time));
-        // NOTE: Relies on FollowerSet::Weights being a 'plain' (pointer-free) object!
         ar(NVP(react_weights));
     }
 };
@@ -145,7 +249,7 @@ struct HashTags {
     // this is the set of bins for idealogies and regions
     HashtagGroup hashtag_groups[N_BIN_IDEOLOGIES][N_BIN_REGIONS];
 
-    int choose_bin(MTwist& rng, bool choice, int default_bin, const int n_choices) {
+    int choose_bin(RandomStream& rng, bool choice, int default_bin, const int n_choices) {
         if (!choice) {
             return rng.rand_int((int) n_choices);
         }
@@ -1,11 +1,15 @@
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <sstream>
 
 #include "tests.h"
 
 #include "tweets.h"
 #include "RateTree.h"
+#include "AgentActivity.h"
+#include "TweetStore.h"
+#include "TweetLog.h"
 
 using namespace std;
 
@@ -23,21 +27,18 @@ SUITE(TweetStore) {
     typedef RateTree<RateV, 1> Tree;
 
     static void basic_check(Tree& vec_tree) {
-        std::vector<Tree::Node*> vec = vec_tree.as_node_vector();
+        std::vector<Tree::Leaf*> vec = vec_tree.as_leaf_vector();
     CHECK_EQUAL(vec.size(), vec_tree.size());
         double sum = vec_tree.rate_summary().tuple_sum;
         double alt_sum = 0.0;
         for (int i = 0; i < vec.size(); i++) {
-            CHECK(vec[i]->is_leaf);
-            CHECK(vec[i]->depth > 0);
-            CHECK(vec[i]->is_allocated);
             alt_sum += vec[i]->rates.tuple_sum;
         }
         CHECK(sum == alt_sum);
     }
 
     TEST(RateTree) {
-        MTwist rng;
+        RandomStream rng;
         RateVec<1> vec;
         Tree vec_tree;
         vec.tuple[0] = 1.0;
@@ -48,6 +49,7 @@ SUITE(TweetStore) {
             for (int i = 0; i < 9001; i++) {
                 int elem = vec_tree.add(i, vec);
                 basic_check(vec_tree);
+                CHECK(vec_tree.depth(elem) > 0);
                 if (i % 2 == 0) {
                     elemsA.push_back(elem);
                 } else {
@@ -72,4 +74,151 @@ SUITE(TweetStore) {
             }
         }
     }
+
+    TEST(RateTreePickWeighted) {
+        typedef RateTree<RateV, 1, 4> Tree4;
+        Tree4 vec_tree;
+        std::vector<int> elems;
+        // Rates 1, 2, ..., 10, with the element for rate 5 removed again
+        for (int i = 1; i <= 10; i++) {
+            elems.push_back(vec_tree.add(i, RateVec<1>(i)));
+        }
+        vec_tree.remove(elems[4]);
+        vec_tree.replace_rate(elems[0], RateVec<1>(0.0));
+        // Walking the leaves in tree order, every number falls in the expected one:
+        std::vector<Tree4::Leaf*> leaves = vec_tree.as_leaf_vector();
+        double below = 0.0;
+        for (int i = 0; i < leaves.size(); i++) {
+            double rate = leaves[i]->rates.tuple_sum;
+            if (rate == 0.0) {
+                continue;
+            }
+            double num = below + rate / 2;
+            int picked = vec_tree.pick_weighted(num);
+            CHECK_EQUAL(leaves[i]->data.val, vec_tree.get(picked).data.val);
+            CHECK_CLOSE(rate / 2, num, 1e-12);
+            below += rate;
+        }
+        CHECK_EQUAL(55.0 - 5.0 - 1.0, below);
+    }
+
+    // Each channel selects agents in proportion to its own rates, also after they change
+    TEST(AgentActivity) {
+        AgentActivity activity;
+        for (int agent = 0; agent < 10; agent++) {
+            activity.set_rates(agent, agent, 10 - agent);
+        }
+        activity.set_rates(3, 0.0, 1.0);
+        CHECK_EQUAL(45.0 - 3.0, activity.follow_rate());
+        CHECK_EQUAL(55.0 - 7.0 + 1.0, activity.tweet_rate());
+        // Sweeping the follow rate finely, each agent takes up a stretch of its own rate
+        const double step = 0.01;
+        std::vector<double> measure(10, 0.0);
+        for (double num = step / 2; num < activity.follow_rate(); num += step) {
+            measure[activity.pick_follow(num)] += step;
+        }
+        for (int agent = 0; agent < 10; agent++) {
+            double rate = (agent == 3) ? 0.0 : agent;
+            CHECK_CLOSE(rate, measure[agent], 2 * step);
+        }
+        CHECK(within_range(activity.pick_tweet(activity.tweet_rate() / 2), 0, 10));
+        CHECK_EQUAL(10, (int) activity.size());
+    }
+
+    TEST(TweetStoreSlots) {
+        TweetStore store;
+        vector<tweet_ref_t> refs;
+        vector<Tweet*> addresses;
+        for (int i = 0; i < 1000; i++) {
+            refs.push_back(store.alloc());
+            store.get(refs[i]).id_tweet = i;
+            addresses.push_back(&store.get(refs[i]));
+        }
+        // Growing does not move the tweets
+        for (int i = 0; i < 1000; i++) {
+            CHECK(&store.get(refs[i]) == addresses[i]);
+            CHECK_EQUAL(i, store.get(refs[i]).id_tweet);
+        }
+        // Freed slots are reused, and come back cleared
+        store.free(refs[10]);
+        CHECK_EQUAL(999, (int) store.size());
+        tweet_ref_t reused = store.alloc();
+        CHECK(reused == refs[10]);
+        CHECK_EQUAL(-1, store.get(reused).id_tweet);
+        CHECK_EQUAL(1000, (int) store.capacity());
+    }
+
+    TEST(TweetCascade) {
+        CascadeStats stats;
+        {
+            TweetContentRef content = TweetContentRef::make();
+            content->cascade.sink = &stats;
+            TweetCascade& cascade = content->cascade;
+            int root = cascade.append(-1, 7);
+            int a = cascade.append(root, 8), b = cascade.append(root, 9);
+            int c = cascade.append(b, 10);
+            CHECK_EQUAL(9, cascade.node(cascade.node(c).parent).id_tweeter);
+            CHECK_EQUAL(2, cascade.node(c).depth);
+            CHECK_EQUAL(1, cascade.node(a).depth);
+            CHECK_EQUAL(2, cascade.max_depth());
+            CHECK_EQUAL(2, cascade.max_breadth());
+            // A copy continues separately
+            TweetContentRef copy = TweetContentRef::make(*content);
+            copy->cascade.append(c, 11);
+            CHECK_EQUAL(4, cascade.size());
+            CHECK_EQUAL(0, (int) stats.n_cascades);
+        }
+        // Both were counted when released
+        CHECK_EQUAL(2, (int) stats.n_cascades);
+        CHECK_EQUAL(9, (int) stats.total_size);
+        CHECK_EQUAL(3, stats.max_depth);
+        CHECK_EQUAL(2, (int) stats.size_bins[2]); // Sizes 4 and 5
+    }
+
+    static void append_tweets(TweetLog& log, int first, int last) {
+        Tweet tweet;
+        tweet.content = TweetContentRef::make();
+        for (int i = first; i < last; i++) {
+            tweet.id_tweet = i;
+            tweet.deletion_time = i;
+            log.append(tweet);
+        }
+    }
+
+    static vector<int> logged_ids(TweetLog& log) {
+        vector<int> ids;
+        log.for_each([&](const TweetRecord& record) {
+            ids.push_back(record.id_tweet);
+        });
+        return ids;
+    }
+
+    // A loaded log drops whatever was written after the save, and continues from there
+    TEST(TweetLogResume) {
+        const char* path = "output/test_tweet_log.dat";
+        std::stringstream saved;
+        {
+            TweetLog log;
+            log.open(path);
+            append_tweets(log, 0, 5000); // A full block, and part of another
+            cereal::BinaryOutputArchive ar(saved);
+            log.save(ar);
+            append_tweets(log, 5000, 12000);
+            log.flush();
+            CHECK_EQUAL(12000, (int) log.size());
+        }
+        TweetLog log;
+        log.open(path);
+        cereal::BinaryInputArchive ar(saved);
+        log.load(ar);
+        CHECK_EQUAL(5000, (int) log.size());
+        // The new records directly follow the saved ones
+        append_tweets(log, 20000, 20100);
+        vector<int> ids = logged_ids(log);
+        CHECK_EQUAL(5100, (int) ids.size());
+        for (int i = 0; i < ids.size(); i++) {
+            CHECK_EQUAL(i < 5000 ? i : 20000 + i - 5000, ids[i]);
+        }
+        log.discard();
+    }
 }
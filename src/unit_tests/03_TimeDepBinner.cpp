@@ -63,4 +63,26 @@ SUITE(TimeDepBinner) {
         CHECK((int)binner.size() == 0);
     }
 
+
+    TEST(ring_queue) {
+        RingQueue<int> queue;
+        int next_in = 0, next_out = 0;
+        // Interleave pushes and pops so that the buffer wraps around as it grows
+        for (int round = 1; round <= 50; round++) {
+            for (int i = 0; i < round; i++) {
+                queue.push_back(next_in++);
+            }
+            for (int i = 0; i < round / 2; i++) {
+                CHECK(queue.front() == next_out++);
+                queue.pop_front();
+            }
+            CHECK((int)queue.size() == next_in - next_out);
+            CHECK(queue[queue.size() - 1] == next_in - 1);
+        }
+        while (!queue.empty()) {
+            CHECK(queue.front() == next_out++);
+            queue.pop_front();
+        }
+        CHECK(next_out == next_in);
+    }
 }
@@ -0,0 +1,132 @@
+#include <set>
+#include <vector>
+#include <algorithm>
+
+#include "tests.h"
+
+#include "util/DenseEdgeSet.h"
+#include "util/SmallEdgeSet.h"
+#include "util/UsedAgentSet.h"
+#include "EndpointPool.h"
+
+using namespace std;
+
+SUITE(EdgeSets) {
+    // Follow and unfollow at random, checking against std::set throughout
+    template <typename EdgeSet>
+    static void churn_check(int max_id) {
+        RandomStream rng(1, 0);
+        EdgeSet edges;
+        std::set<int> reference;
+        for (int i = 0; i < 20000; i++) {
+            int id = rng.rand_int(max_id);
+            if (rng.random_chance(0.5)) {
+                CHECK_EQUAL(reference.insert(id).second, edges.insert(id));
+            } else {
+                CHECK_EQUAL(reference.erase(id) > 0, edges.erase(id));
+            }
+            CHECK_EQUAL(reference.size(), edges.size());
+            int picked = -1;
+            if (edges.pick_random_uniform(rng, picked)) {
+                CHECK(reference.count(picked));
+            } else {
+                CHECK(reference.empty());
+            }
+        }
+        vector<int> elems = edges.as_vector();
+        sort(elems.begin(), elems.end());
+        CHECK(elems == vector<int>(reference.begin(), reference.end()));
+    }
+
+    TEST(DenseEdgeSet) {
+        churn_check<DenseEdgeSet<int>>(100);
+    }
+
+    TEST(SmallEdgeSet) {
+        // Crosses the inline limit back and forth:
+        churn_check<SmallEdgeSet<int>>(10);
+        churn_check<SmallEdgeSet<int>>(100);
+    }
+
+    TEST(UsedAgentSet) {
+        RandomStream rng(3, 0);
+        UsedAgentSet used;
+        std::set<int> reference;
+        for (int i = 0; i < 20000; i++) {
+            // Mostly one dense group of ids, so that it becomes a bitmap, and a few scattered ones
+            int id = rng.random_chance(0.9) ? rng.rand_int(8000) : rng.rand_int(1 << 30);
+            CHECK_EQUAL(reference.count(id) > 0, used.contains(id));
+            CHECK_EQUAL(reference.insert(id).second, used.insert(id));
+            CHECK_EQUAL(reference.size(), used.size());
+        }
+        UsedAgentSet copy = used;
+        CHECK(copy.as_vector() == vector<int>(reference.begin(), reference.end()));
+
+        // Approximate: exact while that is smaller than the filter
+        UsedAgentSet approx;
+        approx.set_approximate(true);
+        vector<int> inserted;
+        for (int id = 0; id < 1000; id++) {
+            CHECK(approx.insert(id * 7));
+            inserted.push_back(id * 7);
+        }
+        CHECK(!approx.contains(3));
+        CHECK(approx.as_vector() == inserted);
+        // Then never inserts twice, and refuses few new elements
+        for (int id = 1000; id < 2000; id++) {
+            approx.insert(id * 7);
+            CHECK(approx.contains(id * 7));
+            CHECK(!approx.insert(id * 7));
+        }
+        CHECK(approx.size() <= 2000 && approx.size() > 2000 * 0.95);
+        CHECK(approx.as_vector().empty());
+        for (int id = 0; id < 1000; id++) {
+            CHECK(approx.contains(id * 7));
+        }
+
+        // The filter grows with the set, so that its false positives stay under 1% at any size
+        UsedAgentSet large;
+        large.set_approximate(true);
+        int n_refused = 0;
+        for (int id = 0; id < 100000; id++) {
+            n_refused += !large.insert(id * 13);
+        }
+        CHECK(n_refused < 100000 * 0.01);
+        CHECK_EQUAL(100000 - n_refused, (int) large.size());
+        int n_false = 0;
+        for (int id = 0; id < 100000; id++) {
+            CHECK(large.contains(id * 13));
+            n_false += large.contains(id * 13 + 1);
+        }
+        CHECK(n_false < 100000 * 0.01);
+    }
+
+    // Add and remove endpoints at random, checking the picks against the counts
+    TEST(endpoint_pool) {
+        RandomStream rng(2, 0);
+        EndpointPool pool;
+        vector<int> counts(20, 0);
+        int total = 0;
+        for (int i = 0; i < 50000; i++) {
+            int agent = rng.rand_int(counts.size());
+            if (rng.random_chance(0.45)) {
+                CHECK_EQUAL(counts[agent] > 0, pool.remove(agent));
+                if (counts[agent] > 0) {
+                    counts[agent]--, total--;
+                }
+            } else {
+                pool.add(agent);
+                counts[agent]++, total++;
+            }
+        }
+        CHECK_EQUAL(total, (int)pool.size());
+        vector<int> picks(counts.size(), 0);
+        const int n_picks = 200000;
+        for (int i = 0; i < n_picks; i++) {
+            picks[pool.pick_random_uniform(rng)]++;
+        }
+        for (int i = 0; i < counts.size(); i++) {
+            CHECK_CLOSE(counts[i] / double(total), picks[i] / double(n_picks), 0.005);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#include <vector>
+
+#include "tests.h"
+
+#include "RandomStreams.h"
+#include "AliasTable.h"
+
+using namespace std;
+
+SUITE(RandomStreams) {
+    // Known-answer vectors of the Philox4x32-10 reference implementation
+    TEST(philox_known_answers) {
+        uint32_t zeros[4] = {0, 0, 0, 0};
+        uint32_t zero_key[2] = {0, 0};
+        philox::block(zeros, zero_key);
+        CHECK_EQUAL(0x6627e8d5u, zeros[0]);
+        CHECK_EQUAL(0xe169c58du, zeros[1]);
+        CHECK_EQUAL(0xbc57ac4cu, zeros[2]);
+        CHECK_EQUAL(0x9b00dbd8u, zeros[3]);
+
+        uint32_t ones[4] = {~0u, ~0u, ~0u, ~0u};
+        uint32_t ones_key[2] = {~0u, ~0u};
+        philox::block(ones, ones_key);
+        CHECK_EQUAL(0x408f276du, ones[0]);
+        CHECK_EQUAL(0x41c83b0eu, ones[1]);
+        CHECK_EQUAL(0xa20bc7c6u, ones[2]);
+        CHECK_EQUAL(0x6d5451fdu, ones[3]);
+    }
+
+    TEST(seek_and_independence) {
+        RandomStream a(7, STREAM_FOLLOW), b(7, STREAM_FOLLOW);
+        vector<uint32_t> words;
+        for (int i = 0; i < 11; i++) {
+            words.push_back(a.genrand_int32());
+        }
+        CHECK_EQUAL(11, (int)a.tell());
+        // Seeking anywhere reproduces the same words
+        b.seek(5);
+        for (int i = 5; i < 11; i++) {
+            CHECK_EQUAL(words[i], b.genrand_int32());
+        }
+        // Drawing from another stream or partition leaves the others alone
+        RandomStream other_stream(7, STREAM_TWEET), other_partition(7, STREAM_FOLLOW, 1);
+        CHECK(other_stream.genrand_int32() != words[0]);
+        CHECK(other_partition.genrand_int32() != words[0]);
+        b.seek(0);
+        CHECK_EQUAL(words[0], b.genrand_int32());
+    }
+
+    // The buffered (and vectorized) words match single Philox blocks, across buffer refills
+    TEST(buffered_words_match_blocks) {
+        uint32_t key[2] = {12345, STREAM_EVENTS};
+        RandomStream stream(key[0], key[1], 3);
+        stream.seek(37);
+        for (uint64_t pos = 37; pos < 1000; pos++) {
+            uint32_t ctr[4] = {(uint32_t)(pos / 4), 0, 3, 0};
+            philox::block(ctr, key);
+            CHECK_EQUAL(ctr[pos % 4], stream.genrand_int32());
+        }
+        CHECK_EQUAL(1000, (int)stream.tell());
+    }
+
+    // Alias table draws follow the weights, including zero weights
+    TEST(alias_table_frequencies) {
+        vector<double> weights = {0.5, 0, 2, 1, 0.25, 0.25};
+        AliasTable table(weights);
+        RandomStream rng(3, 0);
+        vector<int> counts(weights.size(), 0);
+        const int n = 400000;
+        for (int i = 0; i < n; i++) {
+            counts[table.pick(rng)]++;
+        }
+        CHECK_EQUAL(0, counts[1]);
+        for (int i = 0; i < weights.size(); i++) {
+            CHECK_CLOSE(weights[i] / 4.0, counts[i] / double(n), 0.005);
+        }
+    }
+}
@@ -0,0 +1,123 @@
+#include <vector>
+
+#include "tests.h"
+
+#include "CategoryGrouper.h"
+#include "util/FenwickTree.h"
+
+using namespace std;
+
+SUITE(CategoryGrouper) {
+    TEST(fenwick_find) {
+        FenwickTree<double> tree(vector<double> {1, 0, 2, 0, 0, 3, 1});
+        CHECK_EQUAL(7.0, tree.total());
+        CHECK_EQUAL(0, tree.find(0.5));
+        CHECK_EQUAL(2, tree.find(1.0)); // Skips the empty slot
+        CHECK_EQUAL(5, tree.find(3.5));
+        CHECK_EQUAL(6, tree.find(6.5));
+        CHECK_EQUAL(7, tree.find(7.0));
+        tree.add(1, 4);
+        CHECK_EQUAL(1, tree.find(1.0));
+        CHECK_EQUAL(4.0, tree.get(1));
+    }
+
+    // Move agents around at random, checking the weights and the picks
+    TEST(weighted_picks) {
+        CategoryGrouper grouper;
+        for (int i = 0; i < 10; i++) {
+            grouper.categories.push_back(CategoryAgentList(i, i + 1));
+        }
+        RandomStream rng(5, 0);
+        const int n_agents = 200;
+        vector<int> followers(n_agents, 0);
+        for (int step = 0; step < 20000; step++) {
+            int agent = rng.rand_int(n_agents);
+            followers[agent] = rng.rand_int(10);
+            grouper.categorize(agent, followers[agent]);
+        }
+        double total = 0;
+        for (int i = 0; i < 10; i++) {
+            total += grouper.weight(i);
+        }
+        CHECK_CLOSE(total, grouper.total_weight(), 1e-9);
+
+        vector<int> picks(10, 0);
+        const int n_picks = 200000;
+        for (int i = 0; i < n_picks; i++) {
+            int agent = grouper.pick_weighted_agent(rng);
+            picks[grouper.categorizations[agent].category]++;
+        }
+        for (int i = 0; i < 10; i++) {
+            CHECK_CLOSE(grouper.weight(i) / total, picks[i] / double(n_picks), 0.005);
+        }
+    }
+
+    // The first category whose threshold is at least 'parameter', as found by scanning
+    static int scan_category(CategoryGrouper& grouper, double parameter) {
+        for (int i = 0; i < grouper.categories.size(); i++) {
+            if (parameter <= grouper.categories[i].threshold) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // Step parameters by one and jump them at random, on evenly and unevenly spaced thresholds
+    TEST(incremental_categorize) {
+        vector<double> even, uneven;
+        for (int i = 0; i < 50; i++) {
+            even.push_back(3 + 2 * i);
+            uneven.push_back(i * i);
+        }
+        even.push_back(HUGE_VAL);
+        uneven.push_back(HUGE_VAL);
+        for (auto& thresholds : {even, uneven}) {
+            CategoryGrouper grouper;
+            for (double threshold : thresholds) {
+                grouper.categories.push_back(CategoryAgentList(threshold, 1));
+            }
+            RandomStream rng(7, 0);
+            const int n_agents = 100;
+            vector<double> params(n_agents, 0);
+            for (int step = 0; step < 20000; step++) {
+                int agent = rng.rand_int(n_agents);
+                if (rng.rand_int(10) == 0) {
+                    params[agent] = rng.rand_int(3000) - 5;
+                } else {
+                    params[agent] = std::max(0.0, params[agent] + (rng.rand_int(2) ? 1 : -1));
+                }
+                grouper.categorize(agent, params[agent]);
+                Cat& c = grouper.categorizations[agent];
+                CHECK_EQUAL(scan_category(grouper, params[agent]), c.category);
+                CHECK_EQUAL(agent, grouper.categories[c.category].agents[c.index]);
+            }
+        }
+    }
+
+    // A copy cleared of its agents starts from zero weight, as the partitions of parallel_regions do
+    TEST(clear_agents) {
+        CategoryGrouper grouper;
+        for (int i = 0; i < 5; i++) {
+            grouper.categories.push_back(CategoryAgentList(i, i + 1));
+        }
+        for (int agent = 0; agent < 50; agent++) {
+            grouper.categorize(agent, agent % 5);
+        }
+        CHECK_EQUAL(10.0 * (1 + 2 + 3 + 4 + 5), grouper.total_weight());
+
+        CategoryGrouper copy = grouper;
+        copy.clear_agents();
+        CHECK_EQUAL(0.0, copy.total_weight());
+        CHECK_EQUAL(0, (int) copy.categorizations.size());
+        copy.categorize(7, 4);
+        copy.categorize(8, 1);
+        CHECK_EQUAL(5.0 + 2.0, copy.total_weight());
+        RandomStream rng(3, 0);
+        for (int i = 0; i < 100; i++) {
+            int agent = copy.pick_weighted_agent(rng);
+            CHECK(agent == 7 || agent == 8);
+        }
+        // The original keeps its agents
+        CHECK_EQUAL(10, (int) grouper.categories[4].size());
+    }
+}
@@ -0,0 +1,275 @@
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+
+#include "tests.h"
+
+#include "config_dynamic.h"
+#include "analyzer.h"
+#include "analyzer_parallel.h"
+#include "TweetLog.h"
+
+using namespace std;
+
+SUITE(RegionPartitions) {
+
+    // The INFILE of the test directory, with agents spread over its regions, simulated in parallel
+    static ParsedConfig partitioned_config(bool use_barabasi, double add_rate = 0) {
+        ParsedConfig config = parse_yaml_configuration("INFILE.yaml-generated");
+        config.initial_agents = 300;
+        config.max_agents = 1000;
+        config.max_sim_time = 1000;
+        config.parallel_regions = true;
+        config.parallel_window = 10;
+        config.use_barabasi = use_barabasi;
+        config.barabasi_exponent = 1;
+        config.follow_model = use_barabasi ? TWITTER_PREFERENTIAL_FOLLOW : RANDOM_FOLLOW;
+        config.enable_lua_hooks = false;
+        config.enable_interactive_mode = false;
+        config.save_network_on_timeout = false;
+        config.output_stdout_basic = config.output_stdout_summary = false;
+        config.output_console = false;
+
+        config.regions.add_probs.assign(config.regions.size(), 1.0 / config.regions.size());
+        config.regions.add_sampler.build(config.regions.add_probs);
+        Rate_Function& add = config.add_rates.RF;
+        add.monthly_rates.assign(add.monthly_rates.size(), add_rate);
+        for (AgentType& type : config.agent_types) {
+            Rate_Function& follow = type.RF[0];
+            follow.monthly_rates.assign(follow.monthly_rates.size(), 0.01);
+        }
+        return config;
+    }
+
+    // Create the initial agents, then split them by region
+    static void begin_partitions(AnalysisState& state) {
+        analyzer_partition_init(state);
+        analyzer_parallel_begin(state);
+    }
+
+    // With no agents added, only the initial agents can be followed
+    TEST(barabasi_follows) {
+        AnalysisState state(partitioned_config(true), /*seed*/ 1);
+        begin_partitions(state);
+        int64 n_follows = state.stats.global_stats.n_follows;
+        for (int i = 0; i < 20; i++) {
+            analyzer_parallel_window(state);
+        }
+        CHECK(state.stats.global_stats.n_follows > n_follows);
+        analyzer_parallel_end(state);
+
+        // One pool entry per agent and per follower
+        size_t n_entries = 0;
+        for (Agent& agent : state.network) {
+            n_entries += agent.follower_set.size() + 1;
+        }
+        CHECK_EQUAL(n_entries, state.follow_endpoints.size());
+    }
+
+    // The agents held by 'grouper', checking that their categorizations and the weights agree with them
+    static vector<int> grouper_agents(CategoryGrouper& grouper) {
+        vector<int> agents;
+        double weight = 0;
+        for (int i = 0; i < grouper.categories.size(); i++) {
+            CategoryAgentList& C = grouper.categories[i];
+            for (int j = 0; j < C.size(); j++) {
+                Cat& c = grouper.categorizations.at(C[j]);
+                CHECK(c.category == i && c.index == j);
+                agents.push_back(C[j]);
+            }
+            weight += grouper.weight(i);
+        }
+        CHECK_CLOSE(weight, grouper.total_weight(), 1e-9 * (1 + weight));
+        sort(agents.begin(), agents.end());
+        return agents;
+    }
+
+    // The agents of 'type' in 'region', or in every region if -1
+    static vector<int> recount_agents(AnalysisState& state, int type, int region = -1) {
+        vector<int> agents;
+        for (Agent& agent : state.network) {
+            if ((type == -1 || agent.agent_type == type) && (region == -1 || agent.region_bin == region)) {
+                agents.push_back(agent.id);
+            }
+        }
+        return agents;
+    }
+
+    // Each partition holds the agents of its region, and the follows and the endpoint pools agree
+    static void check_partitions(AnalysisState& state) {
+        size_t n_entries = 0;
+        for (auto& partition : state.region_partitions->regions) {
+            AnalysisState& S = *partition->state;
+            int region = partition->region;
+            for (int type = 0; type < S.agent_types.size(); type++) {
+                CHECK(S.agent_types[type].agent_list == recount_agents(state, type, region));
+                CHECK(grouper_agents(S.agent_types[type].follow_ranks) == recount_agents(state, type, region));
+            }
+            CHECK(grouper_agents(S.follow_ranks) == recount_agents(state, -1, region));
+            for (int id : grouper_agents(S.tweet_ranks)) {
+                CHECK_EQUAL(region, state.network[id].region_bin);
+            }
+            n_entries += S.follow_endpoints.size();
+        }
+        size_t n_followers = 0;
+        for (Agent& agent : state.network) {
+            n_followers += agent.follower_set.size();
+        }
+        CHECK_EQUAL(state.network.size() + n_followers, n_entries);
+    }
+
+    // Partition a small network, run windows that create agents, merge it back and recount
+    TEST(partition_and_merge) {
+        AnalysisState state(partitioned_config(true, 0.5), /*seed*/ 2);
+        begin_partitions(state);
+        check_partitions(state);
+        for (int i = 0; i < 20; i++) {
+            analyzer_parallel_window(state);
+            check_partitions(state);
+        }
+        int n_agents = state.network.size();
+        CHECK(n_agents > state.config.initial_agents);
+        analyzer_parallel_end(state);
+
+        // The agent lists and categories of the main state hold every agent once
+        int n_listed = 0;
+        for (int type = 0; type < state.agent_types.size(); type++) {
+            AgentType& et = state.agent_types[type];
+            CHECK(et.agent_list == recount_agents(state, type));
+            CHECK(grouper_agents(et.follow_ranks) == recount_agents(state, type));
+            n_listed += et.agent_list.size();
+            CHECK_EQUAL(et.agent_list.size(), (size_t) et.agent_cap.back() + et.new_agents);
+        }
+        CHECK_EQUAL(n_agents, n_listed);
+        CHECK(grouper_agents(state.follow_ranks) == recount_agents(state, -1));
+        grouper_agents(state.tweet_ranks);
+        grouper_agents(state.retweet_ranks);
+
+        // The follower counts are those of the follows, and the pool has an entry for each
+        vector<int> n_followers(state.network.size(), 0);
+        for (Agent& agent : state.network) {
+            for (int id_followed : agent.following_set.as_vector()) {
+                n_followers[id_followed]++;
+            }
+        }
+        size_t n_entries = 0;
+        for (Agent& agent : state.network) {
+            CHECK_EQUAL(n_followers[agent.id], (int) agent.follower_set.size());
+            n_entries += n_followers[agent.id] + 1;
+        }
+        CHECK_EQUAL(n_entries, state.follow_endpoints.size());
+    }
+
+    // Tweets and retweets crossing regions are made in one copy of their content per region
+    TEST(cross_region_retweets) {
+        ParsedConfig config = partitioned_config(false);
+        for (AgentType& type : config.agent_types) {
+            Rate_Function& follow = type.RF[0];
+            follow.monthly_rates.assign(follow.monthly_rates.size(), 0.05);
+            Rate_Function& tweet = type.RF[1];
+            tweet.monthly_rates.assign(tweet.monthly_rates.size(), 0.01);
+        }
+        // One language, and the first preference class, which retweets, in every region
+        for (Region& region : config.regions.regions) {
+            region.language_probs.assign(region.language_probs.size(), 0.0);
+            region.language_probs[LANG_ENGLISH] = 1.0;
+            region.language_sampler.build(region.language_probs);
+            region.preference_class_probs.assign(region.preference_class_probs.size(), 0.0);
+            region.preference_class_probs[0] = 1.0;
+            region.preference_class_sampler.build(region.preference_class_probs);
+        }
+        AnalysisState state(config, /*seed*/ 3);
+        begin_partitions(state);
+        for (int i = 0; i < 100; i++) {
+            analyzer_parallel_window(state);
+        }
+        analyzer_parallel_end(state);
+
+        // Every tweet that could be retweeted, expired or active, with its content and tweeter
+        vector<Tweet> tweets = state.tweet_bank.as_vector();
+        vector<TweetRecord> records;
+        state.old_tweets.for_each([&](const TweetRecord& record) {
+            records.push_back(record);
+        });
+        for (Tweet& tweet : tweets) {
+            records.push_back(TweetRecord(tweet));
+        }
+
+        // No agent retweets a content twice, whichever regions it was retweeted in
+        set< pair<int, int> > retweeters;
+        int n_cross_region = 0;
+        for (TweetRecord& record : records) {
+            if (record.generation == 0) {
+                continue;
+            }
+            CHECK(retweeters.insert({record.id_content, record.id_tweeter}).second);
+            Agent& tweeter = state.network[record.id_tweeter];
+            Agent& author = state.network[record.id_original_author];
+            n_cross_region += (tweeter.region_bin != author.region_bin);
+        }
+        CHECK(n_cross_region > 0);
+
+        // Each tweet is counted once among the cascades, with those still active as they stand
+        CascadeStats cascades = state.cascade_stats;
+        set<TweetContent*> active;
+        for (Tweet& tweet : tweets) {
+            if (active.insert(tweet.content.get()).second) {
+                cascades.add(tweet.content->cascade);
+                CHECK_EQUAL((int) tweet.content->used_agents.size(), tweet.content->n_retweeters());
+            }
+        }
+        AgentStats& stats = state.stats.global_stats;
+        CHECK_EQUAL(stats.n_tweets + stats.n_retweets, cascades.total_size);
+    }
+
+    // The simulation times of the rows of DATA_vs_TIME in 'directory'
+    static vector<double> data_vs_time_times(const string& directory) {
+        vector<double> times;
+        ifstream file((directory + "/DATA_vs_TIME").c_str());
+        string line;
+        while (getline(file, line)) {
+            double time;
+            if (istringstream(line) >> time) {
+                times.push_back(time);
+            }
+        }
+        return times;
+    }
+
+    // The summary outputs are checked at the same event times as in a serial run, and windows end
+    // once a row may be due, so rows are written in the same output periods whatever the window length
+    TEST(summary_output_times) {
+        ParsedConfig config = partitioned_config(false);
+        // Dense enough that no output period is free of events, in either run
+        for (AgentType& type : config.agent_types) {
+            Rate_Function& follow = type.RF[0];
+            follow.monthly_rates.assign(follow.monthly_rates.size(), 0.1);
+        }
+        config.parallel_window = 5;
+        config.output_stdout_summary = true;
+        config.summary_output_rate = 1;
+        config.summary_output_rate_real_minutes = false;
+        config.handle_ctrlc = false;
+        config.load_network_on_startup = false;
+        config.output_directory = "output/summary_parallel";
+        AnalysisState parallel(config, /*seed*/ 4);
+        analyzer_main(parallel);
+        config.parallel_regions = false;
+        config.output_directory = "output/summary_serial";
+        AnalysisState serial(config, /*seed*/ 4);
+        analyzer_main(serial);
+
+        // One row per 100 output periods, written by the end of the period a serial run writes it in
+        vector<double> parallel_times = data_vs_time_times("output/summary_parallel");
+        vector<double> serial_times = data_vs_time_times("output/summary_serial");
+        CHECK_EQUAL(10, (int) serial_times.size());
+        CHECK_EQUAL(serial_times.size(), parallel_times.size());
+        for (int i = 0; i < min(serial_times.size(), parallel_times.size()); i++) {
+            CHECK(parallel_times[i] >= serial_times[i]);
+            CHECK(parallel_times[i] - serial_times[i] <= config.summary_output_rate);
+        }
+    }
+}
@@ -0,0 +1,117 @@
+#include <cmath>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+#include "tests.h"
+
+#include "config_dynamic.h"
+#include "analyzer.h"
+
+using namespace std;
+
+SUITE(TauLeaping) {
+
+    // The INFILE of the test directory, with 1000 agents following at a constant rate and never tweeting
+    static ParsedConfig leaping_config(double add_rate) {
+        ParsedConfig config = parse_yaml_configuration("INFILE.yaml-generated");
+        config.initial_agents = 1000;
+        config.max_agents = 2000;
+        config.max_sim_time = 100;
+        config.use_tau_leaping = true;
+        config.use_barabasi = false;
+        config.follow_model = RANDOM_FOLLOW;
+        config.use_followback = false;
+        config.use_follow_via_retweets = false;
+        config.enable_lua_hooks = false;
+        config.enable_interactive_mode = false;
+        config.handle_ctrlc = false;
+        config.load_network_on_startup = false;
+        config.save_network_on_timeout = false;
+        config.output_stdout_basic = config.output_stdout_summary = false;
+        config.output_console = false;
+
+        Rate_Function& add = config.add_rates.RF;
+        add.monthly_rates.assign(add.monthly_rates.size(), add_rate);
+        for (AgentType& type : config.agent_types) {
+            type.RF[0].monthly_rates.assign(type.RF[0].monthly_rates.size(), 0.01);
+            type.RF[1].monthly_rates.assign(type.RF[1].monthly_rates.size(), 0.0);
+        }
+        return config;
+    }
+
+    // With constant rates, the whole run is a single leap with a Poisson number of follows,
+    // ending exactly at max_time
+    TEST(constant_rates) {
+        AnalysisState state(leaping_config(0), /*seed*/ 1);
+        analyzer_main(state);
+        double expected = 1000 * 0.01 * 100;
+        CHECK_EQUAL(100.0, state.time);
+        CHECK(fabs(state.stats.n_steps - expected) < 5 * sqrt(expected));
+        CHECK(state.stats.global_stats.n_follows > 0);
+        CHECK_EQUAL(0, (int) state.stats.global_stats.n_tweets);
+    }
+
+    // A leap cut short by the step limit leaves the clock at its last event
+    TEST(step_limit) {
+        ParsedConfig config = leaping_config(0);
+        config.max_analysis_steps = 100;
+        AnalysisState state(config, /*seed*/ 1);
+        analyzer_main(state);
+        CHECK_EQUAL(100, (int) state.stats.n_steps);
+        // 100 follows at 10 per minute
+        CHECK(state.time > 5.0 && state.time < 20.0);
+    }
+
+    // Agents are added and follow, so that the follow rate grows from zero. The leaps,
+    // once the rates are high enough, give about as many follows as exact steps do
+    TEST(growing_rates) {
+        ParsedConfig config = leaping_config(10.0);
+        config.initial_agents = 10;
+        config.max_agents = 4000;
+        AnalysisState leaping(config, /*seed*/ 1);
+        analyzer_main(leaping);
+        config.use_tau_leaping = false;
+        AnalysisState exact(config, /*seed*/ 1);
+        analyzer_main(exact);
+
+        double n_added = leaping.network.size() - 10, n_exact_added = exact.network.size() - 10;
+        CHECK(fabs(n_added - 1000) < 5 * sqrt(1000));
+        CHECK(fabs(n_added - n_exact_added) < 5 * sqrt(2 * 1000));
+        // The follow rate grows as 0.1 * t per minute, for about 500 follows in either
+        double n_follows = leaping.stats.global_stats.n_follows;
+        double n_exact_follows = exact.stats.global_stats.n_follows;
+        CHECK(n_exact_follows > 300);
+        CHECK(fabs(n_follows - n_exact_follows) < 5 * sqrt(n_follows + n_exact_follows));
+        CHECK(leaping.time >= 100.0);
+    }
+
+    // The summary outputs are checked after every event of a leap, as after every exact step:
+    // each event passing an output period counts once, and a row is written every 100 of them
+    TEST(summary_output_times) {
+        ParsedConfig config = leaping_config(0);
+        config.output_stdout_summary = true;
+        config.summary_output_rate = 0.001;
+        config.summary_output_rate_real_minutes = false;
+        config.output_directory = "output/leap_summary";
+        AnalysisState state(config, /*seed*/ 1);
+        analyzer_main(state);
+
+        vector<double> times;
+        ifstream file("output/leap_summary/DATA_vs_TIME");
+        string line;
+        while (getline(file, line)) {
+            double time;
+            if (istringstream(line) >> time) {
+                times.push_back(time);
+            }
+        }
+        // With 1000 events over 100000 periods, few events share a period
+        int n_outputs = state.stats.n_outputs;
+        CHECK(n_outputs > 0.95 * state.stats.n_steps);
+        CHECK_EQUAL((n_outputs + 99) / 100, (int) times.size());
+        for (int i = 1; i < times.size(); i++) {
+            CHECK(times[i] > times[i - 1] && times[i] < 100.0);
+        }
+    }
+}
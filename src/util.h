@@ -33,6 +33,9 @@
 #include <string>
 #include <sstream>
 #include <limits>
+#include <cerrno>
+
+#include <sys/stat.h>
 
 // Mixed bag of useful functions
 
@@ -61,6 +64,9 @@ inline static void error_exit(const std::string& msg) {
 typedef int int32;
 typedef long long int64;
 typedef int32 ref_t;
+// Names a tweet of a TweetStore
+typedef unsigned int tweet_ref_t;
+const tweet_ref_t NO_TWEET = (tweet_ref_t) -1;
 
 template <typename T>
 inline bool within_range(T val, T a, T b) {
@@ -88,6 +94,11 @@ inline bool file_exists(const std::string& name) {
     }
 }
 
+// Create a directory unless it already exists. Returns false on failure.
+inline bool ensure_directory(const std::string& name) {
+    return mkdir(name.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
 inline double parse_num(std::string s) {
     double ret = 0.0;
     std::stringstream string_converter(s); //** Think of this like 'cin', but instead of standard input its an arbitrary string.
@@ -0,0 +1,127 @@
+#ifndef DenseEdgeSet_H_
+#define DenseEdgeSet_H_
+
+#include <vector>
+#include "HashedEdgeSet.h"
+#include <google/sparse_hash_map>
+
+/*
+ * Edge set holding its elements in a dense vector, with a hash map from
+ * each element to its position in the vector. Erasing moves the last
+ * element into the hole. Unlike HashedEdgeSet, picking an element takes a
+ * single random number and iterating is a linear scan, however many
+ * elements were erased before.
+ *
+ * T must be a pointer, or integer.
+ */
+template<typename T, typename HasherT = Hasher>
+struct DenseEdgeSet {
+    DenseEdgeSet() {
+        positions.set_deleted_key((T) -1);
+    }
+
+    struct iterator {
+        typedef T value_type;
+        int slot;
+        T elem;
+        iterator() :
+                slot(0), elem(-1) {
+        }
+        T get() {
+            DEBUG_CHECK(elem != -1, "Getting invalid element!")
+            return elem;
+        }
+    };
+
+    bool pick_random_uniform(RandomStream& rng, T& elem) {
+        if (UNLIKELY(empty())) {
+            return false;
+        }
+        elem = elems[rng.rand_int(elems.size())];
+        return true;
+    }
+
+    void print() {
+        printf("[");
+        for (T elem : elems) {
+            printf("%d ", elem);
+        }
+        printf("]\n");
+    }
+    bool iterate(iterator& iter) {
+        if (iter.slot >= elems.size()) {
+            // No more elements
+            return false;
+        }
+        iter.elem = elems[iter.slot++];
+        return true;
+    }
+
+    bool contains(const T& elem) {
+        return (positions.find(elem) != positions.end());
+    }
+    bool erase(const T& elem) {
+        typename PositionMap::iterator it = positions.find(elem);
+        if (it == positions.end()) {
+            return false;
+        }
+        int pos = it->second;
+        positions.erase(it);
+        T last = elems.back();
+        elems.pop_back();
+        if (pos < elems.size()) {
+            // Fill the hole with the previously last element
+            elems[pos] = last;
+            positions[last] = pos;
+        }
+        return true;
+    }
+    bool insert(const T& elem) {
+        if (!positions.insert(std::make_pair(elem, (int) elems.size())).second) {
+            return false;
+        }
+        elems.push_back(elem);
+        return true;
+    }
+
+    bool empty() const {
+        return elems.empty();
+    }
+    size_t size() const {
+        return elems.size();
+    }
+    void clear() {
+        elems = std::vector<T>();
+        positions = PositionMap();
+        positions.set_deleted_key((T) -1);
+    }
+
+    std::vector<T> as_vector() {
+        return elems;
+    }
+
+    template <typename Archive>
+    void load(Archive& ar) {
+        clear();
+        size_t size = 0;
+        ar( cereal::make_size_tag(size) );
+        for (int i = 0; i < size; i++) {
+            T elem;
+            ar(elem);
+            insert(elem);
+        }
+    }
+    template <typename Archive>
+    void save(Archive& ar) const {
+        ar( cereal::make_size_tag( (size_t) elems.size() ) );
+        for (const T& elem : elems) {
+            ar(elem);
+        }
+    }
+private:
+    typedef google::sparse_hash_map<T, int, HasherT> PositionMap;
+    std::vector<T> elems;
+    PositionMap positions;
+};
+
+#endif
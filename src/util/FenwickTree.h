@@ -0,0 +1,86 @@
+#ifndef FENWICKTREE_H_
+#define FENWICKTREE_H_
+
+#include <vector>
+
+#include "util.h"
+
+/*
+ * Fenwick (binary indexed) tree over the values of n slots. Changing a
+ * value, taking a prefix sum, and finding the slot that a running sum
+ * lands in are all O(log n).
+ *
+ * T is an arithmetic type. For floating point values, the sums drift
+ * from exact recomputation as updates accumulate; callers that adjust
+ * values indefinitely should call assign() now and then.
+ */
+template <typename T>
+struct FenwickTree {
+    FenwickTree() {
+    }
+    FenwickTree(const std::vector<T>& values) {
+        assign(values);
+    }
+
+    /* Replace all values at once, in O(n) */
+    void assign(const std::vector<T>& values) {
+        int n = values.size();
+        tree.assign(n + 1, T());
+        for (int i = 1; i <= n; i++) {
+            tree[i] += values[i - 1];
+            int parent = i + (i & -i);
+            if (parent <= n) {
+                tree[parent] += tree[i];
+            }
+        }
+        top_bit = 1;
+        while (top_bit * 2 <= n) {
+            top_bit *= 2;
+        }
+    }
+
+    void add(int slot, T delta) {
+        DEBUG_CHECK(within_range(slot, 0, size()), "Slot out of range!");
+        for (int i = slot + 1; i < tree.size(); i += (i & -i)) {
+            tree[i] += delta;
+        }
+    }
+
+    /* The sum of the values of the first n slots */
+    T prefix_sum(int n) const {
+        T sum = T();
+        for (int i = n; i > 0; i -= (i & -i)) {
+            sum += tree[i];
+        }
+        return sum;
+    }
+    T total() const {
+        return prefix_sum(size());
+    }
+    T get(int slot) const {
+        return prefix_sum(slot + 1) - prefix_sum(slot);
+    }
+
+    /* The first slot at which the running sum of values exceeds 'num',
+     * or size() if the sum of all values does not. */
+    int find(T num) const {
+        int pos = 0;
+        for (int step = top_bit; step > 0; step /= 2) {
+            int next = pos + step;
+            if (next < tree.size() && tree[next] <= num) {
+                pos = next;
+                num -= tree[next];
+            }
+        }
+        return pos;
+    }
+
+    int size() const {
+        return tree.empty() ? 0 : tree.size() - 1;
+    }
+private:
+    std::vector<T> tree; // 1-indexed, tree[i] sums the (i & -i) slots ending at slot i - 1
+    int top_bit = 0; // Largest power of two <= size()
+};
+
+#endif
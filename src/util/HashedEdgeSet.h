@@ -2,7 +2,7 @@
 #define HashedEdgeSet_H_
 
 #include <fstream>
-#include "dependencies/mtwist.h"
+#include "RandomStreams.h"
 #include "lcommon/typename.h"
 #include "lcommon/strformat.h"
 #include "serialization.h"
@@ -44,7 +44,7 @@ struct HashedEdgeSet {
         }
     };
 
-    bool pick_random_uniform(MTwist& rng, T& elem) {
+    bool pick_random_uniform(RandomStream& rng, T& elem) {
         if (UNLIKELY(empty())) {
             return false;
         }
@@ -0,0 +1,86 @@
+#ifndef RINGQUEUE_H_
+#define RINGQUEUE_H_
+
+#include <vector>
+
+#include "util.h"
+
+/*
+ * First-in first-out queue over a ring buffer. Pushing at the back and
+ * popping at the front are O(1); when the buffer fills, it is doubled and
+ * the elements are laid out again from its start.
+ *
+ * Serializes as the plain vector of its elements, front first.
+ */
+template <typename T>
+struct RingQueue {
+    RingQueue() {
+        head = count = 0;
+    }
+
+    void push_back(const T& value) {
+        if (count == buffer.size()) {
+            grow();
+        }
+        buffer[wrap(head + count)] = value;
+        count++;
+    }
+
+    T& front() {
+        DEBUG_CHECK(count > 0, "Empty queue!");
+        return buffer[head];
+    }
+
+    void pop_front() {
+        DEBUG_CHECK(count > 0, "Empty queue!");
+        head = wrap(head + 1);
+        count--;
+    }
+
+    // The i'th element from the front
+    T& operator[](size_t i) {
+        DEBUG_CHECK(i < count, "Out of bounds!");
+        return buffer[wrap(head + i)];
+    }
+
+    size_t size() const {
+        return count;
+    }
+    bool empty() const {
+        return count == 0;
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar) {
+        // Saving lays the elements out from the start of the buffer, loading reads them back that way
+        linearize(count);
+        ar(buffer);
+        head = 0;
+        count = buffer.size();
+    }
+private:
+    size_t wrap(size_t i) const {
+        return i < buffer.size() ? i : i - buffer.size();
+    }
+
+    void grow() {
+        linearize(count == 0 ? 4 : count * 2);
+    }
+
+    // Moves the elements to the start of a buffer of the given capacity
+    void linearize(size_t capacity) {
+        std::vector<T> next;
+        next.reserve(capacity);
+        for (size_t i = 0; i < count; i++) {
+            next.push_back(buffer[wrap(head + i)]);
+        }
+        next.resize(capacity);
+        buffer.swap(next);
+        head = 0;
+    }
+
+    std::vector<T> buffer;
+    size_t head, count;
+};
+
+#endif
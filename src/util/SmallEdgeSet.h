@@ -0,0 +1,166 @@
+#ifndef SmallEdgeSet_H_
+#define SmallEdgeSet_H_
+
+#include <memory>
+#include "DenseEdgeSet.h"
+
+/*
+ * An edge set for the many sets that hold only a few elements.
+ * Up to N_INLINE elements are kept in an array inside the object itself;
+ * past that, they are moved to a DenseEdgeSet allocated on the heap.
+ * When that set has shrunk to half of N_INLINE again, the
+ * elements move back inline.
+ *
+ * T must be a pointer, or integer.
+ */
+template<typename T, int N_INLINE = 6, typename HasherT = Hasher>
+struct SmallEdgeSet {
+    SmallEdgeSet() :
+            n_inline(0) {
+    }
+
+    bool pick_random_uniform(RandomStream& rng, T& elem) {
+        if (overflow) {
+            return overflow->pick_random_uniform(rng, elem);
+        }
+        if (UNLIKELY(n_inline == 0)) {
+            return false;
+        }
+        elem = inline_elems[rng.rand_int(n_inline)];
+        return true;
+    }
+
+    template <typename Function>
+    void for_each(Function func) {
+        if (overflow) {
+            typename DenseEdgeSet<T, HasherT>::iterator iter;
+            while (overflow->iterate(iter)) {
+                func(iter.get());
+            }
+            return;
+        }
+        for (int i = 0; i < n_inline; i++) {
+            func(inline_elems[i]);
+        }
+    }
+
+    void print() {
+        if (overflow) {
+            overflow->print();
+            return;
+        }
+        printf("[");
+        for (int i = 0; i < n_inline; i++) {
+            printf("%d ", inline_elems[i]);
+        }
+        printf("]\n");
+    }
+
+    bool contains(const T& elem) {
+        if (overflow) {
+            return overflow->contains(elem);
+        }
+        return find_inline(elem) != -1;
+    }
+    bool erase(const T& elem) {
+        if (overflow) {
+            if (!overflow->erase(elem)) {
+                return false;
+            }
+            if (overflow->size() <= N_INLINE / 2) {
+                demote();
+            }
+            return true;
+        }
+        int i = find_inline(elem);
+        if (i == -1) {
+            return false;
+        }
+        inline_elems[i] = inline_elems[--n_inline];
+        return true;
+    }
+    bool insert(const T& elem) {
+        if (overflow) {
+            return overflow->insert(elem);
+        }
+        if (find_inline(elem) != -1) {
+            return false;
+        }
+        if (n_inline == N_INLINE) {
+            promote();
+            return overflow->insert(elem);
+        }
+        inline_elems[n_inline++] = elem;
+        return true;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+    size_t size() const {
+        return overflow ? overflow->size() : n_inline;
+    }
+    void clear() {
+        overflow.reset();
+        n_inline = 0;
+    }
+
+    std::vector<T> as_vector() {
+        std::vector<T> ret;
+        ret.reserve(size());
+        for_each([&](T elem) {
+            ret.push_back(elem);
+        });
+        return ret;
+    }
+
+    template <typename Archive>
+    void load(Archive& ar) {
+        clear();
+        size_t size = 0;
+        ar( cereal::make_size_tag(size) );
+        for (int i = 0; i < size; i++) {
+            T elem;
+            ar(elem);
+            insert(elem);
+        }
+    }
+    template <typename Archive>
+    void save(Archive& ar) const {
+        auto vec = ((SmallEdgeSet*)this)->as_vector();
+        ar( cereal::make_size_tag( (size_t) vec.size() ) );
+        for (T& elem : vec) {
+            ar(elem);
+        }
+    }
+private:
+    int find_inline(const T& elem) const {
+        for (int i = 0; i < n_inline; i++) {
+            if (inline_elems[i] == elem) {
+                return i;
+            }
+        }
+        return -1;
+    }
+    void promote() {
+        overflow.reset(new DenseEdgeSet<T, HasherT>());
+        for (int i = 0; i < n_inline; i++) {
+            overflow->insert(inline_elems[i]);
+        }
+        n_inline = 0;
+    }
+    void demote() {
+        std::unique_ptr<DenseEdgeSet<T, HasherT>> old = std::move(overflow);
+        n_inline = 0;
+        typename DenseEdgeSet<T, HasherT>::iterator iter;
+        while (old->iterate(iter)) {
+            inline_elems[n_inline++] = iter.get();
+        }
+    }
+
+    int n_inline; // Unused while overflow is allocated
+    T inline_elems[N_INLINE];
+    std::unique_ptr<DenseEdgeSet<T, HasherT>> overflow; // NULL while the elements fit inline
+};
+
+#endif
@@ -42,6 +42,14 @@ struct StatCalc {
         return sqrt(q_value / n_elements);
     }
 
+    // Half-width of the 95% confidence interval of the average (normal approximation)
+    double confidence_interval() {
+        if (n_elements < 2) {
+            return 0;
+        }
+        return 1.96 * sqrt(q_value / (n_elements - 1)) / sqrt(n_elements);
+    }
+
     void print_summary() {
         printf("%d Elements in Distribution\nMin %.2f Max %.2f Sum %.2f\nAvg %.2f (+-%.2f)\n",
                 int(n_elements), min, max, sum, average, standard_deviation());
@@ -0,0 +1,423 @@
+#ifndef USEDAGENTSET_H_
+#define USEDAGENTSET_H_
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+
+#include "util.h"
+#include "serialization.h"
+
+/*
+ * The set of agents that have retweeted a tweet's content. Elements are
+ * only ever added.
+ *
+ * Up to N_INLINE ids are kept in an array inside the object itself. Past
+ * that, they move to a roaring-style bitmap: the ids are grouped by their
+ * upper 16 bits, and each group is a sorted array of the lower 16 bits
+ * while it has at most ARRAY_MAX of them, and a bitmap of 2^16 bits after.
+ *
+ * An approximate set is exact too until it holds more than FILTER_MIN_SIZE
+ * ids, where the first slice of a scalable Bloom filter becomes smaller than
+ * the arrays. It then moves to the filter. Each slice holds twice the ids of
+ * the one before, with one more hash, so that its false positive rate is
+ * halved; a new slice is started when the last is full. An element the set
+ * has seen is always reported as contained, and one it has not with a
+ * probability of at most about the sum of the slices' rates,
+ * 2^-(FILTER_HASHES - 1) or 0.8%, however many elements there are.
+ * Inserting those is refused.
+ * Slice i takes (FILTER_HASHES + i) / ln(2) bits per element it can hold,
+ * 1.4 bytes for the first. The size is the number of insertions that went
+ * through, and as_vector() is empty.
+ *
+ * Ids must be non-negative.
+ */
+struct UsedAgentSet {
+    UsedAgentSet() {
+        n_inline = 0;
+        approximate = false;
+    }
+    UsedAgentSet(const UsedAgentSet& o) {
+        *this = o;
+    }
+    UsedAgentSet& operator=(const UsedAgentSet& o) {
+        n_inline = o.n_inline;
+        approximate = o.approximate;
+        std::copy(o.inline_elems, o.inline_elems + o.n_inline, inline_elems);
+        overflow.reset(o.overflow ? new Overflow(*o.overflow) : NULL);
+        return *this;
+    }
+
+    // Only sets created empty can be made approximate
+    void set_approximate(bool approximate) {
+        DEBUG_CHECK(empty(), "Set is not empty!");
+        this->approximate = approximate;
+    }
+    bool is_approximate() const {
+        return approximate;
+    }
+
+    bool contains(int elem) const {
+        if (!overflow) {
+            return find_inline(elem);
+        }
+        if (overflow->is_filter()) {
+            return overflow->filter_contains(elem);
+        }
+        const Container* c = overflow->find(elem >> 16);
+        return c != NULL && c->contains(elem & 0xFFFF);
+    }
+
+    // Returns whether the element was new
+    bool insert(int elem) {
+        DEBUG_CHECK(elem >= 0, "Negative id!");
+        if (!overflow) {
+            if (find_inline(elem)) {
+                return false;
+            }
+            if (n_inline < N_INLINE) {
+                inline_elems[n_inline++] = elem;
+                return true;
+            }
+            promote();
+        }
+        if (overflow->is_filter()) {
+            return overflow->filter_insert(elem);
+        }
+        if (!overflow->insert(elem)) {
+            return false;
+        }
+        if (approximate && overflow->size > FILTER_MIN_SIZE) {
+            overflow->move_to_filter();
+        }
+        return true;
+    }
+
+    // Add the elements of 'o'. If it is past its exact size, it must have none in common with this set.
+    void merge(const UsedAgentSet& o) {
+        if (!o.overflow || !o.overflow->is_filter()) {
+            o.for_each([&](int elem) {
+                insert(elem);
+            });
+            return;
+        }
+        DEBUG_CHECK(approximate, "Set is not approximate!");
+        if (!overflow) {
+            promote();
+        }
+        if (!overflow->is_filter()) {
+            overflow->move_to_filter();
+        }
+        // An element is looked up in every slice, so those of 'o' are added as they are
+        std::vector<Slice>& filter = overflow->filter;
+        filter.insert(filter.end(), o.overflow->filter.begin(), o.overflow->filter.end());
+        overflow->size += o.overflow->size;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+    size_t size() const {
+        if (!overflow) {
+            return n_inline;
+        }
+        return overflow->size;
+    }
+
+    template <typename Function>
+    void for_each(Function func) const {
+        if (!overflow) {
+            for (int i = 0; i < n_inline; i++) {
+                func(inline_elems[i]);
+            }
+            return;
+        }
+        // Empty once an approximate set uses its filter
+        for (const Container& c : overflow->containers) {
+            c.for_each([&](int low) {
+                func((c.key << 16) | low);
+            });
+        }
+    }
+
+    std::vector<int> as_vector() const {
+        std::vector<int> ret;
+        if (!overflow || !overflow->is_filter()) {
+            ret.reserve(size());
+        }
+        for_each([&](int elem) {
+            ret.push_back(elem);
+        });
+        return ret;
+    }
+
+    void clear() {
+        n_inline = 0;
+        overflow.reset();
+    }
+
+    template <typename Archive>
+    void save(Archive& ar) const {
+        ar(approximate, n_inline);
+        for (int i = 0; i < n_inline; i++) {
+            ar(inline_elems[i]);
+        }
+        bool has_overflow = (overflow != NULL);
+        ar(has_overflow);
+        if (!has_overflow) {
+            return;
+        }
+        if (approximate) {
+            // The filter has no slices until the set moves to it, the ids follow until then
+            ar(overflow->size, overflow->filter);
+            if (overflow->is_filter()) {
+                return;
+            }
+        }
+        ar( cereal::make_size_tag( (size_t) overflow->size ) );
+        for_each([&](int elem) {
+            ar(elem);
+        });
+    }
+    template <typename Archive>
+    void load(Archive& ar) {
+        ar(approximate, n_inline);
+        for (int i = 0; i < n_inline; i++) {
+            ar(inline_elems[i]);
+        }
+        overflow.reset();
+        bool has_overflow = false;
+        ar(has_overflow);
+        if (!has_overflow) {
+            return;
+        }
+        overflow.reset(new Overflow());
+        if (approximate) {
+            ar(overflow->size, overflow->filter);
+            if (overflow->is_filter()) {
+                return;
+            }
+            overflow->size = 0; // Counted again below
+        }
+        size_t size = 0;
+        ar( cereal::make_size_tag(size) );
+        for (size_t i = 0; i < size; i++) {
+            int elem;
+            ar(elem);
+            overflow->insert(elem);
+        }
+    }
+private:
+    static const int N_INLINE = 8;
+    // The largest array container, past which a bitmap is smaller
+    static const int ARRAY_MAX = 4096;
+    // Slice i of the Bloom filter holds FILTER_CAPACITY << i elements,
+    // and sets FILTER_HASHES + i of its bits for each
+    static const int FILTER_CAPACITY = 1024;
+    static const int FILTER_HASHES = 8;
+    // The exact ids take 2 bytes each, and the first slice about 1.4 bytes per element
+    static const int FILTER_MIN_SIZE = FILTER_CAPACITY;
+
+    // The ids sharing their upper 16 bits
+    struct Container {
+        uint16_t key;
+        std::vector<uint16_t> array; // Sorted, while there is no bitmap
+        std::vector<uint64_t> bitmap; // 2^16 bits, once the array is too big
+
+        bool contains(uint16_t low) const {
+            if (!bitmap.empty()) {
+                return (bitmap[low >> 6] >> (low & 63)) & 1;
+            }
+            return std::binary_search(array.begin(), array.end(), low);
+        }
+        bool insert(uint16_t low) {
+            if (!bitmap.empty()) {
+                uint64_t bit = uint64_t(1) << (low & 63);
+                if (bitmap[low >> 6] & bit) {
+                    return false;
+                }
+                bitmap[low >> 6] |= bit;
+                return true;
+            }
+            auto iter = std::lower_bound(array.begin(), array.end(), low);
+            if (iter != array.end() && *iter == low) {
+                return false;
+            }
+            array.insert(iter, low);
+            if (array.size() > ARRAY_MAX) {
+                bitmap.assign((1 << 16) / 64, 0);
+                for (uint16_t elem : array) {
+                    bitmap[elem >> 6] |= uint64_t(1) << (elem & 63);
+                }
+                std::vector<uint16_t>().swap(array);
+            }
+            return true;
+        }
+        template <typename Function>
+        void for_each(Function func) const {
+            if (bitmap.empty()) {
+                for (uint16_t low : array) {
+                    func(low);
+                }
+                return;
+            }
+            for (int word = 0; word < bitmap.size(); word++) {
+                uint64_t bits = bitmap[word];
+                while (bits != 0) {
+                    func(word * 64 + __builtin_ctzll(bits));
+                    bits &= bits - 1;
+                }
+            }
+        }
+    };
+
+    // One slice of the Bloom filter
+    struct Slice {
+        int n_hashes = 0;
+        size_t capacity = 0, size = 0;
+        std::vector<uint64_t> bits;
+
+        Slice() {
+        }
+        // The 'i'th slice, with the number of bits for which its hashes are optimal once full
+        explicit Slice(int i) : n_hashes(FILTER_HASHES + i), capacity(size_t(FILTER_CAPACITY) << i) {
+            size_t n_bits = (size_t) ceil(capacity * n_hashes / log(2.0));
+            bits.assign((n_bits + 63) / 64, 0);
+        }
+        bool full() const {
+            return size >= capacity;
+        }
+
+        bool contains(uint64_t hash) const {
+            for (int i = 0; i < n_hashes; i++) {
+                uint64_t bit = filter_bit(hash, i);
+                if (!((bits[bit >> 6] >> (bit & 63)) & 1)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        void set(uint64_t hash) {
+            for (int i = 0; i < n_hashes; i++) {
+                uint64_t bit = filter_bit(hash, i);
+                bits[bit >> 6] |= uint64_t(1) << (bit & 63);
+            }
+            size++;
+        }
+        // Double hashing, from the two halves of the hash, scaled to the number of bits
+        uint64_t filter_bit(uint64_t hash, int i) const {
+            uint32_t h1 = hash, h2 = hash >> 32;
+            return (uint64_t(uint32_t(h1 + i * h2)) * (bits.size() * 64)) >> 32;
+        }
+
+        template <typename Archive>
+        void serialize(Archive& ar) {
+            ar(NVP(n_hashes), NVP(capacity), NVP(size), NVP(bits));
+        }
+    };
+
+    struct Overflow {
+        // Exact: sorted by key
+        std::vector<Container> containers;
+        // Approximate: the slices of the Bloom filter, none until the set moves to it
+        std::vector<Slice> filter;
+        size_t size = 0;
+
+        const Container* find(int key) const {
+            auto iter = std::lower_bound(containers.begin(), containers.end(), key,
+                    [](const Container& c, int key) {
+                return c.key < key;
+            });
+            if (iter == containers.end() || iter->key != key) {
+                return NULL;
+            }
+            return &*iter;
+        }
+        bool insert(int elem) {
+            int key = elem >> 16;
+            auto iter = std::lower_bound(containers.begin(), containers.end(), key,
+                    [](const Container& c, int key) {
+                return c.key < key;
+            });
+            if (iter == containers.end() || iter->key != key) {
+                iter = containers.insert(iter, Container());
+                iter->key = key;
+            }
+            if (!iter->insert(elem & 0xFFFF)) {
+                return false;
+            }
+            size++;
+            return true;
+        }
+
+        bool is_filter() const {
+            return !filter.empty();
+        }
+        // Replace the containers by a filter holding the same ids
+        void move_to_filter() {
+            for (const Container& c : containers) {
+                c.for_each([&](int low) {
+                    filter_set((c.key << 16) | low);
+                });
+            }
+            std::vector<Container>().swap(containers);
+        }
+
+        bool filter_contains(int elem) const {
+            uint64_t hash = mix(elem);
+            for (const Slice& slice : filter) {
+                if (slice.contains(hash)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        bool filter_insert(int elem) {
+            if (filter_contains(elem)) {
+                return false;
+            }
+            filter_set(elem);
+            size++;
+            return true;
+        }
+        // Set in the last slice, starting the next once it is full
+        void filter_set(int elem) {
+            if (filter.empty() || filter.back().full()) {
+                filter.emplace_back((int) filter.size());
+            }
+            filter.back().set(mix(elem));
+        }
+        // The splitmix64 finalizer
+        static uint64_t mix(uint64_t x) {
+            x += 0x9E3779B97F4A7C15ULL;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+            return x ^ (x >> 31);
+        }
+    };
+
+    bool find_inline(int elem) const {
+        for (int i = 0; i < n_inline; i++) {
+            if (inline_elems[i] == elem) {
+                return true;
+            }
+        }
+        return false;
+    }
+    void promote() {
+        overflow.reset(new Overflow());
+        for (int i = 0; i < n_inline; i++) {
+            overflow->insert(inline_elems[i]);
+        }
+        n_inline = 0;
+    }
+
+    int inline_elems[N_INLINE];
+    int n_inline;
+    bool approximate;
+    std::unique_ptr<Overflow> overflow;
+};
+
+#endif